@@ -255,6 +255,7 @@ DEPENDPATH += $$PWD/src \
               $$PWD/src/FilterSelector/FiltersView \
 
 HEADERS +=  \
+  src/BatchProcessor.h \
   src/ClickableLabel.h \
   src/Common.h \
   src/FilterParameters/CustomSpinBox.h \
@@ -281,6 +282,7 @@ HEADERS +=  \
   src/FilterParameters/SeparatorParameter.h \
   src/FilterParameters/TextParameter.h \
   src/FilterSelector/FiltersModel.h \
+  src/FilterSelector/FiltersModelCache.h \
   src/FilterSelector/FiltersModelReader.h \
   src/FilterSelector/FiltersPresenter.h \
   src/FilterSelector/FiltersView/FiltersView.h \
@@ -336,6 +338,7 @@ HEADERS += $$GMIC_PATH/CImg.h
 HEADERS += $$GMIC_PATH/gmic_stdlib_community.h
 
 SOURCES += \
+  src/BatchProcessor.cpp \
   src/ClickableLabel.cpp \
   src/Common.cpp \
   src/FilterParameters/CustomSpinBox.cpp \
@@ -361,6 +364,7 @@ SOURCES += \
   src/FilterParameters/SeparatorParameter.cpp \
   src/FilterParameters/TextParameter.cpp \
   src/FilterSelector/FiltersModel.cpp \
+  src/FilterSelector/FiltersModelCache.cpp \
   src/FilterSelector/FiltersModelReader.cpp \
   src/FilterSelector/FiltersPresenter.cpp \
   src/FilterSelector/FiltersView/FiltersView.cpp \
@@ -0,0 +1,311 @@
+/** -*- mode: c++ ; c-basic-offset: 2 -*-
+ *
+ *  @file BatchProcessor.cpp
+ *
+ *  Copyright 2017 Sebastien Fourey
+ *
+ *  This file is part of G'MIC-Qt, a generic plug-in for raster graphics
+ *  editors, offering hundreds of filters thanks to the underlying G'MIC
+ *  image processing framework.
+ *
+ *  gmic_qt is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gmic_qt is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with gmic_qt.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "BatchProcessor.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImage>
+#include <QThread>
+#include <algorithm>
+#include "FilterThread.h"
+#include "Logger.h"
+#ifndef gmic_core
+#include "CImg.h"
+#endif
+#include "gmic.h"
+
+namespace
+{
+
+class ImageReader : public QThread {
+public:
+  ImageReader(QObject * parent, const QString & filename) : QThread(parent), _filename(filename), _duration(0), _ok(false) {}
+  void run() override
+  {
+    QElapsedTimer timer;
+    timer.start();
+    QImage image;
+    _ok = image.load(_filename);
+    if (_ok) {
+      _images.assign(1);
+      GmicQt::convertQImageToCImg(image.convertToFormat(QImage::Format_ARGB32), _images[0]);
+      QString name = QFileInfo(_filename).fileName();
+      name.replace(QChar('('), QChar(21)).replace(QChar(')'), QChar(22));
+      const QByteArray ba = QString("pos(0,0),name(%1)").arg(name).toUtf8();
+      _imageNames.assign(1);
+      gmic_image<char>::string(ba.constData()).move_to(_imageNames[0]);
+    }
+    _duration = static_cast<int>(timer.elapsed());
+  }
+  const QString & filename() const { return _filename; }
+  gmic_list<float> & images() { return _images; }
+  const gmic_list<char> & imageNames() const { return _imageNames; }
+  int duration() const { return _duration; }
+  bool ok() const { return _ok; }
+
+private:
+  QString _filename;
+  gmic_list<float> _images;
+  gmic_list<char> _imageNames;
+  int _duration;
+  bool _ok;
+};
+
+class ImageWriter : public QThread {
+public:
+  ImageWriter(QObject * parent, const QString & inputFilename, const QString & outputFilename, int jpegQuality)
+      : QThread(parent), _inputFilename(inputFilename), _outputFilename(outputFilename), _jpegQuality(jpegQuality), _readDuration(0), _filterDuration(0), _duration(0), _ok(false)
+  {
+  }
+  void run() override
+  {
+    QElapsedTimer timer;
+    timer.start();
+    _ok = false;
+    if (_images.size()) { // As in host_none, only the first output image is saved
+      QImage image;
+      GmicQt::convertCImgToQImage(_images[0], image);
+      _images.assign();
+      _ok = image.save(_outputFilename, nullptr, _jpegQuality);
+    }
+    _duration = static_cast<int>(timer.elapsed());
+  }
+  gmic_list<float> & images() { return _images; }
+  void setDurations(int read, int filter)
+  {
+    _readDuration = read;
+    _filterDuration = filter;
+  }
+  const QString & inputFilename() const { return _inputFilename; }
+  const QString & outputFilename() const { return _outputFilename; }
+  int readDuration() const { return _readDuration; }
+  int filterDuration() const { return _filterDuration; }
+  int duration() const { return _duration; }
+  bool ok() const { return _ok; }
+
+private:
+  QString _inputFilename;
+  QString _outputFilename;
+  int _jpegQuality;
+  gmic_list<float> _images;
+  int _readDuration;
+  int _filterDuration;
+  int _duration;
+  bool _ok;
+};
+
+} // namespace
+
+namespace GmicQt
+{
+
+BatchProcessor::BatchProcessor(QObject * parent) : QObject(parent), _filter(this)
+{
+  _jobCount = std::max(1, QThread::idealThreadCount());
+  _jpegQuality = -1;
+  _nextInputFile = 0;
+  _failureCount = 0;
+}
+
+BatchProcessor::~BatchProcessor()
+{
+  for (Job & job : _runningJobs) {
+    job.filterThread->disconnect(this);
+    job.filterThread->abortGmic();
+    job.filterThread->wait();
+  }
+  for (QThread * thread : _readers + _writers) {
+    thread->disconnect(this);
+    thread->wait();
+  }
+  qDeleteAll(_interpreters);
+}
+
+bool BatchProcessor::setPluginParameters(const RunParameters & parameters)
+{
+  if (!_filter.setPluginParameters(parameters)) {
+    _errorMessage = _filter.error();
+    return false;
+  }
+  return true;
+}
+
+const QString & BatchProcessor::error() const
+{
+  return _errorMessage;
+}
+
+void BatchProcessor::setInputFiles(const QStringList & filenames)
+{
+  _inputFiles = filenames;
+}
+
+void BatchProcessor::setOutputPattern(const QString & pattern)
+{
+  _outputPattern = pattern;
+}
+
+void BatchProcessor::setJobCount(int count)
+{
+  _jobCount = (count > 0) ? count : std::max(1, QThread::idealThreadCount());
+}
+
+int BatchProcessor::jobCount() const
+{
+  return _jobCount;
+}
+
+void BatchProcessor::setJpegQuality(int quality)
+{
+  _jpegQuality = quality;
+}
+
+int BatchProcessor::failureCount() const
+{
+  return _failureCount;
+}
+
+QString BatchProcessor::outputFilename(const QString & pattern, const QString & inputFilename)
+{
+  QString result = pattern;
+  if (result.contains("%b")) {
+    result.replace("%b", QFileInfo(inputFilename).completeBaseName());
+  }
+  if (result.contains("%f")) {
+    result.replace("%f", QFileInfo(inputFilename).fileName());
+  }
+  return result;
+}
+
+void BatchProcessor::start()
+{
+  Logger::log(QString("Batch processing %1 file(s) with %2 job(s): %3 %4").arg(_inputFiles.size()).arg(_jobCount).arg(_filter.command()).arg(_filter.arguments()));
+  _interpreters.fill(nullptr, _jobCount); // Interpreters are created by the filter threads, on first use
+  _idleInterpreters.clear();
+  for (int i = 0; i < _jobCount; ++i) {
+    _idleInterpreters.push_back(i);
+  }
+  schedule();
+}
+
+void BatchProcessor::schedule()
+{
+  // Output images waiting to be written are bounded as well, so that slow disks throttle filtering
+  while ((_runningJobs.size() < _jobCount) && (_writers.size() < _jobCount) && !_readyInputs.isEmpty()) {
+    auto reader = static_cast<ImageReader *>(_readyInputs.takeFirst());
+    Job job;
+    job.filename = reader->filename();
+    job.readDuration = reader->duration();
+    job.filterThread = new FilterThread(this, _filter.command(), _filter.arguments(), _filter.environment(), _filter.outputMessageMode());
+    job.interpreter = _idleInterpreters.takeFirst();
+    job.filterThread->setInterpreterSlot(&_interpreters[job.interpreter]);
+    job.filterThread->swapImages(reader->images());
+    job.filterThread->setImageNames(reader->imageNames());
+    delete reader;
+    FilterThread * thread = job.filterThread;
+    connect(thread, &QThread::finished, this, [this, thread]() { onFilterThreadFinished(thread); });
+    _runningJobs.push_back(job);
+    thread->start();
+  }
+  while ((_nextInputFile < _inputFiles.size()) && ((_readers.size() + _readyInputs.size()) < _jobCount)) {
+    auto reader = new ImageReader(this, _inputFiles[_nextInputFile++]);
+    connect(reader, &QThread::finished, this, [this, reader]() { onReaderFinished(reader); });
+    _readers.push_back(reader);
+    reader->start();
+  }
+  if (isDone()) {
+    Logger::log(QString("Batch processing done (%1 file(s), %2 failure(s))").arg(_inputFiles.size()).arg(_failureCount));
+    emit done(_failureCount);
+    QCoreApplication::exit(_failureCount ? 1 : 0);
+  }
+}
+
+void BatchProcessor::onReaderFinished(QThread * thread)
+{
+  thread->wait(); // finished() is emitted right before the thread actually ends
+  _readers.removeOne(thread);
+  auto reader = static_cast<ImageReader *>(thread);
+  if (reader->ok()) {
+    _readyInputs.push_back(reader);
+  } else {
+    fail(reader->filename(), tr("Could not read image file"));
+    delete reader;
+  }
+  schedule();
+}
+
+void BatchProcessor::onFilterThreadFinished(FilterThread * thread)
+{
+  auto it = std::find_if(_runningJobs.begin(), _runningJobs.end(), [thread](const Job & job) { return job.filterThread == thread; });
+  Q_ASSERT_X(it != _runningJobs.end(), __PRETTY_FUNCTION__, "Unknown filter thread");
+  const Job job = *it;
+  _runningJobs.erase(it);
+  thread->wait(); // The interpreter slot may be used again as soon as the thread has actually ended
+  _idleInterpreters.push_back(job.interpreter);
+  if (thread->failed()) {
+    fail(job.filename, thread->errorMessage());
+  } else {
+    auto writer = new ImageWriter(this, job.filename, outputFilename(_outputPattern, job.filename), _jpegQuality);
+    writer->setDurations(job.readDuration, thread->duration());
+    thread->swapImages(writer->images());
+    connect(writer, &QThread::finished, this, [this, writer]() { onWriterFinished(writer); });
+    _writers.push_back(writer);
+    writer->start();
+  }
+  thread->deleteLater();
+  schedule();
+}
+
+void BatchProcessor::onWriterFinished(QThread * thread)
+{
+  thread->wait();
+  _writers.removeOne(thread);
+  auto writer = static_cast<ImageWriter *>(thread);
+  if (writer->ok()) {
+    Logger::log(QString("%1 -> %2 [read %3 ms | filter %4 ms | write %5 ms]")
+                    .arg(writer->inputFilename())
+                    .arg(writer->outputFilename())
+                    .arg(writer->readDuration())
+                    .arg(writer->filterDuration())
+                    .arg(writer->duration()));
+  } else {
+    fail(writer->inputFilename(), tr("Could not write output file %1").arg(writer->outputFilename()));
+  }
+  delete writer;
+  schedule();
+}
+
+void BatchProcessor::fail(const QString & filename, const QString & message)
+{
+  ++_failureCount;
+  Logger::error(QString("%1: %2").arg(filename).arg(message));
+}
+
+bool BatchProcessor::isDone() const
+{
+  return (_nextInputFile >= _inputFiles.size()) && _readers.isEmpty() && _readyInputs.isEmpty() && _runningJobs.isEmpty() && _writers.isEmpty();
+}
+
+} // namespace GmicQt
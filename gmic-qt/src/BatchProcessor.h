@@ -0,0 +1,108 @@
+/** -*- mode: c++ ; c-basic-offset: 2 -*-
+ *
+ *  @file BatchProcessor.h
+ *
+ *  Copyright 2017 Sebastien Fourey
+ *
+ *  This file is part of G'MIC-Qt, a generic plug-in for raster graphics
+ *  editors, offering hundreds of filters thanks to the underlying G'MIC
+ *  image processing framework.
+ *
+ *  gmic_qt is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gmic_qt is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with gmic_qt.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef GMIC_QT_BATCHPROCESSOR_H
+#define GMIC_QT_BATCHPROCESSOR_H
+
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "GmicQt.h"
+#include "HeadlessProcessor.h"
+
+class QThread;
+struct gmic;
+
+namespace GmicQt
+{
+class FilterThread;
+
+/**
+ * @brief Applies a single filter to a list of image files, without any user interface.
+ *
+ * Up to jobCount() filter threads run concurrently. Input files are read
+ * ahead of time by reader threads (at most jobCount() images are kept
+ * waiting), and output files are written by writer threads so that the
+ * filter threads never wait for disk I/O. Each of the jobCount() slots keeps
+ * its own G'MIC interpreter, created with the first file it processes and
+ * reused for the next ones, so the stdlib is parsed at most once per slot.
+ */
+class BatchProcessor : public QObject {
+  Q_OBJECT
+
+public:
+  explicit BatchProcessor(QObject * parent);
+  ~BatchProcessor() override;
+  bool setPluginParameters(const RunParameters & parameters);
+  const QString & error() const;
+  void setInputFiles(const QStringList & filenames);
+  void setOutputPattern(const QString & pattern);
+  void setJobCount(int count);
+  int jobCount() const;
+  void setJpegQuality(int quality);
+  int failureCount() const;
+  static QString outputFilename(const QString & pattern, const QString & inputFilename);
+
+public slots:
+  void start();
+
+signals:
+  void done(int failureCount);
+
+private:
+  struct Job {
+    QString filename;
+    int readDuration = 0;
+    int filterDuration = 0;
+    FilterThread * filterThread = nullptr;
+    int interpreter = -1;
+  };
+  void schedule();
+  void onReaderFinished(QThread * reader);
+  void onFilterThreadFinished(FilterThread * thread);
+  void onWriterFinished(QThread * writer);
+  void fail(const QString & filename, const QString & message);
+  bool isDone() const;
+
+  HeadlessProcessor _filter;
+  QString _errorMessage;
+  QStringList _inputFiles;
+  QString _outputPattern;
+  int _jobCount;
+  int _jpegQuality;
+  int _nextInputFile;
+  int _failureCount;
+  QList<QThread *> _readers;
+  QList<QThread *> _readyInputs;
+  QList<Job> _runningJobs;
+  QList<QThread *> _writers;
+  QVector<gmic *> _interpreters;
+  QList<int> _idleInterpreters;
+};
+
+} // namespace GmicQt
+
+#endif // GMIC_QT_BATCHPROCESSOR_H
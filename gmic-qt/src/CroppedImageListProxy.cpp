@@ -55,6 +55,19 @@ void CroppedImageListProxy::get(cimg_library::CImgList<gmic_pixel_type> & images
   imageNames = *_cachedImageNames;
 }
 
+void CroppedImageListProxy::take(cimg_library::CImgList<gmic_pixel_type> & images, cimg_library::CImgList<char> & imageNames, double x, double y, double width, double height, InputMode mode,
+                                 double zoom)
+{
+  if ((x != _x) || (y != _y) || (width != _width) || (height != _height) || (mode != _inputMode) || (zoom != _zoom)) {
+    update(x, y, width, height, mode, zoom);
+  }
+  images.assign();
+  imageNames.assign();
+  _cachedImageList->swap(images);
+  _cachedImageNames->swap(imageNames);
+  clear();
+}
+
 void CroppedImageListProxy::update(double x, double y, double width, double height, InputMode mode, double zoom)
 {
   _x = x;
@@ -42,6 +42,8 @@ public:
   CroppedImageListProxy() = delete;
 
   static void get(cimg_library::CImgList<gmic_pixel_type> & images, cimg_library::CImgList<char> & imageNames, double x, double y, double width, double height, InputMode mode, double zoom);
+  // Same as get(), but the cached list is moved out (no copy) and the cache is cleared
+  static void take(cimg_library::CImgList<gmic_pixel_type> & images, cimg_library::CImgList<char> & imageNames, double x, double y, double width, double height, InputMode mode, double zoom);
   static void update(double x, double y, double width, double height, InputMode mode, double zoom);
   static void clear();
 
@@ -74,6 +74,10 @@ DialogSettings::DialogSettings(QWidget * parent) : QDialog(parent), ui(new Ui::D
   }
 
   ui->sbPreviewTimeout->setRange(0, 999);
+  ui->sbPreviewLatencyTarget->setRange(0, 5000);
+  ui->sbPreviewLatencyTarget->setSingleStep(50);
+  ui->sbPreviewLatencyTarget->setSpecialValueText(tr("Off"));
+  ui->sbPreviewLatencyTarget->setToolTip(tr("Preview resolution is reduced while parameters are changing, if needed to meet this delay"));
 
   ui->rbLeftPreview->setChecked(Settings::previewPosition() == MainWindow::PreviewPosition::Left);
   ui->rbRightPreview->setChecked(Settings::previewPosition() == MainWindow::PreviewPosition::Right);
@@ -87,7 +91,10 @@ DialogSettings::DialogSettings(QWidget * parent) : QDialog(parent), ui(new Ui::D
   ui->cbNativeColorDialogs->setToolTip(tr("Check to use Native/OS color dialog, uncheck to use Qt's"));
   ui->cbShowLogos->setChecked(Settings::visibleLogos());
   ui->sbPreviewTimeout->setValue(Settings::previewTimeout());
+  ui->sbPreviewLatencyTarget->setValue(Settings::previewLatencyTarget());
   ui->cbPreviewZoom->setChecked(Settings::previewZoomAlwaysEnabled());
+  ui->cbProgressivePreview->setChecked(Settings::progressivePreview());
+  ui->cbProgressivePreview->setToolTip(tr("For slow filters, display a low resolution preview first"));
   ui->cbNotifyFailedUpdate->setChecked(Settings::notifyFailedStartupUpdate());
 
   connect(ui->pbOk, SIGNAL(clicked()), this, SLOT(onOk()));
@@ -113,7 +120,9 @@ DialogSettings::DialogSettings(QWidget * parent) : QDialog(parent), ui(new Ui::D
 #endif
   connect(ui->cbShowLogos, SIGNAL(toggled(bool)), this, SLOT(onVisibleLogosToggled(bool)));
   connect(ui->cbPreviewZoom, SIGNAL(toggled(bool)), this, SLOT(onPreviewZoomToggled(bool)));
+  connect(ui->cbProgressivePreview, SIGNAL(toggled(bool)), this, SLOT(onProgressivePreviewToggled(bool)));
   connect(ui->sbPreviewTimeout, SIGNAL(valueChanged(int)), this, SLOT(onPreviewTimeoutChange(int)));
+  connect(ui->sbPreviewLatencyTarget, SIGNAL(valueChanged(int)), this, SLOT(onPreviewLatencyTargetChange(int)));
   connect(ui->outputMessages, SIGNAL(currentIndexChanged(int)), this, SLOT(onOutputMessageModeChanged(int)));
 
 #ifdef _GMIC_QT_DISABLE_UPDATES_
@@ -139,6 +148,7 @@ DialogSettings::DialogSettings(QWidget * parent) : QDialog(parent), ui(new Ui::D
     p.setColor(QPalette::Base, Settings::CheckBoxBaseColor);
     ui->cbNativeColorDialogs->setPalette(p);
     ui->cbPreviewZoom->setPalette(p);
+    ui->cbProgressivePreview->setPalette(p);
     ui->cbUpdatePeriodicity->setPalette(p);
     ui->rbDarkTheme->setPalette(p);
     ui->rbDefaultTheme->setPalette(p);
@@ -179,6 +189,11 @@ void DialogSettings::onPreviewTimeoutChange(int value)
   Settings::setPreviewTimeout(value);
 }
 
+void DialogSettings::onPreviewLatencyTargetChange(int value)
+{
+  Settings::setPreviewLatencyTarget(value);
+}
+
 void DialogSettings::onOutputMessageModeChanged(int)
 {
   const OutputMessageMode mode = static_cast<OutputMessageMode>(ui->outputMessages->currentData().toInt());
@@ -191,6 +206,11 @@ void DialogSettings::onPreviewZoomToggled(bool on)
   Settings::setPreviewZoomAlwaysEnabled(on);
 }
 
+void DialogSettings::onProgressivePreviewToggled(bool on)
+{
+  Settings::setProgressivePreview(on);
+}
+
 void DialogSettings::onNotifyStartupUpdateFailedToggle(bool on)
 {
   Settings::setNotifyFailedStartupUpdate(on);
@@ -56,8 +56,10 @@ public slots:
   void done(int r) override;
   void onVisibleLogosToggled(bool);
   void onPreviewTimeoutChange(int);
+  void onPreviewLatencyTargetChange(int);
   void onOutputMessageModeChanged(int);
   void onPreviewZoomToggled(bool);
+  void onProgressivePreviewToggled(bool);
   void onNotifyStartupUpdateFailedToggle(bool);
 
 private:
@@ -24,6 +24,7 @@
  */
 #include "FilterSelector/FiltersModel.h"
 #include <QCryptographicHash>
+#include <QDataStream>
 #include <QDebug>
 #include <limits>
 #include "Common.h"
@@ -313,6 +314,28 @@ bool FiltersModel::Filter::matchFullPath(const QList<QString> & pathToMatch) con
   return (itToMatch == pathToMatch.cend()) || ((it == _plainPath.cend()) && (itToMatch != pathToMatch.cend()) && (_plainText == *itToMatch));
 }
 
+QDataStream & operator<<(QDataStream & stream, const FiltersModel::Filter & filter)
+{
+  stream << filter._name << filter._plainText << filter._translatedPlainText;
+  stream << filter._path << filter._plainPath << filter._translatedPlainPath;
+  stream << filter._command << filter._previewCommand << static_cast<qint32>(filter._defaultInputMode);
+  stream << filter._parameters << filter._previewFactor << filter._isAccurateIfZoomed;
+  stream << filter._previewFromFullImage << filter._hash << filter._isWarning;
+  return stream;
+}
+
+QDataStream & operator>>(QDataStream & stream, FiltersModel::Filter & filter)
+{
+  qint32 inputMode = 0;
+  stream >> filter._name >> filter._plainText >> filter._translatedPlainText;
+  stream >> filter._path >> filter._plainPath >> filter._translatedPlainPath;
+  stream >> filter._command >> filter._previewCommand >> inputMode;
+  stream >> filter._parameters >> filter._previewFactor >> filter._isAccurateIfZoomed;
+  stream >> filter._previewFromFullImage >> filter._hash >> filter._isWarning;
+  filter._defaultInputMode = static_cast<InputMode>(inputMode);
+  return stream;
+}
+
 FiltersModel::const_iterator::const_iterator(const QMap<QString, Filter>::const_iterator & iterator)
 {
   _mapIterator = iterator;
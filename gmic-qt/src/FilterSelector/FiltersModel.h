@@ -31,6 +31,8 @@
 #include <vector>
 #include "GmicQt.h"
 
+class QDataStream;
+
 namespace GmicQt
 {
 class FiltersModel {
@@ -69,6 +71,10 @@ public:
     bool matchKeywords(const QList<QString> & keywords) const;
     bool matchFullPath(const QList<QString> & path) const;
 
+    // Binary (de)serialization, used by FiltersModelCache
+    friend QDataStream & operator<<(QDataStream & stream, const Filter & filter);
+    friend QDataStream & operator>>(QDataStream & stream, Filter & filter);
+
   private:
     QString _name;
     QString _plainText;
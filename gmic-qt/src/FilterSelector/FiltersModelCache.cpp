@@ -0,0 +1,124 @@
+/** -*- mode: c++ ; c-basic-offset: 2 -*-
+ *
+ *  @file FiltersModelCache.cpp
+ *
+ *  Copyright 2017 Sebastien Fourey
+ *
+ *  This file is part of G'MIC-Qt, a generic plug-in for raster graphics
+ *  editors, offering hundreds of filters thanks to the underlying G'MIC
+ *  image processing framework.
+ *
+ *  gmic_qt is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gmic_qt is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with gmic_qt.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "FilterSelector/FiltersModelCache.h"
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QFile>
+#include "Common.h"
+#include "Globals.h"
+#include "GmicQt.h"
+#include "LanguageSettings.h"
+#include "Logger.h"
+#include "Settings.h"
+#include "Utils.h"
+
+namespace
+{
+const quint32 CacheMagicNumber = 0x474d4643; // "GMFC"
+const quint32 CacheFormatVersion = 1;
+} // namespace
+
+namespace GmicQt
+{
+
+bool FiltersModelCache::load(FiltersModel & model, const QByteArray & stdlibArray)
+{
+  TIMING;
+  QFile file(path(false));
+  if (!file.open(QFile::ReadOnly)) {
+    return false;
+  }
+  // Map the file when possible, strings are copied anyway while deserializing.
+  const qint64 size = file.size();
+  uchar * mapped = file.map(0, size);
+  QByteArray data = mapped ? QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), static_cast<int>(size)) : file.readAll();
+  QBuffer buffer(&data);
+  buffer.open(QIODevice::ReadOnly);
+  QDataStream stream(&buffer);
+  stream.setVersion(QDataStream::Qt_5_0);
+
+  quint32 magic = 0;
+  quint32 version = 0;
+  QByteArray cacheKey;
+  stream >> magic >> version;
+  if ((magic != CacheMagicNumber) || (version != CacheFormatVersion)) {
+    return false;
+  }
+  stream >> cacheKey;
+  if (cacheKey != key(stdlibArray)) {
+    return false;
+  }
+  quint32 count = 0;
+  stream >> count;
+  model.clear();
+  while (count-- && (stream.status() == QDataStream::Ok)) {
+    FiltersModel::Filter filter;
+    stream >> filter;
+    model.addFilter(filter);
+  }
+  if (stream.status() != QDataStream::Ok) {
+    Logger::warning("Filters cache file is corrupted (" + file.fileName() + ")");
+    model.clear();
+    return false;
+  }
+  TIMING;
+  return true;
+}
+
+void FiltersModelCache::save(const FiltersModel & model, const QByteArray & stdlibArray)
+{
+  QByteArray data;
+  QBuffer buffer(&data);
+  buffer.open(QIODevice::WriteOnly);
+  QDataStream stream(&buffer);
+  stream.setVersion(QDataStream::Qt_5_0);
+  stream << CacheMagicNumber << CacheFormatVersion << key(stdlibArray);
+  stream << static_cast<quint32>(model.filterCount());
+  for (const FiltersModel::Filter & filter : model) {
+    stream << filter;
+  }
+  if (!safelyWrite(data, path(true))) {
+    Logger::warning("Cannot write filters cache file (" + path(false) + ")");
+  }
+}
+
+QByteArray FiltersModelCache::key(const QByteArray & stdlibArray)
+{
+  QCryptographicHash hash(QCryptographicHash::Md5);
+  hash.addData(stdlibArray);
+  hash.addData(gmicVersionString().toLatin1());
+  hash.addData(LanguageSettings::configuredTranslator().toLatin1());
+  hash.addData(Settings::filterTranslationEnabled() ? "1" : "0", 1);
+  return hash.result();
+}
+
+QString FiltersModelCache::path(bool create)
+{
+  return QString("%1%2").arg(gmicConfigPath(create), FILTERS_MODEL_CACHE_FILENAME);
+}
+
+} // namespace GmicQt
@@ -0,0 +1,53 @@
+/** -*- mode: c++ ; c-basic-offset: 2 -*-
+ *
+ *  @file FiltersModelCache.h
+ *
+ *  Copyright 2017 Sebastien Fourey
+ *
+ *  This file is part of G'MIC-Qt, a generic plug-in for raster graphics
+ *  editors, offering hundreds of filters thanks to the underlying G'MIC
+ *  image processing framework.
+ *
+ *  gmic_qt is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gmic_qt is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with gmic_qt.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef GMIC_QT_FILTERSMODELCACHE_H
+#define GMIC_QT_FILTERSMODELCACHE_H
+#include <QByteArray>
+#include "FilterSelector/FiltersModel.h"
+
+namespace GmicQt
+{
+
+/**
+ * Binary cache of a parsed FiltersModel, stored in gmicConfigPath().
+ *
+ * The cache is keyed on the content of the stdlib array (including update and
+ * user files), the G'MIC version, the UI language and the filter translation
+ * setting, so that it is automatically discarded whenever one of them changes.
+ */
+class FiltersModelCache {
+public:
+  static bool load(FiltersModel & model, const QByteArray & stdlibArray);
+  static void save(const FiltersModel & model, const QByteArray & stdlibArray);
+
+private:
+  static QByteArray key(const QByteArray & stdlibArray);
+  static QString path(bool create);
+  FiltersModelCache() = delete;
+};
+
+} // namespace GmicQt
+
+#endif // GMIC_QT_FILTERSMODELCACHE_H
@@ -29,6 +29,7 @@
 #include "Common.h"
 #include "FilterSelector/FavesModelReader.h"
 #include "FilterSelector/FavesModelWriter.h"
+#include "FilterSelector/FiltersModelCache.h"
 #include "FilterSelector/FiltersModelReader.h"
 #include "FilterTextTranslator.h"
 #include "FiltersVisibilityMap.h"
@@ -118,8 +119,12 @@ void FiltersPresenter::readFilters()
   if (GmicStdLib::Array.isEmpty()) {
     GmicStdLib::loadStdLib();
   }
+  if (FiltersModelCache::load(_filtersModel, GmicStdLib::Array)) {
+    return;
+  }
   FiltersModelReader filterModelReader(_filtersModel);
   filterModelReader.parseFiltersDefinitions(GmicStdLib::Array);
+  FiltersModelCache::save(_filtersModel, GmicStdLib::Array);
 }
 
 void FiltersPresenter::readFaves()
@@ -25,6 +25,7 @@
 #include "FilterThread.h"
 #include <QDebug>
 #include <iostream>
+#include <memory>
 #include "FilterParameters/AbstractParameter.h"
 #include "GmicStdlib.h"
 #include "Logger.h"
@@ -43,7 +44,7 @@ FilterThread::FilterThread(QObject * parent, const QString & command, const QStr
       _images(new cimg_library::CImgList<float>),                                           //
       _imageNames(new cimg_library::CImgList<char>),                                        //
       _persistentMemoryOuptut(new cimg_library::CImg<char>),                                //
-      _messageMode(mode)
+      _messageMode(mode), _interpreterSlot(nullptr)
 {
   _gmicAbort = false;
   _failed = false;
@@ -198,6 +199,13 @@ void FilterThread::setLogSuffix(const QString & text)
   _logSuffix = text;
 }
 
+// The interpreter in *slot is used instead of a new one, and created in *slot on first use.
+// It is deleted (and *slot reset) when a run fails, so that the next run starts from a clean state.
+void FilterThread::setInterpreterSlot(gmic ** slot)
+{
+  _interpreterSlot = slot;
+}
+
 void FilterThread::abortGmic()
 {
   _gmicAbort = true;
@@ -218,7 +226,17 @@ void FilterThread::run()
     if (_messageMode > OutputMessageMode::Quiet) {
       Logger::log(fullCommandLine, _logSuffix, true);
     }
-    gmic gmicInstance(_environment.isEmpty() ? nullptr : QString("%1").arg(_environment).toLocal8Bit().constData(), GmicStdLib::Array.constData(), true, nullptr, nullptr, 0.0f);
+    std::unique_ptr<gmic> ownInstance;
+    gmic * instance = _interpreterSlot ? *_interpreterSlot : nullptr;
+    if (!instance) {
+      instance = new gmic(_environment.isEmpty() ? nullptr : QString("%1").arg(_environment).toLocal8Bit().constData(), GmicStdLib::Array.constData(), true, nullptr, nullptr, 0.0f);
+      if (_interpreterSlot) {
+        *_interpreterSlot = instance;
+      } else {
+        ownInstance.reset(instance);
+      }
+    }
+    gmic & gmicInstance = *instance;
     gmicInstance.set_variable("_persistent", PersistentMemory::image());
     gmicInstance.set_variable("_host", '=', GmicQtHost::ApplicationShortname);
     gmicInstance.set_variable("_tk", '=', "qt");
@@ -234,6 +252,10 @@ void FilterThread::run()
       Logger::error(QString("When running command '%1', this error occurred:\n%2").arg(fullCommandLine).arg(message), true);
     }
     _failed = true;
+    if (_interpreterSlot) {
+      delete *_interpreterSlot;
+      *_interpreterSlot = nullptr;
+    }
   }
 }
 
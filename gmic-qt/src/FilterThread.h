@@ -36,6 +36,7 @@ namespace cimg_library
 {
 template <typename T> struct CImgList;
 }
+struct gmic;
 
 namespace GmicQt
 {
@@ -62,6 +63,7 @@ public:
   float progress() const;
   QString fullCommand() const;
   void setLogSuffix(const QString & text);
+  void setInterpreterSlot(gmic ** slot);
 
   static QStringList status2StringList(const QString &);
   static QList<int> status2Visibilities(const QString &);
@@ -91,6 +93,7 @@ private:
   QString _logSuffix;
   OutputMessageMode _messageMode;
   QElapsedTimer _startTime;
+  gmic ** _interpreterSlot;
 };
 
 } // namespace GmicQt
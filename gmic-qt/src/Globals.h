@@ -41,6 +41,7 @@ const char WarningPrefix = '!';
 #define PARAMETERS_CACHE_FILENAME "gmic_qt_params.dat"
 #define FILTERS_VISIBILITY_FILENAME "gmic_qt_visibility.dat"
 #define FILTERS_TAGS_FILENAME "gmic_qt_tags.dat"
+#define FILTERS_MODEL_CACHE_FILENAME "gmic_qt_filters.dat"
 
 #define FAVE_FOLDER_TEXT "<b>Faves</b>"
 #define FAVES_IMPORT_KEY "Faves/ImportedGTK179"
@@ -70,6 +71,13 @@ const char WarningPrefix = '!';
 #define KEYPOINTS_INTERACTIVE_MIDDLE_DELAY_MS ((KEYPOINTS_INTERACTIVE_LOWER_DELAY_MS + KEYPOINTS_INTERACTIVE_UPPER_DELAY_MS) / 2)
 #define KEYPOINTS_INTERACTIVE_AVERAGING_COUNT 6
 
+#define PROGRESSIVE_PREVIEW_MIN_DURATION_MS 400
+#define PROGRESSIVE_PREVIEW_SCALE 0.25
+#define PROGRESSIVE_PREVIEW_MIN_SIZE 32
+
+#define ADAPTIVE_PREVIEW_MIN_SCALE 0.125
+#define ADAPTIVE_PREVIEW_REFINEMENT_DELAY_MS 400
+
 #ifdef _GMIC_USE_HOSTED_SETTINGS_
 #ifdef Q_OS_MACOS
 #define GMIC_SETTINGS(x) QSettings x(GMIC_QT_ORGANISATION_DOMAIN, GMIC_QT_APPLICATION_NAME)
@@ -43,6 +43,7 @@
 #include "Misc.h"
 #include "OverrideCursor.h"
 #include "PersistentMemory.h"
+#include "Settings.h"
 #ifndef gmic_core
 #include "CImg.h"
 #endif
@@ -56,6 +57,14 @@ GmicProcessor::GmicProcessor(QObject * parent) : QObject(parent)
   _filterThread = nullptr;
   _gmicImages = new cimg_library::CImgList<gmic_pixel_type>;
   _previewImage = new cimg_library::CImg<float>;
+  _previewIsCoarse = false;
+  _pendingPreviewImages = new cimg_library::CImgList<gmic_pixel_type>;
+  _pendingPreviewImageNames = new cimg_library::CImgList<char>;
+  _previewScale = 1.0;
+  _fullResolutionPreviewDurationEstimate = 0.0;
+  _previewRefinementTimer.setSingleShot(true);
+  _previewRefinementTimer.setInterval(ADAPTIVE_PREVIEW_REFINEMENT_DELAY_MS);
+  connect(&_previewRefinementTimer, &QTimer::timeout, this, &GmicProcessor::fullResolutionPreviewRequested);
   _waitingCursorTimer.setSingleShot(true);
   connect(&_waitingCursorTimer, SIGNAL(timeout()), this, SLOT(showWaitingCursor()));
   cimg_library::cimg::srand();
@@ -69,6 +78,8 @@ void GmicProcessor::init()
 {
   abortCurrentFilterThread();
   _gmicImages->assign();
+  clearPendingPreview();
+  _previewRefinementTimer.stop();
 }
 
 void GmicProcessor::setContext(const GmicProcessor::FilterContext & context)
@@ -81,6 +92,7 @@ void GmicProcessor::execute()
   gmic_list<char> imageNames;
   FilterContext::VisibleRect & rect = _filterContext.visibleRect;
   _gmicImages->assign();
+  _previewRefinementTimer.stop();
   if ((_filterContext.requestType == FilterContext::RequestType::Preview) || //
       (_filterContext.requestType == FilterContext::RequestType::SynchronousPreview)) {
     if (_filterContext.previewFromFullImage) {
@@ -91,7 +103,8 @@ void GmicProcessor::execute()
       updateImageNames(imageNames);
     }
   } else {
-    CroppedImageListProxy::get(*_gmicImages, imageNames, rect.x, rect.y, rect.w, rect.h, _filterContext.inputOutputState.inputMode, 1.0);
+    // Cache is cleared once the full image is processed anyway, so input images are moved out of it
+    CroppedImageListProxy::take(*_gmicImages, imageNames, rect.x, rect.y, rect.w, rect.h, _filterContext.inputOutputState.inputMode, 1.0);
   }
   _waitingCursorTimer.start(WAITING_CURSOR_DELAY);
   const InputOutputState & io = _filterContext.inputOutputState;
@@ -133,12 +146,28 @@ void GmicProcessor::execute()
     preview_y1 = std::min(maxHeight, static_cast<int>(1 + std::ceil(maxHeight * rect.h))) - 1;
     previewSize = QSize(1 + preview_x1 - preview_x0, 1 + preview_y1 - preview_y0);
   }
-  env += QString(" _preview_x0=%1").arg(preview_x0);
-  env += QString(" _preview_y0=%1").arg(preview_y0);
-  env += QString(" _preview_x1=%1").arg(preview_x1);
-  env += QString(" _preview_y1=%1").arg(preview_y1);
-  env += QString(" _preview_width=%1").arg(previewSize.width());
-  env += QString(" _preview_height=%1").arg(previewSize.height());
+  const QString previewEnv = env + previewGeometryEnvironment(preview_x0, preview_y0, preview_x1, preview_y1, previewSize);
+  const bool isPreviewRequest = (_filterContext.requestType == FilterContext::RequestType::Preview) || //
+                                (_filterContext.requestType == FilterContext::RequestType::SynchronousPreview);
+  _previewScale = isPreviewRequest ? adaptivePreviewScale(previewSize) : 1.0;
+  _previewIsCoarse = (_previewScale == 1.0) && (_filterContext.requestType == FilterContext::RequestType::Preview) && shouldRunCoarsePreview(previewSize);
+  if (_previewIsCoarse) {
+    // Keep full resolution input for the refinement pass, run a fast low resolution pass first
+    _pendingPreviewEnvironment = previewEnv;
+    _pendingPreviewImages->assign();
+    _gmicImages->swap(*_pendingPreviewImages);
+    *_pendingPreviewImageNames = imageNames;
+    scalePreviewImages(*_pendingPreviewImages, *_gmicImages, PROGRESSIVE_PREVIEW_SCALE);
+    env += scaledPreviewGeometryEnvironment(preview_x0, preview_y0, previewSize, PROGRESSIVE_PREVIEW_SCALE);
+  } else if (_previewScale < 1.0) {
+    // Latency target cannot be met at full resolution, preview is upscaled for display
+    cimg_library::CImgList<float> images;
+    images.swap(*_gmicImages);
+    scalePreviewImages(images, *_gmicImages, _previewScale);
+    env += scaledPreviewGeometryEnvironment(preview_x0, preview_y0, previewSize, _previewScale);
+  } else {
+    env = previewEnv;
+  }
   if (_filterContext.requestType == FilterContext::RequestType::SynchronousPreview) {
     FilterSyncRunner runner(this, _filterContext.filterCommand, _filterContext.filterArguments, env, _filterContext.outputMessageMode);
     runner.swapImages(*_gmicImages);
@@ -148,18 +177,16 @@ void GmicProcessor::execute()
     _previewRandomSeed = cimg_library::cimg::_rand();
     _filterExecutionTime.restart();
     runner.run();
+    const int duration = static_cast<int>(_filterExecutionTime.elapsed());
     manageSynchonousRunner(runner);
-    recordPreviewFilterExecutionDurationMS((int)_filterExecutionTime.elapsed());
+    recordPreviewFilterExecutionDurationMS(duration);
+    if (!runner.failed() && (_previewScale < 1.0)) {
+      _previewRefinementTimer.start();
+    }
   } else if (_filterContext.requestType == FilterContext::RequestType::Preview) {
-    _filterThread = new FilterThread(this, _filterContext.filterCommand, _filterContext.filterArguments, env, _filterContext.outputMessageMode);
-    _filterThread->swapImages(*_gmicImages);
-    _filterThread->setImageNames(imageNames);
-    _filterThread->setLogSuffix("preview");
-    connect(_filterThread, SIGNAL(finished()), this, SLOT(onPreviewThreadFinished()), Qt::QueuedConnection);
     cimg_library::cimg::srand();
     _previewRandomSeed = cimg_library::cimg::_rand();
-    _filterExecutionTime.restart();
-    _filterThread->start();
+    startPreviewThread(*_gmicImages, imageNames, env);
   } else if (_filterContext.requestType == FilterContext::RequestType::FullImage) {
     _lastAppliedFilterHash = _filterContext.filterHash;
     _lastAppliedFilterPath = _filterContext.filterFullPath;
@@ -176,6 +203,85 @@ void GmicProcessor::execute()
   }
 }
 
+void GmicProcessor::startPreviewThread(cimg_library::CImgList<float> & images, const cimg_library::CImgList<char> & imageNames, const QString & env)
+{
+  _filterThread = new FilterThread(this, _filterContext.filterCommand, _filterContext.filterArguments, env, _filterContext.outputMessageMode);
+  _filterThread->swapImages(images);
+  _filterThread->setImageNames(imageNames);
+  _filterThread->setLogSuffix(_previewIsCoarse ? "coarse preview" : "preview");
+  connect(_filterThread, SIGNAL(finished()), this, SLOT(onPreviewThreadFinished()), Qt::QueuedConnection);
+  // Both passes of a progressive preview use the same seed
+  cimg_library::cimg::srand(_previewRandomSeed);
+  _filterExecutionTime.restart();
+  _filterThread->start();
+}
+
+bool GmicProcessor::shouldRunCoarsePreview(const QSize & previewSize) const
+{
+  return Settings::progressivePreview() && !_filterContext.previewFromFullImage && !_filterContext.previewAtFullResolution && //
+         (std::min(previewSize.width(), previewSize.height()) * PROGRESSIVE_PREVIEW_SCALE >= PROGRESSIVE_PREVIEW_MIN_SIZE) &&  //
+         (averagePreviewFilterExecutionDuration() >= PROGRESSIVE_PREVIEW_MIN_DURATION_MS);
+}
+
+double GmicProcessor::adaptivePreviewScale(const QSize & previewSize) const
+{
+  const int target = Settings::previewLatencyTarget();
+  if ((target <= 0) || _filterContext.previewFromFullImage || _filterContext.previewAtFullResolution || (_fullResolutionPreviewDurationEstimate <= target)) {
+    return 1.0;
+  }
+  // Cost is assumed to be proportional to the number of pixels. Scale is
+  // quantized (powers of sqrt(2)) so that it does not change at each run.
+  const double idealScale = std::sqrt(target / _fullResolutionPreviewDurationEstimate);
+  const double step = std::sqrt(0.5);
+  const int minSide = std::min(previewSize.width(), previewSize.height());
+  double scale = 1.0;
+  while ((scale > idealScale) && (scale * step >= ADAPTIVE_PREVIEW_MIN_SCALE) && (minSide * scale * step >= PROGRESSIVE_PREVIEW_MIN_SIZE)) {
+    scale *= step;
+  }
+  return scale;
+}
+
+void GmicProcessor::scalePreviewImages(const cimg_library::CImgList<float> & images, cimg_library::CImgList<float> & result, double scale)
+{
+  result.assign(images.size());
+  for (unsigned int i = 0; i < images.size(); ++i) {
+    const gmic_image<float> & image = images[i];
+    image
+        .get_resize(std::max(1, static_cast<int>(std::round(image.width() * scale))), //
+                    std::max(1, static_cast<int>(std::round(image.height() * scale))), 1, -100, 2)
+        .move_to(result[i]);
+  }
+}
+
+QString GmicProcessor::scaledPreviewGeometryEnvironment(int x0, int y0, const QSize & previewSize, double scale)
+{
+  const QSize size(std::max(1, static_cast<int>(std::round(previewSize.width() * scale))), //
+                   std::max(1, static_cast<int>(std::round(previewSize.height() * scale))));
+  const int scaledX0 = static_cast<int>(std::round(x0 * scale));
+  const int scaledY0 = static_cast<int>(std::round(y0 * scale));
+  return previewGeometryEnvironment(scaledX0, scaledY0, scaledX0 + size.width() - 1, scaledY0 + size.height() - 1, size);
+}
+
+QString GmicProcessor::previewGeometryEnvironment(int x0, int y0, int x1, int y1, const QSize & previewSize)
+{
+  QString env;
+  env += QString(" _preview_x0=%1").arg(x0);
+  env += QString(" _preview_y0=%1").arg(y0);
+  env += QString(" _preview_x1=%1").arg(x1);
+  env += QString(" _preview_y1=%1").arg(y1);
+  env += QString(" _preview_width=%1").arg(previewSize.width());
+  env += QString(" _preview_height=%1").arg(previewSize.height());
+  return env;
+}
+
+void GmicProcessor::clearPendingPreview()
+{
+  _previewIsCoarse = false;
+  _pendingPreviewImages->assign();
+  _pendingPreviewImageNames->assign();
+  _pendingPreviewEnvironment.clear();
+}
+
 bool GmicProcessor::isProcessingFullImage() const
 {
   return _filterContext.requestType == FilterContext::RequestType::FullImage;
@@ -218,10 +324,17 @@ int GmicProcessor::lastPreviewFilterExecutionDurationMS() const
 void GmicProcessor::resetLastPreviewFilterExecutionDurations()
 {
   _lastFilterPreviewExecutionDurations.clear();
+  _fullResolutionPreviewDurationEstimate = 0.0;
 }
 
 void GmicProcessor::recordPreviewFilterExecutionDurationMS(int duration)
 {
+  const double fullResolutionDuration = duration / (_previewScale * _previewScale);
+  if (_fullResolutionPreviewDurationEstimate == 0.0) {
+    _fullResolutionPreviewDurationEstimate = fullResolutionDuration;
+  } else {
+    _fullResolutionPreviewDurationEstimate = 0.5 * (_fullResolutionPreviewDurationEstimate + fullResolutionDuration);
+  }
   _lastFilterPreviewExecutionDurations.push_back(duration);
   while (_lastFilterPreviewExecutionDurations.size() >= KEYPOINTS_INTERACTIVE_AVERAGING_COUNT) {
     _lastFilterPreviewExecutionDurations.pop_front();
@@ -242,6 +355,16 @@ int GmicProcessor::averagePreviewFilterExecutionDuration() const
   return static_cast<int>(sum / count);
 }
 
+double GmicProcessor::previewScale() const
+{
+  return _previewScale;
+}
+
+int GmicProcessor::estimatedFullResolutionPreviewDurationMS() const
+{
+  return static_cast<int>(_fullResolutionPreviewDurationEstimate);
+}
+
 int GmicProcessor::completedFullImageProcessingCount() const
 {
   return _completeFullImageProcessingCount;
@@ -250,6 +373,7 @@ int GmicProcessor::completedFullImageProcessingCount() const
 void GmicProcessor::cancel()
 {
   abortCurrentFilterThread();
+  _previewRefinementTimer.stop();
 }
 
 bool GmicProcessor::hasUnfinishedAbortedThreads() const
@@ -294,6 +418,8 @@ GmicProcessor::~GmicProcessor()
 {
   delete _gmicImages;
   delete _previewImage;
+  delete _pendingPreviewImages;
+  delete _pendingPreviewImageNames;
   if (!_unfinishedAbortedThreads.isEmpty()) {
     Logger::error(QString("~GmicProcessor(): There are %1 unfinished filter threads.").arg(_unfinishedAbortedThreads.size()));
   }
@@ -310,6 +436,10 @@ void GmicProcessor::onPreviewThreadFinished()
   if (_filterThread->isRunning()) {
     return;
   }
+  if (_previewIsCoarse) {
+    onCoarsePreviewThreadFinished();
+    return;
+  }
   if (_filterThread->failed()) {
     _gmicStatus.clear();
     _parametersVisibilityStates.clear();
@@ -338,14 +468,67 @@ void GmicProcessor::onPreviewThreadFinished()
   _filterThread = nullptr;
   hideWaitingCursor();
   if (correctSpectrums) {
-    emit previewImageAvailable();
     recordPreviewFilterExecutionDurationMS((int)_filterExecutionTime.elapsed());
+    emit previewImageAvailable();
+    if (_previewScale < 1.0) {
+      _previewRefinementTimer.start();
+    }
   } else {
     QString message(tr("Image #%1 returned by filter has %2 channels (should be at most 4)"));
     emit previewCommandFailed(message.arg(badSpectrumIndex).arg((*_gmicImages)[badSpectrumIndex].spectrum()));
   }
 }
 
+void GmicProcessor::onCoarsePreviewThreadFinished()
+{
+  // Persistent memory output of the coarse pass is dropped on purpose, so
+  // that the refinement pass does not reuse low resolution data.
+  FilterThread * coarseThread = _filterThread;
+  _filterThread = nullptr;
+  const bool coarseSucceeded = !coarseThread->failed();
+  QString coarseErrorMessage;
+  if (coarseSucceeded) {
+    _gmicStatus = coarseThread->gmicStatus();
+    _parametersVisibilityStates = coarseThread->parametersVisibilityStates();
+    _gmicImages->assign();
+    coarseThread->swapImages(*_gmicImages);
+  } else {
+    coarseErrorMessage = coarseThread->errorMessage();
+  }
+  coarseThread->deleteLater();
+
+  // Start the refinement pass before notifying, so that the processor is
+  // seen as busy by receivers of the coarse preview signals.
+  _previewIsCoarse = false;
+  cimg_library::CImgList<float> images;
+  images.swap(*_pendingPreviewImages);
+  cimg_library::CImgList<char> imageNames;
+  imageNames.swap(*_pendingPreviewImageNames);
+  startPreviewThread(images, imageNames, _pendingPreviewEnvironment);
+  _pendingPreviewEnvironment.clear();
+
+  // A failing coarse pass is not fatal: the refinement pass runs anyway and
+  // reports its own error, if any.
+  if (!coarseSucceeded) {
+    Logger::warning(QString("Coarse preview failed: %1").arg(coarseErrorMessage));
+    emit coarsePreviewCommandFailed(coarseErrorMessage);
+    return;
+  }
+  unsigned int badSpectrumIndex = 0;
+  if (!checkImageSpectrumAtMost4(*_gmicImages, badSpectrumIndex)) {
+    QString message(tr("Image #%1 returned by filter has %2 channels (should be at most 4)"));
+    message = message.arg(badSpectrumIndex).arg((*_gmicImages)[badSpectrumIndex].spectrum());
+    Logger::warning(QString("Coarse preview failed: %1").arg(message));
+    emit coarsePreviewCommandFailed(message);
+    return;
+  }
+  for (unsigned int i = 0; i < _gmicImages->size(); ++i) {
+    GmicQtHost::applyColorProfile((*_gmicImages)[i]);
+  }
+  buildPreviewImage(*_gmicImages, *_previewImage);
+  emit coarsePreviewImageAvailable();
+}
+
 void GmicProcessor::onApplyThreadFinished()
 {
   Q_ASSERT_X(_filterThread, __PRETTY_FUNCTION__, "No filter thread");
@@ -383,6 +566,7 @@ void GmicProcessor::onApplyThreadFinished()
         emit aboutToSendImagesToHost();
       }
       GmicQtHost::outputImages(*_gmicImages, _filterThread->imageNames(), _filterContext.inputOutputState.outputMode);
+      _gmicImages->assign();
       _completeFullImageProcessingCount += 1;
       LayersExtentProxy::clear();
       CroppedActiveLayerProxy::clear();
@@ -453,6 +637,7 @@ void GmicProcessor::abortCurrentFilterThread()
   _unfinishedAbortedThreads.push_back(_filterThread);
   _filterThread->abortGmic();
   _filterThread = nullptr;
+  clearPendingPreview();
   _waitingCursorTimer.stop();
   OverrideCursor::setWaiting(false);
 }
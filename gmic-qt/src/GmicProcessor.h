@@ -30,6 +30,7 @@
 #include <QObject>
 #include <QSettings>
 #include <QSignalMapper>
+#include <QSize>
 #include <QString>
 #include <QStringList>
 #include <QTimer>
@@ -76,6 +77,7 @@ public:
     int previewWindowHeight;
     int previewTimeout;
     bool previewFromFullImage = false;
+    bool previewAtFullResolution = false; // Disable latency-driven downscaling
     QString filterName;
     QString filterCommand;
     QString filterFullPath;
@@ -108,6 +110,8 @@ public:
   void resetLastPreviewFilterExecutionDurations();
   void recordPreviewFilterExecutionDurationMS(int duration);
   int averagePreviewFilterExecutionDuration() const;
+  double previewScale() const;
+  int estimatedFullResolutionPreviewDurationMS() const;
   int completedFullImageProcessingCount() const;
 
 public slots:
@@ -117,12 +121,16 @@ signals:
   void previewCommandFailed(QString errorMessage);
   void fullImageProcessingFailed(QString errorMessage);
   void previewImageAvailable();
+  void coarsePreviewImageAvailable();
+  void coarsePreviewCommandFailed(QString errorMessage);
   void fullImageProcessingDone();
   void noMoreUnfinishedJobs();
   void aboutToSendImagesToHost();
+  void fullResolutionPreviewRequested();
 
 private slots:
   void onPreviewThreadFinished();
+  void onCoarsePreviewThreadFinished();
   void onApplyThreadFinished();
   void onAbortedThreadFinished();
   void showWaitingCursor();
@@ -130,6 +138,13 @@ private slots:
 
 private:
   void updateImageNames(cimg_library::CImgList<char> & imageNames);
+  void startPreviewThread(cimg_library::CImgList<float> & images, const cimg_library::CImgList<char> & imageNames, const QString & env);
+  bool shouldRunCoarsePreview(const QSize & previewSize) const;
+  double adaptivePreviewScale(const QSize & previewSize) const;
+  static void scalePreviewImages(const cimg_library::CImgList<float> & images, cimg_library::CImgList<float> & result, double scale);
+  static QString previewGeometryEnvironment(int x0, int y0, int x1, int y1, const QSize & previewSize);
+  static QString scaledPreviewGeometryEnvironment(int x0, int y0, const QSize & previewSize, double scale);
+  void clearPendingPreview();
   void abortCurrentFilterThread();
   void manageSynchonousRunner(FilterSyncRunner & runner);
 
@@ -139,6 +154,19 @@ private:
   cimg_library::CImg<float> * _previewImage;
   QList<FilterThread *> _unfinishedAbortedThreads;
 
+  // Progressive preview: a low resolution pass is run first, the full
+  // resolution input and environment are kept here until it is done.
+  bool _previewIsCoarse;
+  cimg_library::CImgList<float> * _pendingPreviewImages;
+  cimg_library::CImgList<char> * _pendingPreviewImageNames;
+  QString _pendingPreviewEnvironment;
+
+  // Latency-driven preview resolution: scale of the current (or last)
+  // preview, and running estimate of the full resolution duration.
+  double _previewScale;
+  double _fullResolutionPreviewDurationEstimate;
+  QTimer _previewRefinementTimer;
+
   unsigned int _previewRandomSeed;
   QStringList _gmicStatus;
   QList<int> _parametersVisibilityStates;
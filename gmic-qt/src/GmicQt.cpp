@@ -30,12 +30,14 @@
 #include <QLocale>
 #include <QSettings>
 #include <QString>
+#include <QStringList>
 #include <QThread>
 #include <QTimer>
 #include <cstdlib>
 #include <cstring>
 #include "Common.h"
 #include "Globals.h"
+#include "BatchProcessor.h"
 #include "HeadlessProcessor.h"
 #include "LanguageSettings.h"
 #include "Logger.h"
@@ -212,6 +214,32 @@ int run(UserInterfaceMode interfaceMode,                   //
   return 0;
 }
 
+int runBatch(RunParameters parameters, const std::list<std::string> & inputFilenames, const std::string & outputPattern, int jobs, int jpegQuality)
+{
+  int dummy_argc = 1;
+  char dummy_app_name[] = GMIC_QT_APPLICATION_NAME;
+  char * dummy_argv[1] = {dummy_app_name};
+  configureApplication();
+  QCoreApplication app(dummy_argc, dummy_argv);
+  Settings::load(UserInterfaceMode::Silent);
+  Logger::setMode(Settings::outputMessageMode());
+  BatchProcessor processor(&app);
+  if (!processor.setPluginParameters(parameters)) {
+    Logger::error(processor.error());
+    return 1;
+  }
+  QStringList filenames;
+  for (const std::string & filename : inputFilenames) {
+    filenames.push_back(QString::fromStdString(filename));
+  }
+  processor.setInputFiles(filenames);
+  processor.setOutputPattern(QString::fromStdString(outputPattern));
+  processor.setJobCount(jobs);
+  processor.setJpegQuality(jpegQuality);
+  QTimer::singleShot(0, &processor, &BatchProcessor::start);
+  return QCoreApplication::exec();
+}
+
 std::string RunParameters::filterName() const
 {
   auto position = filterPath.rfind("/");
@@ -380,34 +408,40 @@ void convertCImgToQImage(const cimg_library::CImg<float> & in, QImage & out)
   }
 #endif
 
+  // Scanlines are independent, convert them in parallel (each loop body is
+  // branch-free enough to be auto-vectorized). Buffer is detached once here,
+  // so that threads do not call QImage::scanLine() concurrently.
+  const int width = in.width();
+  const int height = out.height();
+  const long bytesPerLine = out.bytesPerLine();
+  unsigned char * const bits = out.bits();
   if (in.spectrum() >= 4) {
     const float * srcR = in.data(0, 0, 0, 0);
     const float * srcG = in.data(0, 0, 0, 1);
     const float * srcB = in.data(0, 0, 0, 2);
     const float * srcA = in.data(0, 0, 0, 3);
-    int height = out.height();
     if (archIsLittleEndian()) {
+      cimg_pragma_openmp(parallel for cimg_openmp_if_size(in.width() * in.height(), 16384))
       for (int y = 0; y < height; ++y) {
-        int n = in.width();
-        unsigned char * dst = out.scanLine(y);
-        while (n--) {
-          dst[0] = float2uchar_bounded(*srcB++);
-          dst[1] = float2uchar_bounded(*srcG++);
-          dst[2] = float2uchar_bounded(*srcR++);
-          dst[3] = float2uchar_bounded(*srcA++);
-          dst += 4;
+        const long offset = static_cast<long>(y) * width;
+        unsigned char * dst = bits + y * bytesPerLine;
+        for (int x = 0; x < width; ++x) {
+          dst[4 * x] = float2uchar_bounded(srcB[offset + x]);
+          dst[4 * x + 1] = float2uchar_bounded(srcG[offset + x]);
+          dst[4 * x + 2] = float2uchar_bounded(srcR[offset + x]);
+          dst[4 * x + 3] = float2uchar_bounded(srcA[offset + x]);
         }
       }
     } else {
+      cimg_pragma_openmp(parallel for cimg_openmp_if_size(in.width() * in.height(), 16384))
       for (int y = 0; y < height; ++y) {
-        int n = in.width();
-        unsigned char * dst = out.scanLine(y);
-        while (n--) {
-          dst[0] = float2uchar_bounded(*srcA++);
-          dst[1] = float2uchar_bounded(*srcR++);
-          dst[2] = float2uchar_bounded(*srcG++);
-          dst[3] = float2uchar_bounded(*srcB++);
-          dst += 4;
+        const long offset = static_cast<long>(y) * width;
+        unsigned char * dst = bits + y * bytesPerLine;
+        for (int x = 0; x < width; ++x) {
+          dst[4 * x] = float2uchar_bounded(srcA[offset + x]);
+          dst[4 * x + 1] = float2uchar_bounded(srcR[offset + x]);
+          dst[4 * x + 2] = float2uchar_bounded(srcG[offset + x]);
+          dst[4 * x + 3] = float2uchar_bounded(srcB[offset + x]);
         }
       }
     }
@@ -415,15 +449,14 @@ void convertCImgToQImage(const cimg_library::CImg<float> & in, QImage & out)
     const float * srcR = in.data(0, 0, 0, 0);
     const float * srcG = in.data(0, 0, 0, 1);
     const float * srcB = in.data(0, 0, 0, 2);
-    int height = out.height();
+    cimg_pragma_openmp(parallel for cimg_openmp_if_size(in.width() * in.height(), 16384))
     for (int y = 0; y < height; ++y) {
-      int n = in.width();
-      unsigned char * dst = out.scanLine(y);
-      while (n--) {
-        dst[0] = float2uchar_bounded(*srcR++);
-        dst[1] = float2uchar_bounded(*srcG++);
-        dst[2] = float2uchar_bounded(*srcB++);
-        dst += 3;
+      const long offset = static_cast<long>(y) * width;
+      unsigned char * dst = bits + y * bytesPerLine;
+      for (int x = 0; x < width; ++x) {
+        dst[3 * x] = float2uchar_bounded(srcR[offset + x]);
+        dst[3 * x + 1] = float2uchar_bounded(srcG[offset + x]);
+        dst[3 * x + 2] = float2uchar_bounded(srcB[offset + x]);
       }
     }
   } else if (in.spectrum() == 2) {
@@ -432,25 +465,24 @@ void convertCImgToQImage(const cimg_library::CImg<float> & in, QImage & out)
     //
     const float * src = in.data(0, 0, 0, 0);
     const float * srcA = in.data(0, 0, 0, 1);
-    int height = out.height();
     if (archIsLittleEndian()) {
+      cimg_pragma_openmp(parallel for cimg_openmp_if_size(in.width() * in.height(), 16384))
       for (int y = 0; y < height; ++y) {
-        int n = in.width();
-        unsigned char * dst = out.scanLine(y);
-        while (n--) {
-          dst[2] = dst[1] = dst[0] = float2uchar_bounded(*src++);
-          dst[3] = float2uchar_bounded(*srcA++);
-          dst += 4;
+        const long offset = static_cast<long>(y) * width;
+        unsigned char * dst = bits + y * bytesPerLine;
+        for (int x = 0; x < width; ++x) {
+          dst[4 * x + 2] = dst[4 * x + 1] = dst[4 * x] = float2uchar_bounded(src[offset + x]);
+          dst[4 * x + 3] = float2uchar_bounded(srcA[offset + x]);
         }
       }
     } else {
+      cimg_pragma_openmp(parallel for cimg_openmp_if_size(in.width() * in.height(), 16384))
       for (int y = 0; y < height; ++y) {
-        int n = in.width();
-        unsigned char * dst = out.scanLine(y);
-        while (n--) {
-          dst[1] = dst[2] = dst[3] = float2uchar_bounded(*src++);
-          dst[0] = float2uchar_bounded(*srcA++);
-          dst += 4;
+        const long offset = static_cast<long>(y) * width;
+        unsigned char * dst = bits + y * bytesPerLine;
+        for (int x = 0; x < width; ++x) {
+          dst[4 * x + 1] = dst[4 * x + 2] = dst[4 * x + 3] = float2uchar_bounded(src[offset + x]);
+          dst[4 * x] = float2uchar_bounded(srcA[offset + x]);
         }
       }
     }
@@ -459,21 +491,17 @@ void convertCImgToQImage(const cimg_library::CImg<float> & in, QImage & out)
     // 8-bits Gray levels
     //
     const float * src = in.data(0, 0, 0, 0);
-    int height = out.height();
+    cimg_pragma_openmp(parallel for cimg_openmp_if_size(in.width() * in.height(), 16384))
     for (int y = 0; y < height; ++y) {
-      int n = in.width();
-      unsigned char * dst = out.scanLine(y);
+      const long offset = static_cast<long>(y) * width;
+      unsigned char * dst = bits + y * bytesPerLine;
 #if QT_VERSION_GTE(5, 5, 0)
-      while (n--) {
-        *dst++ = static_cast<unsigned char>(*src++);
+      for (int x = 0; x < width; ++x) {
+        dst[x] = static_cast<unsigned char>(src[offset + x]);
       }
 #else
-      while (n--) {
-        dst[0] = float2uchar_bounded(*src);
-        dst[1] = float2uchar_bounded(*src);
-        dst[2] = float2uchar_bounded(*src);
-        ++src;
-        dst += 3;
+      for (int x = 0; x < width; ++x) {
+        dst[3 * x] = dst[3 * x + 1] = dst[3 * x + 2] = float2uchar_bounded(src[offset + x]);
       }
 #endif
     }
@@ -128,6 +128,20 @@ int run(UserInterfaceMode interfaceMode = UserInterfaceMode::Full,
         const std::list<InputMode> & disabledInputModes = std::list<InputMode>(),    //
         const std::list<OutputMode> & disabledOutputModes = std::list<OutputMode>(), //
         bool * dialogWasAccepted = nullptr);
+
+/**
+ * Apply a filter (or command) to a list of image files, without user interface.
+ * Files are processed by up to jobs concurrent filter threads (0 means one per
+ * core), inputs being read ahead and outputs written asynchronously.
+ * In outputPattern, %b is replaced by the input file basename and %f by the
+ * input filename (without path).
+ * @return 0 if all files were processed successfully, 1 otherwise.
+ */
+int runBatch(RunParameters parameters,                      //
+             const std::list<std::string> & inputFilenames, //
+             const std::string & outputPattern,             //
+             int jobs = 0,                                  //
+             int jpegQuality = -1);
 /*
  * What follows may be helpful for the implementation of a host_something.cpp
  */
@@ -162,10 +162,7 @@ void HeadlessProcessor::startProcessing()
   if (!_progressWindow) {
     GmicQtHost::showMessage(QString("G'MIC: %1 %2").arg(_command).arg(_arguments).toUtf8().constData());
   }
-  QString env = QString("_input_layers=%1").arg((int)_inputMode);
-  env += QString(" _output_mode=%1").arg((int)_outputMode);
-  env += QString(" _output_messages=%1").arg((int)_outputMessageMode);
-  _filterThread = new FilterThread(this, _command, _arguments, env, _outputMessageMode);
+  _filterThread = new FilterThread(this, _command, _arguments, environment(), _outputMessageMode);
   _filterThread->swapImages(*_gmicImages);
   _filterThread->setImageNames(imageNames);
   _processingCompletedProperly = false;
@@ -181,6 +178,24 @@ QString HeadlessProcessor::command() const
   return _command;
 }
 
+QString HeadlessProcessor::arguments() const
+{
+  return _arguments;
+}
+
+QString HeadlessProcessor::environment() const
+{
+  QString env = QString("_input_layers=%1").arg((int)_inputMode);
+  env += QString(" _output_mode=%1").arg((int)_outputMode);
+  env += QString(" _output_messages=%1").arg((int)_outputMessageMode);
+  return env;
+}
+
+OutputMessageMode HeadlessProcessor::outputMessageMode() const
+{
+  return _outputMessageMode;
+}
+
 QString HeadlessProcessor::filterName() const
 {
   return _filterName;
@@ -236,7 +251,8 @@ void HeadlessProcessor::onProcessingFinished()
       errorMessage = tr("Filter execution failed, but with no error message.");
     }
   } else {
-    gmic_list<gmic_pixel_type> images = _filterThread->images();
+    gmic_list<gmic_pixel_type> images;
+    _filterThread->swapImages(images);
     if (!_filterThread->aborted()) {
       GmicQtHost::outputImages(images, _filterThread->imageNames(), _outputMode);
       _processingCompletedProperly = true;
@@ -48,6 +48,9 @@ public:
   explicit HeadlessProcessor(QObject * parent);
   ~HeadlessProcessor() override;
   QString command() const;
+  QString arguments() const;
+  QString environment() const;
+  OutputMessageMode outputMessageMode() const;
   QString filterName() const;
   void setProgressWindow(ProgressInfoWindow *);
   bool processingCompletedProperly();
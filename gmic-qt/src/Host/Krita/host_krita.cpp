@@ -255,7 +255,7 @@ void outputImages(gmic_list<float> & images, const gmic_list<char> & imageNames,
 
     // qDebug() << "\tgmic-qt: image number" << i;
 
-    gmic_image<float> gimg = images.at(i);
+    gmic_image<float> & gimg = images[i];
 
     QSharedMemory * m = new QSharedMemory(QString("key_%1").arg(QUuid::createUuid().toString()));
     sharedMemorySegments.append(m);
@@ -268,10 +268,15 @@ void outputImages(gmic_list<float> & images, const gmic_list<char> & imageNames,
     m->lock();
     memcpy(m->data(), gimg._data, gimg._width * gimg._height * gimg._spectrum * sizeof(float));
     m->unlock();
+    const unsigned int spectrum = gimg._spectrum;
+    const unsigned int width = gimg._width;
+    const unsigned int height = gimg._height;
+    // Image now lives in the shared memory segment, release it to lower peak memory usage
+    gimg.assign();
 
     QString layerName((const char *)imageNames[i]);
 
-    message += "layer=" + m->key() + "," + layerName.toUtf8().toHex() + "," + QString("%1,%2,%3").arg(gimg._spectrum).arg(gimg._width).arg(gimg._height) + +"\n";
+    message += "layer=" + m->key() + "," + layerName.toUtf8().toHex() + "," + QString("%1,%2,%3").arg(spectrum).arg(width).arg(height) + +"\n";
   }
   sendMessageSynchronously(message.toUtf8());
 }
@@ -158,7 +158,10 @@ void outputImages(gmic_list<float> &images,
   for (uint i = 0; i < images.size(); ++i) {
     // qDebug() << "\tgmic-qt: image number" << i;
 
-    gmic_image<float> gimg = images.at(i);
+    gmic_image<float> &gimg = images[i];
+    if (gimg._depth > 1) {
+      gimg.slice(0);
+    }
 
     const auto layerName = QString::fromUtf8(imageNames[i].data());
 
@@ -169,11 +172,11 @@ void outputImages(gmic_list<float> &images,
     {
       QMutexLocker lock(&m->m_mutex);
 
-      const auto slice = gimg.get_slice(0);
-
-      const auto length = slice._width * slice._height * slice._spectrum * sizeof(float);
-      std::memcpy(m->m_data, slice._data, length);
+      const auto length = gimg._width * gimg._height * gimg._spectrum * sizeof(float);
+      std::memcpy(m->m_data, gimg._data, length);
     }
+    // Image now lives in the shared segment, release it to lower peak memory usage
+    gimg.assign();
 
     layers << m;
   }
@@ -260,6 +260,8 @@ void usage(const std::string & argv0)
                "                              -a --apply : Apply filter or command and quit (requires one of -r -p -c)\n"
                "                      -R --reapply-first : Launch GUI once for first input file, then apply selected filter\n"
                "                                           and parameters to all other files\n"
+               "                             -j --jobs N : Batch mode: with --apply and --output, process input files\n"
+               "                                           with N concurrent jobs (0: one per core), without any window\n"
                "                             --show-last : Print last applied plugin parameters\n"
                "                       --show-last-after : Print last applied plugin parameters (after filter execution)\n";
 }
@@ -282,6 +284,7 @@ int main(int argc, char * argv[])
   bool reapplyFirst = false;
   bool printLast = false;
   bool printLastAfter = false;
+  int jobs = -1;
   std::string filterPath;
   std::string command;
   QStringList filenames;
@@ -310,6 +313,14 @@ int main(int argc, char * argv[])
         std::cerr << "Missing argument for option " << arg.toStdString() << std::endl;
         return EXIT_FAILURE;
       }
+    } else if ((arg == "--jobs") || (arg == "-j")) {
+      if (narg < argc - 1) {
+        ++narg;
+        jobs = std::max(0, atoi(argv[narg]));
+      } else {
+        std::cerr << "Missing argument for option " << arg.toStdString() << std::endl;
+        return EXIT_FAILURE;
+      }
     } else if ((arg == "--repeat") || (arg == "-r")) {
       repeat = true;
     } else if ((arg == "--command") || (arg == "-c")) {
@@ -355,6 +366,16 @@ int main(int argc, char * argv[])
     return EXIT_FAILURE;
   }
 
+  if ((jobs >= 0) && (!apply || gmic_qt_standalone::output_image_filename.isEmpty())) {
+    std::cerr << "Option --jobs requires --apply and --output" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if ((jobs >= 0) && (filenames.size() > 1) && !gmic_qt_standalone::output_image_filename.contains("%b") && !gmic_qt_standalone::output_image_filename.contains("%f")) {
+    std::cerr << "Option --jobs with several input files requires %b or %f in the --output filename" << std::endl;
+    return EXIT_FAILURE;
+  }
+
   if (printLast || printLastAfter) {
     GmicQt::ReturnedRunParametersFlag flag = printLast ? GmicQt::ReturnedRunParametersFlag::BeforeFilterExecution : GmicQt::ReturnedRunParametersFlag::AfterFilterExecution;
     GmicQt::RunParameters parameters = GmicQt::lastAppliedFilterRunParameters(flag);
@@ -396,6 +417,13 @@ int main(int argc, char * argv[])
   if (filenames.isEmpty()) {
     return GmicQt::run(GmicQt::UserInterfaceMode::Full, parameters, disabledInputModes, disabledOutputModes);
   }
+  if (jobs >= 0) {
+    std::list<std::string> inputFilenames;
+    for (const QString & filename : filenames) {
+      inputFilenames.push_back(filename.toStdString());
+    }
+    return GmicQt::runBatch(parameters, inputFilenames, gmic_qt_standalone::output_image_filename.toStdString(), jobs, gmic_qt_standalone::jpeg_quality);
+  }
   bool firstLaunch = true;
   for (const QString & filename : filenames) {
     if (loadImage(gmic_qt_standalone::input_image, filename, argc, argv)) {
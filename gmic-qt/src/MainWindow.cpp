@@ -675,9 +675,12 @@ void MainWindow::makeConnections()
 
   connect(&_processor, &GmicProcessor::previewImageAvailable, this, &MainWindow::onPreviewImageAvailable);
   connect(&_processor, &GmicProcessor::previewCommandFailed, this, &MainWindow::onPreviewError);
+  connect(&_processor, &GmicProcessor::coarsePreviewImageAvailable, this, &MainWindow::onCoarsePreviewImageAvailable);
+  connect(&_processor, &GmicProcessor::coarsePreviewCommandFailed, this, &MainWindow::onCoarsePreviewError);
   connect(&_processor, &GmicProcessor::fullImageProcessingFailed, this, &MainWindow::onFullImageProcessingError);
   connect(&_processor, &GmicProcessor::fullImageProcessingDone, this, &MainWindow::onFullImageProcessingDone);
   connect(&_processor, &GmicProcessor::aboutToSendImagesToHost, ui->progressInfoWidget, &ProgressInfoWidget::stopAnimationAndHide);
+  connect(&_processor, &GmicProcessor::fullResolutionPreviewRequested, this, &MainWindow::onFullResolutionPreviewRequested);
   connect(_filtersPresenter, &FiltersPresenter::faveNameChanged, this, &MainWindow::setFilterName);
 }
 
@@ -686,7 +689,12 @@ void MainWindow::onPreviewUpdateRequested()
   onPreviewUpdateRequested(false);
 }
 
-void MainWindow::onPreviewUpdateRequested(bool synchronous)
+void MainWindow::onFullResolutionPreviewRequested()
+{
+  onPreviewUpdateRequested(false, true);
+}
+
+void MainWindow::onPreviewUpdateRequested(bool synchronous, bool fullResolution)
 {
   if (!ui->cbPreview->isChecked()) {
     ui->previewWidget->invalidateSavedPreview();
@@ -719,6 +727,7 @@ void MainWindow::onPreviewUpdateRequested(bool synchronous)
   context.filterCommand = currentFilter.previewCommand;
   context.filterArguments = ui->filterParams->valueString();
   context.previewFromFullImage = currentFilter.previewFromFullImage;
+  context.previewAtFullResolution = fullResolution;
   _processor.setContext(context);
   _processor.execute();
 
@@ -763,6 +772,9 @@ void MainWindow::onPreviewImageAvailable()
   }
   ui->previewWidget->setPreviewImage(_processor.previewImage());
   ui->previewWidget->enableRightClick();
+  if (_processor.previewScale() < 1.0) {
+    showMessage(tr("Preview at %1% resolution (%2 ms)").arg(qRound(100 * _processor.previewScale())).arg(_processor.lastPreviewFilterExecutionDurationMS()), 2000);
+  }
 #ifndef _GMIC_QT_DISABLE_UPDATES_
   ui->tbUpdateFilters->setEnabled(true);
 #endif
@@ -771,6 +783,23 @@ void MainWindow::onPreviewImageAvailable()
   }
 }
 
+void MainWindow::onCoarsePreviewImageAvailable()
+{
+  // The refinement pass is still running: only display the intermediate
+  // result, pending actions are handled once the final preview arrives.
+  ui->filterParams->setValues(_processor.gmicStatus(), false);
+  ui->filterParams->setVisibilityStates(_processor.parametersVisibilityStates());
+  if (ui->filterParams->hasKeypoints()) {
+    ui->previewWidget->setKeypoints(ui->filterParams->keypoints());
+  }
+  ui->previewWidget->setPreviewImage(_processor.previewImage());
+}
+
+void MainWindow::onCoarsePreviewError(const QString & message)
+{
+  showMessage(tr("Coarse preview failed: %1").arg(message), 2000);
+}
+
 void MainWindow::onPreviewError(const QString & message)
 {
   ui->previewWidget->setPreviewErrorMessage(message);
@@ -79,8 +79,9 @@ public:
 public slots:
   void onUpdateDownloadsFinished(int status);
   void onApplyClicked();
-  void onPreviewUpdateRequested(bool synchronous);
+  void onPreviewUpdateRequested(bool synchronous, bool fullResolution = false);
   void onPreviewUpdateRequested();
+  void onFullResolutionPreviewRequested();
   void onPreviewKeypointsEvent(unsigned int flags, unsigned long time);
   void onFullImageProcessingDone();
   void expandOrCollapseFolders();
@@ -106,7 +107,9 @@ public slots:
   void onFilterSelectionChanged();
   void onEscapeKeyPressed();
   void onPreviewImageAvailable();
+  void onCoarsePreviewImageAvailable();
   void onPreviewError(const QString & message);
+  void onCoarsePreviewError(const QString & message);
   void onParametersChanged();
   static bool isAccepted();
   void setFilterName(const QString & text);
@@ -49,6 +49,8 @@ int Settings::_updatePeriodicity;
 int Settings::_previewTimeout = 16;
 OutputMessageMode Settings::_outputMessageMode;
 bool Settings::_previewZoomAlwaysEnabled = false;
+bool Settings::_progressivePreview = true;
+int Settings::_previewLatencyTarget = 0;
 bool Settings::_notifyFailedStartupUpdate = true;
 
 const QColor Settings::CheckBoxBaseColor(83, 83, 83);
@@ -83,6 +85,8 @@ void Settings::load(UserInterfaceMode userInterfaceMode)
   FileParameterDefaultPath = settings.value("FileParameterDefaultPath", QDir::homePath()).toString();
   _previewTimeout = settings.value("PreviewTimeout", 16).toInt();
   _previewZoomAlwaysEnabled = settings.value("AlwaysEnablePreviewZoom", false).toBool();
+  _progressivePreview = settings.value("Config/ProgressivePreview", true).toBool();
+  _previewLatencyTarget = settings.value("Config/PreviewLatencyTarget", 0).toInt();
   _outputMessageMode = filterDeprecatedOutputMessageMode((GmicQt::OutputMessageMode)settings.value("OutputMessageMode", static_cast<int>(GmicQt::DefaultOutputMessageMode)).toInt());
   _notifyFailedStartupUpdate = settings.value("Config/NotifyIfStartupUpdateFails", true).toBool();
   if (userInterfaceMode != UserInterfaceMode::Silent) {
@@ -199,6 +203,26 @@ void Settings::setPreviewZoomAlwaysEnabled(bool on)
   _previewZoomAlwaysEnabled = on;
 }
 
+bool Settings::progressivePreview()
+{
+  return _progressivePreview;
+}
+
+void Settings::setProgressivePreview(bool on)
+{
+  _progressivePreview = on;
+}
+
+int Settings::previewLatencyTarget()
+{
+  return _previewLatencyTarget;
+}
+
+void Settings::setPreviewLatencyTarget(int ms)
+{
+  _previewLatencyTarget = ms;
+}
+
 bool Settings::notifyFailedStartupUpdate()
 {
   return _notifyFailedStartupUpdate;
@@ -227,6 +251,8 @@ void Settings::save(QSettings & settings)
   settings.setValue("PreviewTimeout", _previewTimeout);
   settings.setValue("OutputMessageMode", (int)_outputMessageMode);
   settings.setValue("AlwaysEnablePreviewZoom", _previewZoomAlwaysEnabled);
+  settings.setValue("Config/ProgressivePreview", _progressivePreview);
+  settings.setValue("Config/PreviewLatencyTarget", _previewLatencyTarget);
   // Remove obsolete keys (2.0.0 pre-release)
   settings.remove("Config/UseFaveInputMode");
   settings.remove("Config/UseFaveOutputMode");
@@ -60,6 +60,10 @@ public:
   static void setOutputMessageMode(OutputMessageMode mode);
   static bool previewZoomAlwaysEnabled();
   static void setPreviewZoomAlwaysEnabled(bool);
+  static bool progressivePreview();
+  static void setProgressivePreview(bool);
+  static int previewLatencyTarget();
+  static void setPreviewLatencyTarget(int ms);
   static bool notifyFailedStartupUpdate();
   static void setNotifyFailedStartupUpdate(bool);
 
@@ -89,6 +93,8 @@ private:
   static int _previewTimeout;
   static OutputMessageMode _outputMessageMode;
   static bool _previewZoomAlwaysEnabled;
+  static bool _progressivePreview;
+  static int _previewLatencyTarget;
   static bool _notifyFailedStartupUpdate;
 };
 
@@ -70,6 +70,8 @@ PreviewWidget::PreviewWidget(QWidget * parent) : QWidget(parent)
   _zoomConstraint = ZoomConstraint::Any;
   _timerID = 0;
   _savedPreviewIsValid = false;
+  _cachedPreviewImageIsValid = false;
+  _cachedOriginalImageIsValid = false;
   _paintOriginalImage = true;
   qApp->installEventFilter(this);
   _rightClickEnabled = false;
@@ -98,6 +100,7 @@ void PreviewWidget::setPreviewImage(const cimg_library::CImg<float> & image)
   *_image = image;
   *_savedPreview = image;
   _savedPreviewIsValid = true;
+  _cachedPreviewImageIsValid = false;
   updateOriginalImagePosition();
   _paintOriginalImage = false;
   if (isAtFullZoom()) {
@@ -138,6 +141,7 @@ void PreviewWidget::setFullImageSize(const QSize & size)
 {
   _fullImageSize = size;
   CroppedActiveLayerProxy::clear();
+  invalidateCachedImages();
   updateVisibleRect();
   saveVisibleCenter();
 }
@@ -148,6 +152,7 @@ void PreviewWidget::updateFullImageSizeIfDifferent(const QSize & size)
     setFullImageSize(size);
   } else {
     CroppedActiveLayerProxy::clear();
+    invalidateCachedImages();
   }
 }
 
@@ -371,34 +376,61 @@ void PreviewWidget::paintPreview(QPainter & painter)
    *  Otherwise : Preview size == Original scaled size and image position is therefore unchanged
    */
 
-  if (hasAlphaChannel(*_image)) {
+  if (!_cachedPreviewImageIsValid || (_cachedPreviewImageSize != _imagePosition.size())) {
+    updateCachedPreviewImage();
+  }
+  if (_cachedPreviewImage.hasAlphaChannel()) {
     painter.fillRect(_imagePosition, QBrush(_transparency));
   }
-  QImage qimage;
-  convertCImgToQImage(_image->get_resize(_imagePosition.width(), _imagePosition.height(), 1, -100, 1), qimage);
-  painter.drawImage(_imagePosition, qimage);
+  painter.drawImage(_imagePosition, _cachedPreviewImage);
   paintKeypoints(painter);
 }
 
 void PreviewWidget::paintOriginalImage(QPainter & painter)
 {
-  gmic_image<float> image;
-  getOriginalImageCrop(image);
   updateOriginalImagePosition();
-  if (!image.width() && !image.height()) {
+  if (!_cachedOriginalImageIsValid || (_cachedOriginalImageRect != _visibleRect) || (_cachedOriginalImageSize != _imagePosition.size())) {
+    updateCachedOriginalImage();
+  }
+  if (_cachedOriginalImage.isNull()) {
     painter.fillRect(rect(), QBrush(_transparency));
   } else {
-    image.resize(_imagePosition.width(), _imagePosition.height(), 1, -100, 1);
-    if (hasAlphaChannel(image)) {
+    if (_cachedOriginalImage.hasAlphaChannel()) {
       painter.fillRect(_imagePosition, QBrush(_transparency));
     }
-    QImage qimage;
-    convertCImgToQImage(image, qimage);
-    painter.drawImage(_imagePosition, qimage);
+    painter.drawImage(_imagePosition, _cachedOriginalImage);
     paintKeypoints(painter);
   }
 }
 
+void PreviewWidget::updateCachedPreviewImage()
+{
+  convertCImgToQImage(_image->get_resize(_imagePosition.width(), _imagePosition.height(), 1, -100, 1), _cachedPreviewImage);
+  _cachedPreviewImageSize = _imagePosition.size();
+  _cachedPreviewImageIsValid = true;
+}
+
+void PreviewWidget::updateCachedOriginalImage()
+{
+  gmic_image<float> image;
+  getOriginalImageCrop(image);
+  if (!image.width() && !image.height()) {
+    _cachedOriginalImage = QImage();
+  } else {
+    image.resize(_imagePosition.width(), _imagePosition.height(), 1, -100, 1);
+    convertCImgToQImage(image, _cachedOriginalImage);
+  }
+  _cachedOriginalImageSize = _imagePosition.size();
+  _cachedOriginalImageRect = _visibleRect;
+  _cachedOriginalImageIsValid = true;
+}
+
+void PreviewWidget::invalidateCachedImages()
+{
+  _cachedPreviewImageIsValid = false;
+  _cachedOriginalImageIsValid = false;
+}
+
 void PreviewWidget::paintEvent(QPaintEvent * e)
 {
   QPainter painter(this);
@@ -932,6 +964,7 @@ void PreviewWidget::invalidateSavedPreview()
 void PreviewWidget::restorePreview()
 {
   *_image = *_savedPreview;
+  _cachedPreviewImageIsValid = false;
 }
 
 void PreviewWidget::enableRightClick()
@@ -133,6 +133,9 @@ private:
   void paintOriginalImage(QPainter &);
   void getOriginalImageCrop(cimg_library::CImg<float> & image);
   void updateOriginalImagePosition();
+  void updateCachedPreviewImage();
+  void updateCachedOriginalImage();
+  void invalidateCachedImages();
   void updateErrorImage();
 
   void paintKeypoints(QPainter & painter);
@@ -201,6 +204,20 @@ private:
   QString _errorMessage;
   QString _overlayMessage;
   QImage _errorImage;
+
+  /*
+   * Display-ready (8-bit, widget resolution) versions of the preview and of the
+   * original image crop, so that repaints (e.g. while dragging keypoints) do not
+   * resize and convert the float images again.
+   */
+  QImage _cachedPreviewImage;
+  QSize _cachedPreviewImageSize;
+  bool _cachedPreviewImageIsValid;
+  QImage _cachedOriginalImage;
+  QSize _cachedOriginalImageSize;
+  PreviewRect _cachedOriginalImageRect;
+  bool _cachedOriginalImageIsValid;
+
   KeypointList _keypoints;
   int _movedKeypointIndex;
   QPoint _movedKeypointOrigin;
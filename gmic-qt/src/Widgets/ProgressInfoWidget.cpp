@@ -218,6 +218,9 @@ void ProgressInfoWidget::updateThreadInformation()
 #else
   ui->label->setText(QString(tr("[Processing %1]")).arg(durationStr));
 #endif
+  if (!_gmicProcessor->isProcessingFullImage() && (_gmicProcessor->previewScale() < 1.0)) {
+    ui->label->setText(ui->label->text() + QString(tr(" [Preview at %1% | ~%2 ms at 100%]")).arg(qRound(100 * _gmicProcessor->previewScale())).arg(_gmicProcessor->estimatedFullResolutionPreviewDurationMS()));
+  }
 }
 
 void ProgressInfoWidget::updateUpdateProgression()
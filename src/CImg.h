@@ -171,6 +171,7 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <fnmatch.h>
@@ -202,6 +203,7 @@ enum {FALSE_WIN = 0};
 #if cimg_use_cpp11==1
 #include <initializer_list>
 #include <utility>
+#include <atomic>
 #endif
 
 // Convenient macro to define pragma
@@ -272,6 +274,18 @@ enum {FALSE_WIN = 0};
 #endif
 #endif
 
+// Configure allocation of pixel buffers.
+//
+// Pixel buffers of images with basic value types are aligned on 'cimg_alignment' bytes (default: 64).
+// Recently deallocated buffers are kept in a pool of at most 'cimg_memory_pool_size' bytes, so that they can
+// be reused by further allocations of the same size. Define 'cimg_memory_pool_size' to '0' to disable the pool.
+#ifndef cimg_alignment
+#define cimg_alignment 64
+#endif
+#ifndef cimg_memory_pool_size
+#define cimg_memory_pool_size ((cimg_ulong)256*1024*1024)
+#endif
+
 // Configure filename separator.
 //
 // Filename separator is set by default to '/', except for Windows where it is '\'.
@@ -329,6 +343,14 @@ enum {FALSE_WIN = 0};
 #define cimg_pragma_openmp(p)
 #endif
 
+// Configure the user-defined context of the math parser (null by default).
+// It is evaluated once when a math parser is constructed, and copied to the per-thread
+// copies of the math parser, so that user-defined functions ('cimg_mp_func_*') can
+// access it as 'mp.p_context' without any global lookup.
+#ifndef cimg_mp_context
+#define cimg_mp_context 0
+#endif
+
 // Configure the 'abort' signal handler (does nothing by default).
 // A typical signal handler can be defined in your own source like this:
 // #define cimg_abort_test if (is_abort) throw CImgAbortException("")
@@ -2370,6 +2392,9 @@ namespace cimg_library_suffixed {
     // 'lock_mode' can be { 0=unlock | 1=lock | 2=trylock }.
     // 'n' can be in [0,31] but mutex range [0,15] is reserved by CImg.
     inline int mutex(const unsigned int n, const int lock_mode=1);
+    inline void *memalloc(const size_t size);
+    inline void memfree(void *const ptr);
+    inline void memtrim();
 
     inline unsigned int& exception_mode(const unsigned int value, const bool is_set) {
       static unsigned int mode = cimg_verbosity;
@@ -3065,6 +3090,17 @@ namespace cimg_library_suffixed {
     };
 #endif
 
+    // Define traits that tell if pixel buffers of a given type can be allocated as raw memory
+    // (i.e. without calling constructors and destructors), with 'cimg::memalloc()' and 'cimg::memfree()'.
+    template<typename T> struct is_raw { enum { value = 0 }; };
+    template<typename T> struct is_raw<T*> { enum { value = 1 }; };
+#define _cimg_is_raw(T) template<> struct is_raw<T> { enum { value = 1 }; }
+    _cimg_is_raw(bool); _cimg_is_raw(unsigned char); _cimg_is_raw(char); _cimg_is_raw(signed char);
+    _cimg_is_raw(unsigned short); _cimg_is_raw(short); _cimg_is_raw(unsigned int); _cimg_is_raw(int);
+    _cimg_is_raw(cimg_uint64); _cimg_is_raw(cimg_int64); _cimg_is_raw(float); _cimg_is_raw(double);
+    _cimg_is_raw(long double);
+#undef _cimg_is_raw
+
     template<typename T, typename t> struct superset { typedef T type; };
     template<> struct superset<bool,unsigned char> { typedef unsigned char type; };
     template<> struct superset<bool,char> { typedef char type; };
@@ -3278,6 +3314,62 @@ namespace cimg_library_suffixed {
     inline Mutex_static& Mutex_attr() { static Mutex_static val; return val; }
 #endif
 
+    struct Memory_static {
+      void *pool[32];           // Recently deallocated buffers, from the oldest to the newest
+      unsigned int pool_siz;    // Number of buffers in the pool
+      cimg_ulong pool_bytes;    // Total size of the buffers in the pool
+#if cimg_use_cpp11==1
+      std::atomic<cimg_uint64> bytes, peak_bytes, nb_allocations, nb_reuses;
+#else
+      cimg_uint64 bytes, peak_bytes, nb_allocations, nb_reuses;
+#endif
+#if cimg_use_openmp!=0
+      omp_lock_t mutex;
+      Memory_static():pool_siz(0),pool_bytes(0),bytes(0),peak_bytes(0),nb_allocations(0),nb_reuses(0) {
+        omp_init_lock(&mutex);
+      }
+      void lock() { omp_set_lock(&mutex); }
+      void unlock() { omp_unset_lock(&mutex); }
+#else
+      Memory_static():pool_siz(0),pool_bytes(0),bytes(0),peak_bytes(0),nb_allocations(0),nb_reuses(0) {}
+      void lock() { cimg::mutex(13); }
+      void unlock() { cimg::mutex(13,0); }
+#endif
+
+      // Update counters of allocated buffers.
+      // With C++11, they are relaxed atomics, so that allocations that do not touch the pool never take the lock.
+      void count_alloc(const cimg_uint64 size, const bool is_reuse) {
+#if cimg_use_cpp11==1
+        const cimg_uint64 nbytes = bytes.fetch_add(size,std::memory_order_relaxed) + size;
+        nb_allocations.fetch_add(1,std::memory_order_relaxed);
+        if (is_reuse) nb_reuses.fetch_add(1,std::memory_order_relaxed);
+        cimg_uint64 peak = peak_bytes.load(std::memory_order_relaxed);
+        while (nbytes>peak && !peak_bytes.compare_exchange_weak(peak,nbytes,std::memory_order_relaxed)) {}
+#else
+        lock();
+        bytes+=size; ++nb_allocations;
+        if (is_reuse) ++nb_reuses;
+        if (bytes>peak_bytes) peak_bytes = bytes;
+        unlock();
+#endif
+      }
+
+      void count_free(const cimg_uint64 size) {
+#if cimg_use_cpp11==1
+        bytes.fetch_sub(size,std::memory_order_relaxed);
+#else
+        lock(); bytes-=size; unlock();
+#endif
+      }
+    }; // struct Memory_static { ...
+#if defined(cimg_module)
+    Memory_static& Memory_attr();
+#elif defined(cimg_main)
+    Memory_static& Memory_attr() { static Memory_static val; return val; }
+#else
+    inline Memory_static& Memory_attr() { static Memory_static val; return val; }
+#endif
+
 #if defined(cimg_use_magick)
     struct Magick_static {
       Magick_static() {
@@ -5699,6 +5791,108 @@ namespace cimg_library_suffixed {
       }
     }
 
+    //! Allocate a memory buffer, aligned for pixel storage.
+    /**
+       \param size Size of the buffer, in bytes.
+       \return Pointer to the allocated buffer, aligned on \c cimg_alignment bytes.
+       \note
+       - Buffers of at least 16 Kio are taken from the pool of recently deallocated buffers, when one with the same size
+         is available. Buffers of at least 2 Mio are aligned on 2 Mio, and backed by transparent huge pages
+         when the system allows it.
+       - A \c std::bad_alloc exception is thrown when the buffer cannot be allocated.
+       - The returned buffer must be deallocated with cimg::memfree().
+    **/
+    inline void *memalloc(const size_t size) {
+      if (!size) return 0;
+      Memory_static &mem = cimg::Memory_attr();
+      if (size>=16384) { // Large buffer: look for one with the same size in the pool
+        void *ptr = 0;
+        mem.lock();
+        for (int k = (int)mem.pool_siz - 1; k>=0; --k)
+          if (((size_t*)mem.pool[k])[-1]==size) {
+            ptr = mem.pool[k];
+            std::memmove(mem.pool + k,mem.pool + k + 1,(mem.pool_siz - k - 1)*sizeof(void*));
+            --mem.pool_siz; mem.pool_bytes-=size;
+            break;
+          }
+        mem.unlock();
+        if (ptr) { mem.count_alloc(size,true); return ptr; }
+      }
+
+      size_t alignment = cimg_alignment;
+#if defined(MADV_HUGEPAGE)
+      if (size>=((size_t)2<<20)) alignment = (size_t)2<<20;
+#endif
+      const size_t offset = 2*sizeof(size_t);
+      void *raw = std::malloc(size + offset + alignment);
+      if (!raw) { cimg::memtrim(); raw = std::malloc(size + offset + alignment); }
+      if (!raw) throw std::bad_alloc();
+      mem.count_alloc(size,false);
+      void *const ptr = (void*)(((cimg_ulong)raw + offset + alignment - 1)/alignment*alignment);
+      ((size_t*)ptr)[-2] = (size_t)((char*)ptr - (char*)raw);
+      ((size_t*)ptr)[-1] = size;
+#if defined(MADV_HUGEPAGE)
+      if (alignment>cimg_alignment) madvise(ptr,size/4096*4096,MADV_HUGEPAGE);
+#endif
+      return ptr;
+    }
+
+    //! Deallocate a memory buffer allocated by cimg::memalloc().
+    /**
+       \param ptr Pointer to the buffer to deallocate.
+       \note Buffers of at least 16 Kio are moved to the pool of recently deallocated buffers, from which the oldest
+       ones are released when its size exceeds \c cimg_memory_pool_size.
+    **/
+    inline void memfree(void *const ptr) {
+      if (!ptr) return;
+      Memory_static &mem = cimg::Memory_attr();
+      const size_t size = ((size_t*)ptr)[-1];
+      mem.count_free(size);
+      if (size<16384 || size>cimg_memory_pool_size) { // Small or huge buffer: release it directly
+        std::free((char*)ptr - ((size_t*)ptr)[-2]);
+        return;
+      }
+      mem.lock();
+      while (mem.pool_siz && (mem.pool_siz==32 || mem.pool_bytes + size>cimg_memory_pool_size)) {
+        void *const old = *mem.pool;
+        mem.pool_bytes-=((size_t*)old)[-1];
+        std::memmove(mem.pool,mem.pool + 1,(--mem.pool_siz)*sizeof(void*));
+        std::free((char*)old - ((size_t*)old)[-2]);
+      }
+      mem.pool[mem.pool_siz++] = ptr;
+      mem.pool_bytes+=size;
+      mem.unlock();
+    }
+
+    //! Release all buffers kept in the pool of recently deallocated buffers.
+    inline void memtrim() {
+      Memory_static &mem = cimg::Memory_attr();
+      mem.lock();
+      for (unsigned int k = 0; k<mem.pool_siz; ++k) {
+        void *const old = mem.pool[k];
+        std::free((char*)old - ((size_t*)old)[-2]);
+      }
+      mem.pool_siz = 0; mem.pool_bytes = 0;
+      mem.unlock();
+    }
+
+    //! Get statistics about buffers allocated by cimg::memalloc().
+    /**
+       \param[out] bytes Total size of the currently allocated buffers, in bytes.
+       \param[out] peak_bytes Peak value reached by \c bytes.
+       \param[out] nb_allocations Number of allocated buffers since the program started.
+       \param[out] nb_reuses Number of allocations served by the pool of recently deallocated buffers.
+    **/
+    inline void meminfo(cimg_uint64 &bytes, cimg_uint64 &peak_bytes,
+                        cimg_uint64 &nb_allocations, cimg_uint64 &nb_reuses) {
+      Memory_static &mem = cimg::Memory_attr();
+      mem.lock();
+      bytes = mem.bytes; peak_bytes = mem.peak_bytes;
+      nb_allocations = mem.nb_allocations; nb_reuses = mem.nb_reuses;
+      mem.unlock();
+      if (bytes>peak_bytes) peak_bytes = bytes;
+    }
+
     //! Display a warning message on the default output stream.
     /**
        \param format C-string containing the format of the message, as with <tt>std::printf()</tt>.
@@ -11832,6 +12026,15 @@ namespace cimg_library_suffixed {
                                   pixel_type(),dx,dy,dz,dc);
     }
 
+    // Allocate and deallocate pixel buffers.
+    static T *_new_data(const size_t siz) {
+      return cimg::is_raw<T>::value?(T*)cimg::memalloc(siz*sizeof(T)):new T[siz];
+    }
+
+    static void _delete_data(T *const data) {
+      if (cimg::is_raw<T>::value) cimg::memfree((void*)data); else delete[] data;
+    }
+
     //@}
     //---------------------------
     //
@@ -11884,7 +12087,7 @@ namespace cimg_library_suffixed {
          (to a deallocated buffer).
     **/
     ~CImg() {
-      if (!_is_shared) delete[] _data;
+      if (!_is_shared) _delete_data(_data);
     }
 
     //! Construct empty image.
@@ -11935,7 +12138,7 @@ namespace cimg_library_suffixed {
       const size_t siz = safe_size(size_x,size_y,size_z,size_c);
       if (siz) {
         _width = size_x; _height = size_y; _depth = size_z; _spectrum = size_c;
-        try { _data = new T[siz]; } catch (...) {
+        try { _data = _new_data(siz); } catch (...) {
           _width = _height = _depth = _spectrum = 0; _data = 0;
           throw CImgInstanceException(_cimg_instance
                                       "CImg(): Failed to allocate memory (%s) for image (%u,%u,%u,%u).",
@@ -11967,7 +12170,7 @@ namespace cimg_library_suffixed {
       const size_t siz = safe_size(size_x,size_y,size_z,size_c);
       if (siz) {
         _width = size_x; _height = size_y; _depth = size_z; _spectrum = size_c;
-        try { _data = new T[siz]; } catch (...) {
+        try { _data = _new_data(siz); } catch (...) {
           _width = _height = _depth = _spectrum = 0; _data = 0;
           throw CImgInstanceException(_cimg_instance
                                       "CImg(): Failed to allocate memory (%s) for image (%u,%u,%u,%u).",
@@ -12192,7 +12395,7 @@ namespace cimg_library_suffixed {
       const size_t siz = safe_size(size_x,size_y,size_z,size_c);
       if (siz) {
         _width = size_x; _height = size_y; _depth = size_z; _spectrum = size_c;
-        try { _data = new T[siz]; } catch (...) {
+        try { _data = _new_data(siz); } catch (...) {
           _width = _height = _depth = _spectrum = 0; _data = 0;
           throw CImgInstanceException(_cimg_instance
                                       "CImg(): Failed to allocate memory (%s) for image (%u,%u,%u,%u).",
@@ -12248,7 +12451,7 @@ namespace cimg_library_suffixed {
       const size_t siz = safe_size(size_x,size_y,size_z,size_c);
       if (values && siz) {
         _width = size_x; _height = size_y; _depth = size_z; _spectrum = size_c;
-        try { _data = new T[siz]; } catch (...) {
+        try { _data = _new_data(siz); } catch (...) {
           _width = _height = _depth = _spectrum = 0; _data = 0;
           throw CImgInstanceException(_cimg_instance
                                       "CImg(): Failed to allocate memory (%s) for image (%u,%u,%u,%u).",
@@ -12269,7 +12472,7 @@ namespace cimg_library_suffixed {
         _width = size_x; _height = size_y; _depth = size_z; _spectrum = size_c; _is_shared = is_shared;
         if (_is_shared) _data = const_cast<T*>(values);
         else {
-          try { _data = new T[siz]; } catch (...) {
+          try { _data = _new_data(siz); } catch (...) {
             _width = _height = _depth = _spectrum = 0; _data = 0;
             throw CImgInstanceException(_cimg_instance
                                         "CImg(): Failed to allocate memory (%s) for image (%u,%u,%u,%u).",
@@ -12385,7 +12588,7 @@ namespace cimg_library_suffixed {
       const size_t siz = (size_t)img.size();
       if (img._data && siz) {
         _width = img._width; _height = img._height; _depth = img._depth; _spectrum = img._spectrum;
-        try { _data = new T[siz]; } catch (...) {
+        try { _data = _new_data(siz); } catch (...) {
           _width = _height = _depth = _spectrum = 0; _data = 0;
           throw CImgInstanceException(_cimg_instance
                                       "CImg(): Failed to allocate memory (%s) for image (%u,%u,%u,%u).",
@@ -12405,7 +12608,7 @@ namespace cimg_library_suffixed {
         _is_shared = img._is_shared;
         if (_is_shared) _data = const_cast<T*>(img._data);
         else {
-          try { _data = new T[siz]; } catch (...) {
+          try { _data = _new_data(siz); } catch (...) {
             _width = _height = _depth = _spectrum = 0; _data = 0;
             throw CImgInstanceException(_cimg_instance
                                         "CImg(): Failed to allocate memory (%s) for image (%u,%u,%u,%u).",
@@ -12447,7 +12650,7 @@ namespace cimg_library_suffixed {
       const size_t siz = (size_t)img.size();
       if (img._data && siz) {
         _width = img._width; _height = img._height; _depth = img._depth; _spectrum = img._spectrum;
-        try { _data = new T[siz]; } catch (...) {
+        try { _data = _new_data(siz); } catch (...) {
           _width = _height = _depth = _spectrum = 0; _data = 0;
           throw CImgInstanceException(_cimg_instance
                                       "CImg(): Failed to allocate memory (%s) for image (%u,%u,%u,%u).",
@@ -12467,7 +12670,7 @@ namespace cimg_library_suffixed {
         _is_shared = is_shared;
         if (_is_shared) _data = const_cast<T*>(img._data);
         else {
-          try { _data = new T[siz]; } catch (...) {
+          try { _data = _new_data(siz); } catch (...) {
             _width = _height = _depth = _spectrum = 0; _data = 0;
             throw CImgInstanceException(_cimg_instance
                                         "CImg(): Failed to allocate memory (%s) for image (%u,%u,%u,%u).",
@@ -12554,7 +12757,7 @@ namespace cimg_library_suffixed {
        In-place version of the default constructor CImg(). It simply resets the instance to an empty image.
     **/
     CImg<T>& assign() {
-      if (!_is_shared) delete[] _data;
+      if (!_is_shared) _delete_data(_data);
       _width = _height = _depth = _spectrum = 0; _is_shared = false; _data = 0;
       return *this;
     }
@@ -12576,8 +12779,8 @@ namespace cimg_library_suffixed {
                                       cimg_instance,
                                       size_x,size_y,size_z,size_c);
         else {
-          delete[] _data;
-          try { _data = new T[siz]; } catch (...) {
+          _delete_data(_data);
+          try { _data = _new_data(siz); } catch (...) {
             _width = _height = _depth = _spectrum = 0; _data = 0;
             throw CImgInstanceException(_cimg_instance
                                         "assign(): Failed to allocate memory (%s) for image (%u,%u,%u,%u).",
@@ -12661,7 +12864,7 @@ namespace cimg_library_suffixed {
         else std::memcpy((void*)_data,(void*)values,siz*sizeof(T));
       } else {
         T *new_data = 0;
-        try { new_data = new T[siz]; } catch (...) {
+        try { new_data = _new_data(siz); } catch (...) {
           _width = _height = _depth = _spectrum = 0; _data = 0;
           throw CImgInstanceException(_cimg_instance
                                       "assign(): Failed to allocate memory (%s) for image (%u,%u,%u,%u).",
@@ -12670,7 +12873,7 @@ namespace cimg_library_suffixed {
                                       size_x,size_y,size_z,size_c);
         }
         std::memcpy((void*)new_data,(void*)values,siz*sizeof(T));
-        delete[] _data; _data = new_data; _width = size_x; _height = size_y; _depth = size_z; _spectrum = size_c;
+        _delete_data(_data); _data = new_data; _width = size_x; _height = size_y; _depth = size_z; _spectrum = size_c;
       }
       return *this;
     }
@@ -16892,12 +17095,14 @@ namespace cimg_library_suffixed {
       CImgList<T>& imglist;
 
       CImg<doubleT> _img_stats, &img_stats, constcache_vals;
-      CImgList<doubleT> _list_stats, &list_stats, _list_median, &list_median, _list_norm, &list_norm;
+      CImgList<doubleT> _list_stats, &list_stats, _list_median, &list_median, _list_norm, &list_norm,
+        _list_integrals, &list_integrals;
       CImg<uintT> mem_img_stats, constcache_inds;
 
       CImg<uintT> level, variable_pos, reserved_label;
       CImgList<charT> variable_def, macro_def, macro_body;
       char *user_macro;
+      void *p_context; // User-defined context, captured at construction (see 'cimg_mp_context')
 
       unsigned int mempos, mem_img_median, mem_img_norm, mem_img_index, debug_indent, result_dim, break_type,
         constcache_size;
@@ -16955,8 +17160,9 @@ namespace cimg_library_suffixed {
         code(_code),code_begin_t(_code_begin_t),code_end_t(_code_end_t),
         p_break((CImg<ulongT>*)(cimg_ulong)-2),imgin(img_input),
         imgout(img_output?*img_output:CImg<T>::empty()),imglist(list_images?*list_images:CImgList<T>::empty()),
-        img_stats(_img_stats),list_stats(_list_stats),list_median(_list_median),list_norm(_list_norm),user_macro(0),
-        mem_img_median(~0U),mem_img_norm(~0U),mem_img_index(~0U),debug_indent(0),result_dim(0),break_type(0),
+        img_stats(_img_stats),list_stats(_list_stats),list_median(_list_median),list_norm(_list_norm),
+        list_integrals(_list_integrals),user_macro(0),
+        p_context(cimg_mp_context),mem_img_median(~0U),mem_img_norm(~0U),mem_img_index(~0U),debug_indent(0),result_dim(0),break_type(0),
         constcache_size(0),is_parallelizable(true),is_noncritical_run(false),is_fill(_is_fill),need_input_copy(false),
         rng((cimg::_rand(),cimg::rng())),calling_function(funcname?funcname:"cimg_math_parser") {
 
@@ -17070,9 +17276,10 @@ namespace cimg_library_suffixed {
         code(_code),code_begin_t(_code_begin_t),code_end_t(_code_end_t),
         p_code_end(0),p_break((CImg<ulongT>*)(cimg_ulong)-2),
         imgin(CImg<T>::const_empty()),imgout(CImg<T>::empty()),imglist(CImgList<T>::empty()),
-        img_stats(_img_stats),list_stats(_list_stats),list_median(_list_median),list_norm(_list_norm),debug_indent(0),
-        result_dim(0),break_type(0),constcache_size(0),is_parallelizable(true),is_noncritical_run(false),is_fill(false),
-        need_input_copy(false),rng(0),calling_function(0) {
+        img_stats(_img_stats),list_stats(_list_stats),list_median(_list_median),list_norm(_list_norm),
+        list_integrals(_list_integrals),p_context(0),
+        debug_indent(0),result_dim(0),break_type(0),constcache_size(0),is_parallelizable(true),is_noncritical_run(false),
+        is_fill(false),need_input_copy(false),rng(0),calling_function(0) {
         mem.assign(1 + _cimg_mp_slot_c,1,1,1,0); // Allow to skip 'is_empty?' test in operator()()
         result = mem._data;
       }
@@ -17082,7 +17289,7 @@ namespace cimg_library_suffixed {
         p_code_end(mp.p_code_end),p_break(mp.p_break),
         imgin(mp.imgin),imgout(mp.imgout),imglist(mp.imglist),
         img_stats(mp.img_stats),list_stats(mp.list_stats),list_median(mp.list_median),list_norm(mp.list_norm),
-        debug_indent(0),result_dim(mp.result_dim),break_type(0),constcache_size(0),
+        list_integrals(mp.list_integrals),p_context(mp.p_context),debug_indent(0),result_dim(mp.result_dim),break_type(0),constcache_size(0),
         is_parallelizable(mp.is_parallelizable),is_noncritical_run(mp.is_noncritical_run),is_fill(mp.is_fill),
         need_input_copy(mp.need_input_copy),result(mem._data + (mp.result - mp.mem._data)),
         rng((cimg::_rand(),cimg::rng())),calling_function(0) {
@@ -19191,6 +19398,37 @@ namespace cimg_library_suffixed {
               }
             }
 
+            if (!std::strncmp(ss,"boxcov(",7) || !std::strncmp(ss,"boxmean(",8) ||
+                !std::strncmp(ss,"boxsum(",7) || !std::strncmp(ss,"boxvar(",7)) { // Box statistics
+              p3 = ss[3]=='s'?0U:ss[3]=='m'?1U:ss[3]=='v'?2U:3U; // Statistic
+              _cimg_mp_op(p3==0?"Function 'boxsum()'":p3==1?"Function 'boxmean()'":
+                          p3==2?"Function 'boxvar()'":"Function 'boxcov()'");
+              s0 = p3==1?ss8:ss7;
+              if (*s0!='#') break;
+              s1 = ++s0; while (s1<se1 && (*s1!=',' || level[s1 - expr._data]!=clevel1)) ++s1;
+              p1 = compile(s0,s1,depth1,0,bloc_flags);
+              _cimg_mp_check_list();
+              _cimg_mp_check_type(p1,1,1,0);
+              CImg<ulongT>::vector((ulongT)mp_list_box_stats,0,p1,0,0,0,0,0,0,0,0,p3).move_to(opcode);
+              for (pos = 3; pos<(p3==3?11U:10U); ++pos) {
+                if (pos==9 && s1>=se1 && p3!=3) { opcode[9] = const_scalar(0); break; } // Default channel
+                s2 = ++s1; while (s2<se1 && (*s2!=',' || level[s2 - expr._data]!=clevel1)) ++s2;
+                opcode[pos] = compile(s1,s2,depth1,0,bloc_flags);
+                _cimg_mp_check_type((unsigned int)opcode[pos],pos - 1,1,0);
+                s1 = s2;
+              }
+              if (p3!=3) opcode[10] = opcode[9];
+              if (_cimg_mp_is_const_scalar(p1)) { // Compute integral images once, before evaluation
+                p2 = (unsigned int)cimg::mod((int)mem[p1],imglist.width());
+                get_list_integral(*this,p2,false);
+                if (p3>=2) get_list_integral(*this,p2,true);
+              } else if (!is_inside_critical) is_parallelizable = false;
+              pos = scalar();
+              opcode[1] = pos;
+              opcode.move_to(code);
+              _cimg_mp_return(pos);
+            }
+
             if (!std::strncmp(ss,"bool(",5)) { // Boolean cast
               _cimg_mp_op("Function 'bool()'");
               arg1 = compile(ss5,se1,depth1,0,bloc_flags);
@@ -22819,6 +23057,19 @@ namespace cimg_library_suffixed {
         return res;
       }
 
+      // Return integral image (or integral image of channel products) of image 'imglist[ind]'.
+      // It is computed at its first request, and kept for the rest of the evaluation.
+      static const CImg<doubleT>& get_list_integral(_cimg_math_parser& mp, const unsigned int ind,
+                                                    const bool is_products) {
+        if (!mp.list_integrals) mp.list_integrals.assign(2*mp.imglist._width);
+        CImg<doubleT> &integral = mp.list_integrals[2*ind + (is_products?1:0)];
+        if (!integral) {
+          if (is_products) mp.imglist[ind].get_integral_products().move_to(integral);
+          else mp.imglist[ind].get_integral_image().move_to(integral);
+        }
+        return integral;
+      }
+
       // Find and return index of current image 'imgin' within image list 'imglist'.
       unsigned int get_mem_img_index() {
         if (mem_img_index==~0U) {
@@ -25108,6 +25359,31 @@ namespace cimg_library_suffixed {
         return _mp_arg(4) - _mp_arg(2)*_mp_arg(3);
       }
 
+      static double mp_list_box_stats(_cimg_math_parser& mp) {
+        const unsigned int
+          ind = (unsigned int)cimg::mod((int)_mp_arg(2),mp.imglist.width()),
+          statistic = (unsigned int)mp.opcode[11];
+        const CImg<T> &img = mp.imglist[ind];
+        const int
+          x0 = (int)_mp_arg(3), y0 = (int)_mp_arg(4), z0 = (int)_mp_arg(5),
+          x1 = (int)_mp_arg(6), y1 = (int)_mp_arg(7), z1 = (int)_mp_arg(8),
+          c0 = (int)std::min(_mp_arg(9),_mp_arg(10)), c1 = (int)std::max(_mp_arg(9),_mp_arg(10));
+        if (c0<0 || c1>=img.spectrum()) return cimg::type<double>::nan();
+        const double
+          n = (double)std::max(0,std::min(x1,img.width() - 1) - std::max(x0,0) + 1)*
+          std::max(0,std::min(y1,img.height() - 1) - std::max(y0,0) + 1)*
+          std::max(0,std::min(z1,img.depth() - 1) - std::max(z0,0) + 1);
+        if (!n) return statistic?cimg::type<double>::nan():0;
+        const CImg<doubleT> &integral = get_list_integral(mp,ind,false);
+        const double sum0 = integral.integral_sum(x0,y0,z0,x1,y1,z1,c0);
+        if (statistic<2) return statistic?sum0/n:sum0;
+        const int k = c0*(2*img.spectrum() - c0 + 1)/2 + c1 - c0; // Index of channel products (c0,c1)
+        const double
+          sum1 = c1==c0?sum0:integral.integral_sum(x0,y0,z0,x1,y1,z1,c1),
+          res = get_list_integral(mp,ind,true).integral_sum(x0,y0,z0,x1,y1,z1,k)/n - sum0*sum1/(n*n);
+        return statistic==2?std::max(0.,res):res;
+      }
+
       static double mp_list_depth(_cimg_math_parser& mp) {
         const unsigned int ind = (unsigned int)cimg::mod((int)_mp_arg(2),mp.imglist.width());
         return (double)mp.imglist[ind]._depth;
@@ -28664,6 +28940,46 @@ namespace cimg_library_suffixed {
                                     "kth_smallest(): Empty instance.",
                                     cimg_instance);
       if (k>=size()) return max();
+      if (size()>=(cimg_openmp_sizefactor)*1048576) { // Large image: select value from histogram
+        if (_is_value_countable()) {
+          const CImg<ulongT> counts = _get_value_counts();
+          ulongT cumul = 0;
+          cimg_forX(counts,l) if ((cumul+=counts[l])>k) return (T)(l + cimg::type<T>::min());
+        }
+        T val_max = 0;
+        const T val_min = min_max(val_max);
+        if (!cimg::type<T>::is_nan(val_min) && !cimg::type<T>::is_nan(val_max)) {
+          if (val_min==val_max) return val_min;
+          const unsigned int nb_levels = 65536;
+          const double vmin = (double)val_min, factor = nb_levels/((double)val_max - vmin);
+          ulongT nb_nans = cimg::type<double>::is_finite(factor)?0:1;
+          CImg<ulongT> hist(nb_levels,1,1,1,0);
+          if (!nb_nans) cimg_pragma_openmp(parallel reduction(+:nb_nans) cimg_openmp_if_size(size(),1048576)) {
+            CImg<ulongT> _hist;
+            ulongT *_ptrd = hist._data;
+#if cimg_use_openmp!=0
+            if (omp_get_num_threads()>1) _ptrd = _hist.assign(nb_levels,1,1,1,0)._data;
+#endif
+            cimg_pragma_openmp(for)
+            cimg_rofoff(*this,off) {
+              const T val = _data[off];
+              if (cimg::type<T>::is_nan(val)) ++nb_nans;
+              else ++_ptrd[std::min((unsigned int)((val - vmin)*factor),nb_levels - 1)];
+            }
+            if (_hist) { cimg_pragma_openmp(critical(kth_smallest)) hist+=_hist; }
+          }
+          if (!nb_nans) { // Find level containing the kth value, then select it among values of this level
+            unsigned int level = 0;
+            ulongT cumul = 0;
+            while (cumul + hist[level]<=k) cumul+=hist[level++];
+            CImg<T> arr(1,(unsigned int)hist[level]);
+            T *ptrd = arr._data;
+            cimg_for(*this,ptrs,T)
+              if (std::min((unsigned int)((*ptrs - vmin)*factor),nb_levels - 1)==level) *(ptrd++) = *ptrs;
+            return arr.kth_smallest(k - cumul);
+          }
+        }
+      }
       CImg<T> arr(*this,false);
       ulongT l = 0, ir = size() - 1;
       for ( ; ; ) {
@@ -29930,8 +30246,19 @@ namespace cimg_library_suffixed {
     CImg<T>& sort(CImg<t>& permutations, const bool is_increasing=true) {
       permutations.assign(_width,_height,_depth,_spectrum);
       if (is_empty()) return *this;
-      cimg_foroff(permutations,off) permutations[off] = (t)off;
-      return _quicksort(0,size() - 1,permutations,is_increasing,true);
+      if (_is_radix_sortable())
+        return sizeof(T)==4?_radix_sort<cimg_uint32>(&permutations,is_increasing):
+          _radix_sort<cimg_uint64>(&permutations,is_increasing);
+      const longT siz = (longT)size();
+      _sort_item *const items = new _sort_item[siz];
+      cimg_pragma_openmp(parallel for cimg_openmp_if_size(siz,1048576))
+      for (longT off = 0; off<siz; ++off) { items[off].value = _data[off]; items[off].index = (ulongT)off; }
+      if (is_increasing) _parallel_sort(items,siz,_sort_item_increasing());
+      else _parallel_sort(items,siz,_sort_item_decreasing());
+      cimg_pragma_openmp(parallel for cimg_openmp_if_size(siz,1048576))
+      for (longT off = 0; off<siz; ++off) { _data[off] = items[off].value; permutations[off] = (t)items[off].index; }
+      delete[] items;
+      return *this;
     }
 
     //! Sort pixel values and get sorting permutations \newinstance.
@@ -29955,31 +30282,49 @@ namespace cimg_library_suffixed {
       CImg<uintT> perm;
       switch (cimg::lowercase(axis)) {
       case 0 :
-        _quicksort(0,size() - 1,perm,is_increasing,false);
+        if (size()>=512 && _is_value_countable()) { // Counting sort
+          const longT tmin = (longT)cimg::type<T>::min();
+          const CImg<ulongT> counts = _get_value_counts();
+          T *ptrd = _data;
+          if (is_increasing) cimg_forX(counts,l) { std::fill(ptrd,ptrd + counts[l],(T)(l + tmin)); ptrd+=counts[l]; }
+          else cimg_rofX(counts,l) { std::fill(ptrd,ptrd + counts[l],(T)(l + tmin)); ptrd+=counts[l]; }
+        } else if (_is_radix_sortable()) {
+          if (sizeof(T)==4) _radix_sort<cimg_uint32>((CImg<uintT>*)0,is_increasing);
+          else _radix_sort<cimg_uint64>((CImg<uintT>*)0,is_increasing);
+        } else if (is_increasing) _parallel_sort(_data,size(),_sort_increasing());
+        else _parallel_sort(_data,size(),_sort_decreasing());
         break;
       case 'x' : {
         perm.assign(_width);
         get_crop(0,0,0,0,_width - 1,0,0,0).sort(perm,is_increasing);
         CImg<T> img(*this,false);
-        cimg_forXYZC(*this,x,y,z,c) (*this)(x,y,z,c) = img(perm[x],y,z,c);
+        cimg_pragma_openmp(parallel for cimg_openmp_collapse(3) cimg_openmp_if_size(size(),65536))
+        cimg_forYZC(*this,y,z,c) {
+          const T *const ptrs = img.data(0,y,z,c);
+          T *const ptrd = data(0,y,z,c);
+          cimg_forX(*this,x) ptrd[x] = ptrs[perm[x]];
+        }
       } break;
       case 'y' : {
         perm.assign(_height);
         get_crop(0,0,0,0,0,_height - 1,0,0).sort(perm,is_increasing);
         CImg<T> img(*this,false);
-        cimg_forXYZC(*this,x,y,z,c) (*this)(x,y,z,c) = img(x,perm[y],z,c);
+        cimg_pragma_openmp(parallel for cimg_openmp_collapse(3) cimg_openmp_if_size(size(),65536))
+        cimg_forYZC(*this,y,z,c) std::memcpy(data(0,y,z,c),img.data(0,perm[y],z,c),_width*sizeof(T));
       } break;
       case 'z' : {
         perm.assign(_depth);
         get_crop(0,0,0,0,0,0,_depth - 1,0).sort(perm,is_increasing);
         CImg<T> img(*this,false);
-        cimg_forXYZC(*this,x,y,z,c) (*this)(x,y,z,c) = img(x,y,perm[z],c);
+        cimg_pragma_openmp(parallel for cimg_openmp_collapse(2) cimg_openmp_if_size(size(),65536))
+        cimg_forZC(*this,z,c) std::memcpy(data(0,0,z,c),img.data(0,0,perm[z],c),(size_t)_width*_height*sizeof(T));
       } break;
       case 'c' : {
         perm.assign(_spectrum);
         get_crop(0,0,0,0,0,0,0,_spectrum - 1).sort(perm,is_increasing);
         CImg<T> img(*this,false);
-        cimg_forXYZC(*this,x,y,z,c) (*this)(x,y,z,c) = img(x,y,z,perm[c]);
+        cimg_pragma_openmp(parallel for cimg_openmp_if_size(size(),65536))
+        cimg_forC(*this,c) std::memcpy(data(0,0,0,c),img.data(0,0,0,perm[c]),(size_t)_width*_height*_depth*sizeof(T));
       } break;
       default :
         throw CImgArgumentException(_cimg_instance
@@ -29995,65 +30340,164 @@ namespace cimg_library_suffixed {
       return (+*this).sort(is_increasing,axis);
     }
 
-    template<typename t>
-    CImg<T>& _quicksort(const long indm, const long indM, CImg<t>& permutations,
-                        const bool is_increasing, const bool is_permutations) {
-      if (indm<indM) {
-        const long mid = (indm + indM)/2;
-        if (is_increasing) {
-          if ((*this)[indm]>(*this)[mid]) {
-            cimg::swap((*this)[indm],(*this)[mid]);
-            if (is_permutations) cimg::swap(permutations[indm],permutations[mid]);
-          }
-          if ((*this)[mid]>(*this)[indM]) {
-            cimg::swap((*this)[indM],(*this)[mid]);
-            if (is_permutations) cimg::swap(permutations[indM],permutations[mid]);
-          }
-          if ((*this)[indm]>(*this)[mid]) {
-            cimg::swap((*this)[indm],(*this)[mid]);
-            if (is_permutations) cimg::swap(permutations[indm],permutations[mid]);
-          }
-        } else {
-          if ((*this)[indm]<(*this)[mid]) {
-            cimg::swap((*this)[indm],(*this)[mid]);
-            if (is_permutations) cimg::swap(permutations[indm],permutations[mid]);
-          }
-          if ((*this)[mid]<(*this)[indM]) {
-            cimg::swap((*this)[indM],(*this)[mid]);
-            if (is_permutations) cimg::swap(permutations[indM],permutations[mid]);
-          }
-          if ((*this)[indm]<(*this)[mid]) {
-            cimg::swap((*this)[indm],(*this)[mid]);
-            if (is_permutations) cimg::swap(permutations[indm],permutations[mid]);
-          }
-        }
-        if (indM - indm>=3) {
-          const T pivot = (*this)[mid];
-          long i = indm, j = indM;
-          if (is_increasing) {
-            do {
-              while ((*this)[i]<pivot) ++i;
-              while ((*this)[j]>pivot) --j;
-              if (i<=j) {
-                if (is_permutations) cimg::swap(permutations[i],permutations[j]);
-                cimg::swap((*this)[i++],(*this)[j--]);
-              }
-            } while (i<=j);
-          } else {
-            do {
-              while ((*this)[i]>pivot) ++i;
-              while ((*this)[j]<pivot) --j;
-              if (i<=j) {
-                if (is_permutations) cimg::swap(permutations[i],permutations[j]);
-                cimg::swap((*this)[i++],(*this)[j--]);
-              }
-            } while (i<=j);
+    // Tell if pixel values can be sorted with '_radix_sort()' (32/64-bit integer or floating-point types).
+    // Small images (e.g. vectors sorted by the math parser) are faster to sort by comparison,
+    // as they do not need key buffers and digit histograms.
+    bool _is_radix_sortable() const {
+      return size()>=512 && (sizeof(T)==4 || sizeof(T)==8) && (cimg::type<T>::is_float() || (T)0.5==(T)0);
+    }
+
+    // Convert pixel value to an unsigned integer key with the same ordering (NaN values get the largest key).
+    template<typename tk>
+    static tk _radix_key(const T& val, const bool is_increasing) {
+      const tk sign = (tk)1<<(8*sizeof(tk) - 1);
+      tk key = 0;
+      std::memcpy(&key,&val,std::min(sizeof(T),sizeof(tk)));
+      if (cimg::type<T>::is_float()) {
+        if (cimg::type<T>::is_nan(val)) return ~(tk)0;
+        key = key&sign?~key:key|sign;
+      } else if (cimg::type<T>::min()<0) key^=sign;
+      return is_increasing?key:~key;
+    }
+
+    // Convert unsigned integer key back to pixel value.
+    template<typename tk>
+    static T _radix_value(const tk& _key, const bool is_increasing) {
+      const tk sign = (tk)1<<(8*sizeof(tk) - 1);
+      if (cimg::type<T>::is_float() && _key==~(tk)0) return (T)cimg::type<double>::nan();
+      tk key = is_increasing?_key:~_key;
+      if (cimg::type<T>::is_float()) key = key&sign?key&~sign:~key;
+      else if (cimg::type<T>::min()<0) key^=sign;
+      T val = 0;
+      std::memcpy(&val,&key,std::min(sizeof(T),sizeof(tk)));
+      return val;
+    }
+
+    // Sort pixel values (and permutations, if 'permutations' is non-null) with a LSD radix sort on 8-bit digits.
+    // Each pass counts digits and scatters values independently on one chunk per thread, and is stable.
+    template<typename tk, typename t>
+    CImg<T>& _radix_sort(CImg<t> *const permutations, const bool is_increasing) {
+      const ulongT siz = size();
+      unsigned int nb_chunks = 1;
+#if cimg_use_openmp!=0
+      if (siz>=(cimg_openmp_sizefactor)*65536) nb_chunks = (unsigned int)std::max(1,omp_get_max_threads());
+#endif
+      tk *const keys = new tk[2*siz], *src = keys, *dst = keys + siz;
+      ulongT
+        *const inds = permutations?new ulongT[2*siz]:0,
+        *isrc = inds, *idst = inds?inds + siz:0;
+      cimg_pragma_openmp(parallel for cimg_openmp_if_size(siz,1048576))
+      for (longT off = 0; off<(longT)siz; ++off) {
+        src[off] = _radix_key<tk>(_data[off],is_increasing);
+        if (isrc) isrc[off] = (ulongT)off;
+      }
+      CImg<ulongT> bounds(nb_chunks + 1), counts(256,nb_chunks);
+      cimg_forX(bounds,k) bounds[k] = siz*k/nb_chunks;
+      for (unsigned int shift = 0; shift<8*sizeof(tk); shift+=8) {
+        counts.fill(0);
+        cimg_pragma_openmp(parallel for cimg_openmp_if(nb_chunks>1))
+        for (int k = 0; k<(int)nb_chunks; ++k) {
+          ulongT *const ptrc = counts.data(0,k);
+          for (ulongT off = bounds[k]; off<bounds[k + 1]; ++off) ++ptrc[(src[off]>>shift)&255];
+        }
+        ulongT cumul = 0;
+        bool is_pass = true;
+        cimg_forX(counts,b) cimg_forY(counts,k) {
+          const ulongT count = counts(b,k);
+          if (count==siz) is_pass = false;
+          counts(b,k) = cumul; cumul+=count;
+        }
+        if (!is_pass) continue; // All keys have the same digit
+        cimg_pragma_openmp(parallel for cimg_openmp_if(nb_chunks>1))
+        for (int k = 0; k<(int)nb_chunks; ++k) {
+          ulongT *const ptrc = counts.data(0,k);
+          for (ulongT off = bounds[k]; off<bounds[k + 1]; ++off) {
+            const ulongT pos = ptrc[(src[off]>>shift)&255]++;
+            dst[pos] = src[off];
+            if (isrc) idst[pos] = isrc[off];
+          }
+        }
+        cimg::swap(src,dst);
+        cimg::swap(isrc,idst);
+      }
+      cimg_pragma_openmp(parallel for cimg_openmp_if_size(siz,1048576))
+      for (longT off = 0; off<(longT)siz; ++off) {
+        _data[off] = _radix_value<tk>(src[off],is_increasing);
+        if (isrc) (*permutations)[off] = (t)isrc[off];
+      }
+      delete[] keys;
+      delete[] inds;
+      return *this;
+    }
+
+    // Comparison functors used for sorting pixel values (NaN values are always sorted last).
+    struct _sort_increasing {
+      bool operator()(const T& a, const T& b) const { return a<b || (a==a && b!=b); }
+    };
+
+    struct _sort_decreasing {
+      bool operator()(const T& a, const T& b) const { return a>b || (a==a && b!=b); }
+    };
+
+    // Pixel value with its offset, and comparison functors, used for sorting with permutations.
+    struct _sort_item {
+      T value;
+      ulongT index;
+    };
+
+    struct _sort_item_increasing {
+      bool operator()(const _sort_item& a, const _sort_item& b) const {
+        return _sort_increasing()(a.value,b.value) || (!_sort_increasing()(b.value,a.value) && a.index<b.index);
+      }
+    };
+
+    struct _sort_item_decreasing {
+      bool operator()(const _sort_item& a, const _sort_item& b) const {
+        return _sort_decreasing()(a.value,b.value) || (!_sort_decreasing()(b.value,a.value) && a.index<b.index);
+      }
+    };
+
+    // Sort buffer 'ptr' of size 'siz' with comparison functor 'comp'.
+    // When several threads are available, one chunk per thread is sorted, then sorted chunks are merged
+    // pairwise, each merge being split into as many independent segments as there are chunks.
+    template<typename t, typename tc>
+    static void _parallel_sort(t *const ptr, const ulongT siz, const tc& comp) {
+      unsigned int nb_chunks = 1;
+#if cimg_use_openmp!=0
+      if (siz>=(cimg_openmp_sizefactor)*65536) nb_chunks = (unsigned int)std::max(1,omp_get_max_threads());
+#endif
+      if (nb_chunks<2) { std::sort(ptr,ptr + siz,comp); return; }
+      CImg<ulongT> bounds(nb_chunks + 1);
+      cimg_forX(bounds,k) bounds[k] = siz*k/nb_chunks;
+      cimg_pragma_openmp(parallel for)
+      for (int k = 0; k<(int)nb_chunks; ++k) std::sort(ptr + bounds[k],ptr + bounds[k + 1],comp);
+
+      t *const buf = new t[siz], *src = ptr, *dst = buf;
+      const int nb_segs = (int)nb_chunks;
+      for (unsigned int w = 1; w<nb_chunks; w*=2) {
+        const int nb_pairs = (int)((nb_chunks + 2*w - 1)/(2*w));
+        cimg_pragma_openmp(parallel for cimg_openmp_collapse(2))
+        for (int p = 0; p<nb_pairs; ++p) for (int s = 0; s<nb_segs; ++s) {
+            const ulongT
+              i0 = bounds[2*p*w],
+              i1 = bounds[std::min(2*p*w + w,nb_chunks)],
+              i2 = bounds[std::min(2*p*w + 2*w,nb_chunks)],
+              na = i1 - i0,
+              ia0 = i0 + na*s/nb_segs,
+              ia1 = i0 + na*(s + 1)/nb_segs;
+            if (!na) { if (!s) std::copy(src + i1,src + i2,dst + i0); continue; }
+            t
+              *const pb0 = s?std::lower_bound(src + i1,src + i2,src[ia0],comp):src + i1,
+              *const pb1 = s<nb_segs - 1?std::lower_bound(src + i1,src + i2,src[ia1],comp):src + i2;
+            std::merge(src + ia0,src + ia1,pb0,pb1,dst + ia0 + (pb0 - src - i1),comp);
           }
-          if (indm<j) _quicksort(indm,j,permutations,is_increasing,is_permutations);
-          if (i<indM) _quicksort(i,indM,permutations,is_increasing,is_permutations);
-        }
+        cimg::swap(src,dst);
       }
-      return *this;
+      if (src!=ptr) {
+        cimg_pragma_openmp(parallel for)
+        for (longT off = 0; off<(longT)siz; ++off) ptr[off] = src[off];
+      }
+      delete[] buf;
     }
 
     //! Compute the SVD of the instance image, viewed as a general matrix.
@@ -32570,13 +33014,56 @@ namespace cimg_library_suffixed {
         vmin = (double)(min_value<max_value?min_value:max_value),
         vmax = (double)(min_value<max_value?max_value:min_value);
       CImg<ulongT> res(nb_levels,1,1,1,0);
-      cimg_rof(*this,ptrs,T) {
-        const T val = *ptrs;
-        if (val>=vmin && val<=vmax) ++res[val==vmax?nb_levels - 1:(unsigned int)((val - vmin)*nb_levels/(vmax - vmin))];
+      if (_is_value_countable()) { // Count each possible value, then merge counts into histogram bins
+        const longT tmin = (longT)cimg::type<T>::min();
+        const CImg<ulongT> counts = _get_value_counts();
+        cimg_forX(counts,k) if (counts[k]) {
+          const double val = (double)(k + tmin);
+          if (val>=vmin && val<=vmax)
+            res[val==vmax?nb_levels - 1:(unsigned int)((val - vmin)*nb_levels/(vmax - vmin))]+=counts[k];
+        }
+        return res;
+      }
+      const double factor = nb_levels/(vmax - vmin);
+      cimg_pragma_openmp(parallel cimg_openmp_if(size()>=(cimg_openmp_sizefactor)*1048576 && nb_levels<=65536)) {
+        CImg<ulongT> _res;
+        ulongT *_ptrd = res._data;
+#if cimg_use_openmp!=0
+        if (omp_get_num_threads()>1) _ptrd = _res.assign(nb_levels,1,1,1,0)._data;
+#endif
+        cimg_pragma_openmp(for)
+        cimg_rofoff(*this,off) {
+          const T val = _data[off];
+          if (val>=vmin && val<=vmax)
+            ++_ptrd[val==vmax?nb_levels - 1:std::min((unsigned int)((val - vmin)*factor),nb_levels - 1)];
+        }
+        if (_res) { cimg_pragma_openmp(critical(get_histogram)) res+=_res; }
       }
       return res;
     }
 
+    // Tell if pixel values can be counted by direct indexing (8/16-bit integer types).
+    bool _is_value_countable() const {
+      return sizeof(T)<=2 && !cimg::type<T>::is_float() && (sizeof(T)==1 || size()>=65536);
+    }
+
+    // Return number of occurrences of each possible pixel value, indexed from 'cimg::type<T>::min()'.
+    CImg<ulongT> _get_value_counts() const {
+      const longT tmin = (longT)cimg::type<T>::min();
+      CImg<ulongT> counts((unsigned int)((longT)cimg::type<T>::max() - tmin + 1),1,1,1,0);
+      cimg_pragma_openmp(parallel cimg_openmp_if_size(size(),1048576)) {
+        CImg<ulongT> _counts;
+        ulongT *_ptrd = counts._data;
+#if cimg_use_openmp!=0
+        if (omp_get_num_threads()>1) _ptrd = _counts.assign(counts._width,1,1,1,0)._data;
+#endif
+        cimg_pragma_openmp(for)
+        cimg_rofoff(*this,off) ++_ptrd[(longT)_data[off] - tmin];
+        if (_counts) { cimg_pragma_openmp(critical(get_value_counts)) counts+=_counts; }
+      }
+      return counts;
+    }
+
     //! Compute the histogram of pixel values \newinstance.
     CImg<ulongT> get_histogram(const unsigned int nb_levels) const {
       if (!nb_levels || is_empty()) return CImg<ulongT>();
@@ -32607,9 +33094,10 @@ namespace cimg_library_suffixed {
       ulongT cumul = 0;
       cimg_forX(hist,pos) { cumul+=hist[pos]; hist[pos] = cumul; }
       if (!cumul) cumul = 1;
+      const double factor = (nb_levels - 1.)/(vmax - vmin);
       cimg_pragma_openmp(parallel for cimg_openmp_if_size(size(),1048576))
       cimg_rofoff(*this,off) {
-        const int pos = (int)((_data[off] - vmin)*(nb_levels - 1.)/(vmax - vmin));
+        const int pos = (int)((_data[off] - vmin)*factor);
         if (pos>=0 && pos<(int)nb_levels) _data[off] = (T)(vmin + (vmax - vmin)*hist[pos]/cumul);
       }
       return *this;
@@ -35782,52 +36270,14 @@ namespace cimg_library_suffixed {
         if (l>=4 || (c!='x' && c!='y' && c!='z' && c!='c')) { *s_code = 4; break; }
         else { ++n_code[c%=4]; s_code[l] = (unsigned char)c; }
       }
-      if (*axes_order && *s_code<4 && *n_code<=1 && n_code[1]<=1 && n_code[2]<=1 && n_code[3]<=1) {
-        const unsigned int code = (s_code[0]<<12) | (s_code[1]<<8) | (s_code[2]<<4) | (s_code[3]);
-        ulongT wh, whd;
+      if (*axes_order && *s_code<4 && *n_code<=1 && n_code[1]<=1 && n_code[2]<=1 && n_code[3]<=1 &&
+          ((1U<<s_code[0]) | (1U<<s_code[1]) | (1U<<s_code[2]) | (1U<<s_code[3]))==15) {
+        const unsigned int
+          code = (s_code[0]<<12) | (s_code[1]<<8) | (s_code[2]<<4) | (s_code[3]),
+          dims[4] = { _width,_height,_depth,_spectrum };
         switch (code) {
         case 0x0123 : // xyzc
           return +*this;
-        case 0x0132 : // xycz
-          res.assign(_width,_height,_spectrum,_depth);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(x,y,c,z,wh,whd) = (t)*(ptrs++);
-          break;
-        case 0x0213 : // xzyc
-          res.assign(_width,_depth,_height,_spectrum);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(x,z,y,c,wh,whd) = (t)*(ptrs++);
-          break;
-        case 0x0231 : // xzcy
-          res.assign(_width,_depth,_spectrum,_height);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(x,z,c,y,wh,whd) = (t)*(ptrs++);
-          break;
-        case 0x0312 : // xcyz
-          res.assign(_width,_spectrum,_height,_depth);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(x,c,y,z,wh,whd) = (t)*(ptrs++);
-          break;
-        case 0x0321 : // xczy
-          res.assign(_width,_spectrum,_depth,_height);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(x,c,z,y,wh,whd) = (t)*(ptrs++);
-          break;
-        case 0x1023 : // yxzc
-          res.assign(_height,_width,_depth,_spectrum);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(y,x,z,c,wh,whd) = (t)*(ptrs++);
-          break;
-        case 0x1032 : // yxcz
-          res.assign(_height,_width,_spectrum,_depth);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(y,x,c,z,wh,whd) = (t)*(ptrs++);
-          break;
-        case 0x1203 : // yzxc
-          res.assign(_height,_depth,_width,_spectrum);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(y,z,x,c,wh,whd) = (t)*(ptrs++);
-          break;
         case 0x1230 : // yzcx
           res.assign(_height,_depth,_spectrum,_width);
           switch (_width) {
@@ -35866,52 +36316,8 @@ namespace cimg_library_suffixed {
               ptrs+=4;
             }
           } break;
-          default : {
-            wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-            cimg_forXYZC(*this,x,y,z,c) res(y,z,c,x,wh,whd) = *(ptrs++);
-            return res;
-          }
           }
-          break;
-        case 0x1302 : // ycxz
-          res.assign(_height,_spectrum,_width,_depth);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(y,c,x,z,wh,whd) = (t)*(ptrs++);
-          break;
-        case 0x1320 : // yczx
-          res.assign(_height,_spectrum,_depth,_width);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(y,c,z,x,wh,whd) = (t)*(ptrs++);
-          break;
-        case 0x2013 : // zxyc
-          res.assign(_depth,_width,_height,_spectrum);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(z,x,y,c,wh,whd) = (t)*(ptrs++);
-          break;
-        case 0x2031 : // zxcy
-          res.assign(_depth,_width,_spectrum,_height);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(z,x,c,y,wh,whd) = (t)*(ptrs++);
-          break;
-        case 0x2103 : // zyxc
-          res.assign(_depth,_height,_width,_spectrum);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(z,y,x,c,wh,whd) = (t)*(ptrs++);
-          break;
-        case 0x2130 : // zycx
-          res.assign(_depth,_height,_spectrum,_width);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(z,y,c,x,wh,whd) = (t)*(ptrs++);
-          break;
-        case 0x2301 : // zcxy
-          res.assign(_depth,_spectrum,_width,_height);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(z,c,x,y,wh,whd) = (t)*(ptrs++);
-          break;
-        case 0x2310 : // zcyx
-          res.assign(_depth,_spectrum,_height,_width);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(z,c,y,x,wh,whd) = (t)*(ptrs++);
+          if (_width<=4) return res;
           break;
         case 0x3012 : // cxyz
           res.assign(_spectrum,_width,_height,_depth);
@@ -35951,38 +36357,19 @@ namespace cimg_library_suffixed {
               ptrd+=4;
             }
           } break;
-          default : {
-            wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-            cimg_forXYZC(*this,x,y,z,c) res(c,x,y,z,wh,whd) = (t)*(ptrs++);
           }
-          }
-          break;
-        case 0x3021 : // cxzy
-          res.assign(_spectrum,_width,_depth,_height);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(c,x,z,y,wh,whd) = (t)*(ptrs++);
-          break;
-        case 0x3102 : // cyxz
-          res.assign(_spectrum,_height,_width,_depth);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(c,y,x,z,wh,whd) = (t)*(ptrs++);
-          break;
-        case 0x3120 : // cyzx
-          res.assign(_spectrum,_height,_depth,_width);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(c,y,z,x,wh,whd) = (t)*(ptrs++);
-          break;
-        case 0x3201 : // czxy
-          res.assign(_spectrum,_depth,_width,_height);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(c,z,x,y,wh,whd) = (t)*(ptrs++);
-          break;
-        case 0x3210 : // czyx
-          res.assign(_spectrum,_depth,_height,_width);
-          wh = (ulongT)res._width*res._height; whd = wh*res._depth;
-          cimg_forXYZC(*this,x,y,z,c) res(c,z,y,x,wh,whd) = (t)*(ptrs++);
+          if (_spectrum<=4) return res;
           break;
         }
+
+        // Generic case: get destination offset increment for each source axis, then transpose.
+        res.assign(dims[s_code[0]],dims[s_code[1]],dims[s_code[2]],dims[s_code[3]]);
+        const ulongT
+          res_strides[4] = { 1,(ulongT)res._width,(ulongT)res._width*res._height,
+                             (ulongT)res._width*res._height*res._depth };
+        ulongT strides[4] = { 0 };
+        for (unsigned int l = 0; l<4; ++l) strides[s_code[l]] = res_strides[l];
+        _permute_axes(res._data,strides);
       }
       if (!res)
         throw CImgArgumentException(_cimg_instance
@@ -35992,6 +36379,44 @@ namespace cimg_library_suffixed {
       return res;
     }
 
+    // Copy image values to 'ptrd', with 'strides[k]' the destination offset increment along source axis 'k'.
+    // Use a cache-blocked transposition when the destination contiguous axis is not 'x'.
+    template<typename t>
+    void _permute_axes(t *const ptrd, const ulongT *const strides) const {
+      const unsigned int dims[4] = { _width,_height,_depth,_spectrum };
+      const ulongT sstrides[4] = { 1,(ulongT)_width,(ulongT)_width*_height,(ulongT)_width*_height*_depth };
+      if (strides[0]==1) { // Rows are kept contiguous
+        cimg_pragma_openmp(parallel for cimg_openmp_collapse(3) cimg_openmp_if_size(size(),1048576))
+        cimg_forYZC(*this,y,z,c) {
+          const T *const ptrs = data(0,y,z,c);
+          t *const _ptrd = ptrd + y*strides[1] + z*strides[2] + c*strides[3];
+          cimg_forX(*this,x) _ptrd[x] = (t)ptrs[x];
+        }
+        return;
+      }
+      unsigned int a = 1; // Source axis that becomes contiguous
+      while (strides[a]!=1) ++a;
+      const unsigned int p = a==1?2:1, q = a==3?2:3, bs = 32;
+      const int W = (int)_width, A = (int)dims[a], P = (int)dims[p], Q = (int)dims[q];
+      const ulongT sa = sstrides[a], dx = strides[0];
+      cimg_pragma_openmp(parallel for cimg_openmp_collapse(3) cimg_openmp_if_size(size(),1048576))
+      for (int iq = 0; iq<Q; ++iq)
+        for (int ip = 0; ip<P; ++ip)
+          for (int a0 = 0; a0<A; a0+=bs) {
+            const int a1 = std::min(a0 + (int)bs,A);
+            const T *const ptrs0 = _data + ip*sstrides[p] + iq*sstrides[q] + a0*sa;
+            t *const ptrd0 = ptrd + ip*strides[p] + iq*strides[q] + a0;
+            for (int x0 = 0; x0<W; x0+=bs) {
+              const int x1 = std::min(x0 + (int)bs,W);
+              for (int x = x0; x<x1; ++x) {
+                const T *ptrs = ptrs0 + x;
+                t *_ptrd = ptrd0 + x*dx;
+                for (int i = a0; i<a1; ++i) { *(_ptrd++) = (t)*ptrs; ptrs+=sa; }
+              }
+            }
+          }
+    }
+
     //! Unroll pixel values along specified axis.
     /**
        \param axis Unroll axis (can be \c 'x', \c 'y', \c 'z' or c 'c').
@@ -39228,6 +39653,168 @@ namespace cimg_library_suffixed {
       return CImg<Tlong>(*this,false).cumulate(axes);
     }
 
+    //! Compute integral image (summed-area table) of each channel.
+    /**
+       Value at (x,y,z,c) of the integral image is the sum of all pixel values of channel \p c
+       in the box [0,x]x[0,y]x[0,z]. Sums are computed with double precision.
+       \see integral_sum().
+    **/
+    CImg<T>& integral_image() {
+      return get_integral_image().move_to(*this);
+    }
+
+    //! Compute integral image (summed-area table) of each channel \newinstance.
+    CImg<Tdouble> get_integral_image() const {
+      if (is_empty()) return CImg<Tdouble>();
+      CImg<Tdouble> res(_width,_height,_depth,_spectrum);
+      cimg_pragma_openmp(parallel for cimg_openmp_collapse(3) cimg_openmp_if_size(size(),1048576))
+      cimg_forYZC(*this,y,z,c) {
+        const T *ptrs = data(0,y,z,c);
+        Tdouble *ptrd = res.data(0,y,z,c), cumul = 0;
+        cimg_forX(*this,x) *(ptrd++) = cumul+=*(ptrs++);
+      }
+      if (_height>1) {
+        cimg_pragma_openmp(parallel for cimg_openmp_collapse(2) cimg_openmp_if_size(size(),1048576))
+        cimg_forZC(res,z,c) for (int y = 1; y<height(); ++y) {
+          Tdouble *const ptrd = res.data(0,y,z,c);
+          const Tdouble *const ptrp = ptrd - _width;
+          cimg_forX(res,x) ptrd[x]+=ptrp[x];
+        }
+      }
+      if (_depth>1) {
+        const ulongT wh = (ulongT)_width*_height;
+        cimg_pragma_openmp(parallel for cimg_openmp_if_size(size(),1048576))
+        cimg_forC(res,c) for (int z = 1; z<depth(); ++z) {
+          Tdouble *const ptrd = res.data(0,0,z,c);
+          const Tdouble *const ptrp = ptrd - wh;
+          for (ulongT off = 0; off<wh; ++off) ptrd[off]+=ptrp[off];
+        }
+      }
+      return res;
+    }
+
+    //! Return sum of pixel values in a box, from an integral image.
+    /**
+       \param x0 X-coordinate of the box starting corner.
+       \param y0 Y-coordinate of the box starting corner.
+       \param z0 Z-coordinate of the box starting corner.
+       \param x1 X-coordinate of the box ending corner (included).
+       \param y1 Y-coordinate of the box ending corner (included).
+       \param z1 Z-coordinate of the box ending corner (included).
+       \param c Channel.
+       \note
+       - Instance image must be an integral image, as returned by get_integral_image().
+       - Box is clipped by the image domain. Sums of squares or products can be queried the same way
+         (from integral images of squared or multiplied images), giving local variances and covariances
+         in constant time.
+    **/
+    Tdouble integral_sum(const int x0, const int y0, const int z0,
+                         const int x1, const int y1, const int z1, const int c=0) const {
+      const int
+        nx0 = std::max(x0,0) - 1, ny0 = std::max(y0,0) - 1, nz0 = std::max(z0,0) - 1,
+        nx1 = std::min(x1,width() - 1), ny1 = std::min(y1,height() - 1), nz1 = std::min(z1,depth() - 1);
+      if (nx0>=nx1 || ny0>=ny1 || nz0>=nz1 || c<0 || c>=spectrum()) return 0;
+      const ulongT wh = (ulongT)_width*_height;
+      const T *const ptr1 = data(0,0,nz1,c), *const ptr0 = nz0>=0?ptr1 - (nz1 - nz0)*wh:0;
+      Tdouble res = 0;
+      for (unsigned int k = 0; k<2; ++k) {
+        const T *const ptr = k?ptr0:ptr1;
+        if (!ptr) break;
+        const T *const ptry1 = ptr + ny1*_width, *const ptry0 = ny0>=0?ptr + ny0*_width:0;
+        Tdouble val = (Tdouble)ptry1[nx1] - (nx0>=0?ptry1[nx0]:0);
+        if (ptry0) val-=(Tdouble)ptry0[nx1] - (nx0>=0?ptry0[nx0]:0);
+        res+=k?-val:val;
+      }
+      return res;
+    }
+
+    //! Compute integral images of the products of each pair of channels.
+    /**
+       Channel \c k of the resulting image is the integral image of the product of channels \c c0 and \c c1,
+       with \c c0<=c1, ordered as <tt>(0,0),(0,1),...,(0,s-1),(1,1),(1,2),...,(s-1,s-1)</tt>
+       (i.e. \c spectrum()*(spectrum() + 1)/2 channels).
+       Sums are computed with double precision.
+       \see get_integral_image(), integral_sum().
+    **/
+    CImg<Tdouble> get_integral_products() const {
+      if (is_empty()) return CImg<Tdouble>();
+      CImg<Tdouble> res(_width,_height,_depth,_spectrum*(_spectrum + 1)/2);
+      const ulongT whd = (ulongT)_width*_height*_depth;
+      for (int c0 = 0, k = 0; c0<spectrum(); ++c0) for (int c1 = c0; c1<spectrum(); ++c1, ++k) {
+          const T *const ptrs0 = data(0,0,0,c0), *const ptrs1 = data(0,0,0,c1);
+          Tdouble *const ptrd = res.data(0,0,0,k);
+          cimg_pragma_openmp(parallel for cimg_openmp_if_size(whd,1048576))
+          for (longT off = 0; off<(longT)whd; ++off) ptrd[off] = (Tdouble)ptrs0[off]*ptrs1[off];
+        }
+      return res.get_integral_image();
+    }
+
+    //! Compute local statistics over a box centered at each pixel.
+    /**
+       \param rx Box radius along the X-axis.
+       \param ry Box radius along the Y-axis.
+       \param rz Box radius along the Z-axis.
+       \param statistic Statistic to compute. Can be <tt>{ 0=sum | 1=mean | 2=variance | 3=covariance }</tt>.
+       
+ote
+       - Statistics are computed from integral images in double precision, in constant time per pixel
+         whatever the box size. Boxes are clipped by the image domain.
+       - For covariances, the resulting image has \c spectrum()*(spectrum() + 1)/2 channels, ordered as
+         in get_integral_products().
+    **/
+    CImg<T>& box_stats(const unsigned int rx, const unsigned int ry, const unsigned int rz,
+                       const unsigned int statistic=1) {
+      return get_box_stats(rx,ry,rz,statistic).move_to(*this);
+    }
+
+    //! Compute local statistics over a box centered at each pixel \newinstance.
+    CImg<Tdouble> get_box_stats(const unsigned int rx, const unsigned int ry, const unsigned int rz,
+                                const unsigned int statistic=1) const {
+      if (statistic>3)
+        throw CImgArgumentException(_cimg_instance
+                                    "box_stats(): Invalid specified statistic %u "
+                                    "(should be { 0=sum | 1=mean | 2=variance | 3=covariance }).",
+                                    cimg_instance,
+                                    statistic);
+      if (is_empty()) return CImg<Tdouble>();
+      const CImg<Tdouble>
+        integral = get_integral_image(),
+        integral_products = statistic>=2?get_integral_products():CImg<Tdouble>();
+      CImg<Tdouble> res(_width,_height,_depth,statistic==3?integral_products._spectrum:_spectrum);
+      cimg_pragma_openmp(parallel for cimg_openmp_collapse(3) cimg_openmp_if_size(size(),65536))
+      cimg_forXYZ(*this,x,y,z) {
+        const int
+          x0 = x - (int)rx, y0 = y - (int)ry, z0 = z - (int)rz,
+          x1 = x + (int)rx, y1 = y + (int)ry, z1 = z + (int)rz;
+        const double
+          n = (double)(std::min(x1,width() - 1) - std::max(x0,0) + 1)*
+          (std::min(y1,height() - 1) - std::max(y0,0) + 1)*
+          (std::min(z1,depth() - 1) - std::max(z0,0) + 1);
+        switch (statistic) {
+        case 0 : // Sum
+          cimg_forC(*this,c) res(x,y,z,c) = integral.integral_sum(x0,y0,z0,x1,y1,z1,c);
+          break;
+        case 1 : // Mean
+          cimg_forC(*this,c) res(x,y,z,c) = integral.integral_sum(x0,y0,z0,x1,y1,z1,c)/n;
+          break;
+        case 2 : // Variance
+          for (int c = 0, k = 0; c<spectrum(); k+=spectrum() - c, ++c) {
+            const Tdouble mean = integral.integral_sum(x0,y0,z0,x1,y1,z1,c)/n;
+            res(x,y,z,c) = std::max(0.,integral_products.integral_sum(x0,y0,z0,x1,y1,z1,k)/n - mean*mean);
+          }
+          break;
+        default : // Covariance
+          for (int c0 = 0, k = 0; c0<spectrum(); ++c0) {
+            const Tdouble mean0 = integral.integral_sum(x0,y0,z0,x1,y1,z1,c0)/n;
+            for (int c1 = c0; c1<spectrum(); ++c1, ++k)
+              res(x,y,z,k) = integral_products.integral_sum(x0,y0,z0,x1,y1,z1,k)/n -
+                mean0*integral.integral_sum(x0,y0,z0,x1,y1,z1,c1)/n;
+          }
+        }
+      }
+      return res;
+    }
+
     //! Erode image by a structuring element.
     /**
        \param kernel Structuring element.
@@ -40293,36 +40880,47 @@ namespace cimg_library_suffixed {
 
       coefp = (a0 + a1)/(1 + b1 + b2);
       coefn = (a2 + a3)/(1 + b1 + b2);
+      _cimg_abort_init_openmp;
+      cimg_abort_init;
       switch (naxis) {
       case 'x' : {
         const int N = width();
         const ulongT off = 1U;
         cimg_pragma_openmp(parallel for cimg_openmp_collapse(3) cimg_openmp_if(_width>=(cimg_openmp_sizefactor)*256 &&
                                                                    _height*_depth*_spectrum>=16))
-        cimg_forYZC(*this,y,z,c) { T *ptrX = data(0,y,z,c); _cimg_deriche_apply; }
+        cimg_forYZC(*this,y,z,c) _cimg_abort_try_openmp {
+          cimg_abort_test; T *ptrX = data(0,y,z,c); _cimg_deriche_apply;
+        } _cimg_abort_catch_openmp
       } break;
       case 'y' : {
         const int N = height();
         const ulongT off = (ulongT)_width;
         cimg_pragma_openmp(parallel for cimg_openmp_collapse(3) cimg_openmp_if(_width>=(cimg_openmp_sizefactor)*256 &&
                                                                    _height*_depth*_spectrum>=16))
-        cimg_forXZC(*this,x,z,c) { T *ptrX = data(x,0,z,c); _cimg_deriche_apply; }
+        cimg_forXZC(*this,x,z,c) _cimg_abort_try_openmp {
+          cimg_abort_test; T *ptrX = data(x,0,z,c); _cimg_deriche_apply;
+        } _cimg_abort_catch_openmp
       } break;
       case 'z' : {
         const int N = depth();
         const ulongT off = (ulongT)_width*_height;
         cimg_pragma_openmp(parallel for cimg_openmp_collapse(3) cimg_openmp_if(_width>=(cimg_openmp_sizefactor)*256 &&
                                                                    _height*_depth*_spectrum>=16))
-        cimg_forXYC(*this,x,y,c) { T *ptrX = data(x,y,0,c); _cimg_deriche_apply; }
+        cimg_forXYC(*this,x,y,c) _cimg_abort_try_openmp {
+          cimg_abort_test; T *ptrX = data(x,y,0,c); _cimg_deriche_apply;
+        } _cimg_abort_catch_openmp
       } break;
       default : {
         const int N = spectrum();
         const ulongT off = (ulongT)_width*_height*_depth;
         cimg_pragma_openmp(parallel for cimg_openmp_collapse(3) cimg_openmp_if(_width>=(cimg_openmp_sizefactor)*256 &&
                                                                    _height*_depth*_spectrum>=16))
-        cimg_forXYZ(*this,x,y,z) { T *ptrX = data(x,y,z,0); _cimg_deriche_apply; }
+        cimg_forXYZ(*this,x,y,z) _cimg_abort_try_openmp {
+          cimg_abort_test; T *ptrX = data(x,y,z,0); _cimg_deriche_apply;
+        } _cimg_abort_catch_openmp
       }
       }
+      cimg_abort_test;
       return *this;
     }
 
@@ -40559,34 +41157,45 @@ namespace cimg_library_suffixed {
         B = ( m0 * (m1sq + m2sq) ) / scale;
       double filter[4];
       filter[0] = B; filter[1] = -b1; filter[2] = -b2; filter[3] = -b3;
+      _cimg_abort_init_openmp;
+      cimg_abort_init;
       switch (naxis) {
       case 'x' : {
         cimg_pragma_openmp(parallel for cimg_openmp_collapse(3) cimg_openmp_if(_width>=(cimg_openmp_sizefactor)*256 &&
                                                                    _height*_depth*_spectrum>=16))
-        cimg_forYZC(*this,y,z,c)
+        cimg_forYZC(*this,y,z,c) _cimg_abort_try_openmp {
+          cimg_abort_test;
           _cimg_recursive_apply(data(0,y,z,c),filter,_width,1U,order,boundary_conditions);
+        } _cimg_abort_catch_openmp
       } break;
       case 'y' : {
         cimg_pragma_openmp(parallel for cimg_openmp_collapse(3) cimg_openmp_if(_width>=(cimg_openmp_sizefactor)*256 &&
                                                                    _height*_depth*_spectrum>=16))
-        cimg_forXZC(*this,x,z,c)
+        cimg_forXZC(*this,x,z,c) _cimg_abort_try_openmp {
+          cimg_abort_test;
           _cimg_recursive_apply(data(x,0,z,c),filter,_height,(ulongT)_width,order,boundary_conditions);
+        } _cimg_abort_catch_openmp
       } break;
       case 'z' : {
         cimg_pragma_openmp(parallel for cimg_openmp_collapse(3) cimg_openmp_if(_width>=(cimg_openmp_sizefactor)*256 &&
                                                                    _height*_depth*_spectrum>=16))
-        cimg_forXYC(*this,x,y,c)
+        cimg_forXYC(*this,x,y,c) _cimg_abort_try_openmp {
+          cimg_abort_test;
           _cimg_recursive_apply(data(x,y,0,c),filter,_depth,(ulongT)_width*_height,
                                 order,boundary_conditions);
+        } _cimg_abort_catch_openmp
       } break;
       default : {
         cimg_pragma_openmp(parallel for cimg_openmp_collapse(3) cimg_openmp_if(_width>=(cimg_openmp_sizefactor)*256 &&
                                                                    _height*_depth*_spectrum>=16))
-        cimg_forXYZ(*this,x,y,z)
+        cimg_forXYZ(*this,x,y,z) _cimg_abort_try_openmp {
+          cimg_abort_test;
           _cimg_recursive_apply(data(x,y,z,0),filter,_spectrum,(ulongT)_width*_height*_depth,
                                 order,boundary_conditions);
+        } _cimg_abort_catch_openmp
       }
       }
+      cimg_abort_test;
       return *this;
     }
 
@@ -41299,18 +41908,93 @@ namespace cimg_library_suffixed {
        \param nb_iter Number of filter iterations.
        \note
        - This is a recursive algorithm, not depending on the values of the box kernel size.
+       - For floating-point images with dirichlet or neumann boundary conditions, a single iteration
+         and odd integer box sizes, the filter is computed from integral images instead.
+         Results are identical to the recursive algorithm up to rounding errors.
        \see blur().
     **/
     CImg<T>& blur_box(const float boxsize_x, const float boxsize_y, const float boxsize_z,
                       const unsigned int boundary_conditions=1,
                       const unsigned int nb_iter=1) {
       if (is_empty()) return *this;
+      if (cimg::type<T>::is_float() && nb_iter==1 && boundary_conditions<=1) {
+        // Odd integer box sizes: compute all axes at once from integral images.
+        const unsigned int dims[] = { _width,_height,_depth };
+        const float boxsizes[] = { boxsize_x,boxsize_y,boxsize_z };
+        int radii[3] = { 0 };
+        bool is_integral = true;
+        for (unsigned int k = 0; k<3 && is_integral; ++k) {
+          const float boxsize = boxsizes[k]>=0?boxsizes[k]:-boxsizes[k]*dims[k]/100;
+          if (dims[k]>1 && boxsize>1) {
+            if (boxsize==(int)boxsize && ((int)boxsize)%2) radii[k] = ((int)boxsize - 1)/2;
+            else is_integral = false;
+          }
+        }
+        if (is_integral) return radii[0] || radii[1] || radii[2]?
+                           _blur_box_integral(radii[0],radii[1],radii[2],boundary_conditions):*this;
+      }
       if (_width>1) boxfilter(boxsize_x,0,'x',boundary_conditions,nb_iter);
       if (_height>1) boxfilter(boxsize_y,0,'y',boundary_conditions,nb_iter);
       if (_depth>1) boxfilter(boxsize_z,0,'z',boundary_conditions,nb_iter);
       return *this;
     }
 
+    // [internal] Apply box filter of radii 'rx','ry' and 'rz', with dirichlet or neumann boundary conditions,
+    // from the integral image of each channel (constant time per pixel, whatever the box size).
+    CImg<T>& _blur_box_integral(const int rx, const int ry, const int rz, const unsigned int boundary_conditions) {
+      const CImg<Tdouble> integral = get_integral_image();
+      const double norm = 1./((2.*rx + 1)*(2*ry + 1)*(2*rz + 1));
+      const int xi0 = std::min(rx + 1,width()), xi1 = std::max(width() - rx,xi0); // Range of inner X-coordinates
+      cimg_pragma_openmp(parallel cimg_openmp_if_size(size(),65536)) {
+        CImg<Tdouble> line(_width);
+        cimg_pragma_openmp(for cimg_openmp_collapse(3))
+        cimg_forYZC(*this,y,z,c) {
+          // Sum rows of the integral image needed for the YZ-ranges, weighted by their signs and weights.
+          int y0[3], y1[3], z0[3], z1[3];
+          double wy[3], wz[3];
+          const unsigned int
+            ny = _blur_box_integral_ranges(y,ry,height(),boundary_conditions,y0,y1,wy),
+            nz = _blur_box_integral_ranges(z,rz,depth(),boundary_conditions,z0,z1,wz);
+          line.fill(0);
+          for (unsigned int k = 0; k<nz; ++k) for (unsigned int j = 0; j<ny; ++j) {
+              const int rows_y[] = { y1[j],y0[j] - 1 }, rows_z[] = { z1[k],z0[k] - 1 };
+              for (unsigned int l = 0; l<4; ++l) {
+                const int ry_l = rows_y[l&1], rz_l = rows_z[l>>1];
+                if (ry_l<0 || rz_l<0) continue;
+                const double weight = ((l==1 || l==2)?-1:1)*wy[j]*wz[k];
+                const Tdouble *const ptrs = integral.data(0,ry_l,rz_l,c);
+                cimg_forX(line,x) line[x]+=weight*ptrs[x];
+              }
+            }
+          T *const ptrd = data(0,y,z,c);
+          for (int x = xi0; x<xi1; ++x) ptrd[x] = (T)((line[x + rx] - line[x - rx - 1])*norm);
+          for (int x = 0; x<width(); x = x==xi0 - 1?xi1:x + 1) { // Border X-coordinates
+            int x0[3], x1[3];
+            double wx[3];
+            const unsigned int nx = _blur_box_integral_ranges(x,rx,width(),boundary_conditions,x0,x1,wx);
+            Tdouble sum = 0;
+            for (unsigned int i = 0; i<nx; ++i) sum+=wx[i]*(line[x1[i]] - (x0[i]?line[x0[i] - 1]:0));
+            ptrd[x] = (T)(sum*norm);
+          }
+        }
+      }
+      return *this;
+    }
+
+    // [internal] Get ranges of coordinates, and their weights, covered by a box of radius 'r' centered at 'p'.
+    // With neumann boundary conditions, out-of-range coordinates are counted as the nearest border coordinate.
+    static unsigned int _blur_box_integral_ranges(const int p, const int r, const int N,
+                                                  const unsigned int boundary_conditions,
+                                                  int *const p0, int *const p1, double *const w) {
+      unsigned int n = 1;
+      p0[0] = std::max(p - r,0); p1[0] = std::min(p + r,N - 1); w[0] = 1;
+      if (boundary_conditions) {
+        if (p - r<0) { p0[n] = p1[n] = 0; w[n++] = r - p; }
+        if (p + r>=N) { p0[n] = p1[n] = N - 1; w[n++] = p + r - N + 1; }
+      }
+      return n;
+    }
+
     //! Blur image with a box filter \newinstance.
     CImg<Tfloat> get_blur_box(const float boxsize_x, const float boxsize_y, const float boxsize_z,
                               const unsigned int boundary_conditions=1) const {
@@ -42206,17 +42890,20 @@ namespace cimg_library_suffixed {
     CImg<Tfloat> get_structure_tensors(const bool is_fwbw_scheme=false) const {
       if (is_empty()) return *this;
       CImg<Tfloat> res;
+      _cimg_abort_init_openmp;
+      cimg_abort_init;
       if (_depth>1) { // 3D
         res.assign(_width,_height,_depth,6,0);
         if (!is_fwbw_scheme) { // Classical central finite differences
           cimg_pragma_openmp(parallel for cimg_openmp_if(_width*_height*_depth>=(cimg_openmp_sizefactor)*1048576 &&
                                                          _spectrum>=2))
-          cimg_forC(*this,c) {
+          cimg_forC(*this,c) _cimg_abort_try_openmp {
             Tfloat
               *ptrd0 = res.data(0,0,0,0), *ptrd1 = res.data(0,0,0,1), *ptrd2 = res.data(0,0,0,2),
               *ptrd3 = res.data(0,0,0,3), *ptrd4 = res.data(0,0,0,4), *ptrd5 = res.data(0,0,0,5);
             CImg_3x3x3(I,Tfloat);
             cimg_for3x3x3(*this,x,y,z,c,I,Tfloat) {
+              if (!x) { cimg_abort_test; }
               const Tfloat
                 ix = (Incc - Ipcc)/2,
                 iy = (Icnc - Icpc)/2,
@@ -42228,16 +42915,17 @@ namespace cimg_library_suffixed {
               cimg_pragma_openmp(atomic) *(ptrd4++)+=iy*iz;
               cimg_pragma_openmp(atomic) *(ptrd5++)+=iz*iz;
             }
-          }
+          } _cimg_abort_catch_openmp
         } else { // Forward/backward finite differences
           cimg_pragma_openmp(parallel for cimg_openmp_if(_width*_height*_depth>=(cimg_openmp_sizefactor)*1048576 &&
                                                          _spectrum>=2))
-          cimg_forC(*this,c) {
+          cimg_forC(*this,c) _cimg_abort_try_openmp {
             Tfloat
               *ptrd0 = res.data(0,0,0,0), *ptrd1 = res.data(0,0,0,1), *ptrd2 = res.data(0,0,0,2),
               *ptrd3 = res.data(0,0,0,3), *ptrd4 = res.data(0,0,0,4), *ptrd5 = res.data(0,0,0,5);
             CImg_3x3x3(I,Tfloat);
             cimg_for3x3x3(*this,x,y,z,c,I,Tfloat) {
+              if (!x) { cimg_abort_test; }
               const Tfloat
                 ixf = Incc - Iccc, ixb = Iccc - Ipcc, ixc = (Incc - Ipcc)/2,
                 iyf = Icnc - Iccc, iyb = Iccc - Icpc, iyc = (Icnc - Icpc)/2,
@@ -42249,17 +42937,18 @@ namespace cimg_library_suffixed {
               cimg_pragma_openmp(atomic) *(ptrd4++)+=iyc*izc;
               cimg_pragma_openmp(atomic) *(ptrd5++)+=(izf*izf + izb*izb)/2;
             }
-          }
+          } _cimg_abort_catch_openmp
         }
       } else { // 2D
         res.assign(_width,_height,_depth,3,0);
         if (!is_fwbw_scheme) { // Classical central finite differences
           cimg_pragma_openmp(parallel for cimg_openmp_if(_width*_height>=(cimg_openmp_sizefactor)*1048576 &&
                                                          _depth*_spectrum>=2))
-          cimg_forC(*this,c) {
+          cimg_forC(*this,c) _cimg_abort_try_openmp {
             Tfloat *ptrd0 = res.data(0,0,0,0), *ptrd1 = res.data(0,0,0,1), *ptrd2 = res.data(0,0,0,2);
             CImg_3x3(I,Tfloat);
             cimg_for3x3(*this,x,y,0,c,I,Tfloat) {
+              if (!x) { cimg_abort_test; }
               const Tfloat
                 ix = (Inc - Ipc)/2,
                 iy = (Icn - Icp)/2;
@@ -42267,14 +42956,15 @@ namespace cimg_library_suffixed {
               cimg_pragma_openmp(atomic) *(ptrd1++)+=ix*iy;
               cimg_pragma_openmp(atomic) *(ptrd2++)+=iy*iy;
             }
-          }
+          } _cimg_abort_catch_openmp
         } else { // Forward/backward finite differences (version 2)
           cimg_pragma_openmp(parallel for cimg_openmp_if(_width*_height>=(cimg_openmp_sizefactor)*1048576 &&
                                                          _depth*_spectrum>=2))
-          cimg_forC(*this,c) {
+          cimg_forC(*this,c) _cimg_abort_try_openmp {
             Tfloat *ptrd0 = res.data(0,0,0,0), *ptrd1 = res.data(0,0,0,1), *ptrd2 = res.data(0,0,0,2);
             CImg_3x3(I,Tfloat);
             cimg_for3x3(*this,x,y,0,c,I,Tfloat) {
+              if (!x) { cimg_abort_test; }
               const Tfloat
                 ixf = Inc - Icc, ixb = Icc - Ipc, ixc = (Inc - Ipc)/2,
                 iyf = Icn - Icc, iyb = Icc - Icp, iyc = (Icn - Icp)/2;
@@ -42282,9 +42972,10 @@ namespace cimg_library_suffixed {
               cimg_pragma_openmp(atomic) *(ptrd1++)+=ixc*iyc;
               cimg_pragma_openmp(atomic) *(ptrd2++)+=(iyf*iyf + iyb*iyb)/2;
             }
-          }
+          } _cimg_abort_catch_openmp
         }
       }
+      cimg_abort_test;
       return res;
     }
 
@@ -42303,13 +42994,16 @@ namespace cimg_library_suffixed {
         nsharpness = std::max(sharpness,1e-5f),
         power1 = (is_sqrt?0.5f:1)*nsharpness,
         power2 = power1/(1e-7f + 1 - anisotropy);
+      _cimg_abort_init_openmp;
+      cimg_abort_init;
       blur(alpha).normalize(0,(T)255);
 
       if (_depth>1) { // 3D
         get_structure_tensors().move_to(res).blur(sigma);
         cimg_pragma_openmp(parallel for cimg_openmp_collapse(2) cimg_openmp_if(_width>=(cimg_openmp_sizefactor)*256 &&
                                                                    _height*_depth>=(cimg_openmp_sizefactor)*256))
-        cimg_forYZ(*this,y,z) {
+        cimg_forYZ(*this,y,z) _cimg_abort_try_openmp {
+          cimg_abort_test;
           Tfloat
             *ptrd0 = res.data(0,y,z,0), *ptrd1 = res.data(0,y,z,1), *ptrd2 = res.data(0,y,z,2),
             *ptrd3 = res.data(0,y,z,3), *ptrd4 = res.data(0,y,z,4), *ptrd5 = res.data(0,y,z,5);
@@ -42331,12 +43025,13 @@ namespace cimg_library_suffixed {
             *(ptrd4++) = n1*(uy*uz + vy*vz) + n2*wy*wz;
             *(ptrd5++) = n1*(uz*uz + vz*vz) + n2*wz*wz;
           }
-        }
+        } _cimg_abort_catch_openmp
       } else { // for 2D images
         get_structure_tensors().move_to(res).blur(sigma);
         cimg_pragma_openmp(parallel for cimg_openmp_if(_width>=(cimg_openmp_sizefactor)*256 &&
                                                        _height>=(cimg_openmp_sizefactor)*256))
-        cimg_forY(*this,y) {
+        cimg_forY(*this,y) _cimg_abort_try_openmp {
+          cimg_abort_test;
           Tfloat *ptrd0 = res.data(0,y,0,0), *ptrd1 = res.data(0,y,0,1), *ptrd2 = res.data(0,y,0,2);
           CImg<floatT> val(2), vec(2,2);
           cimg_forX(*this,x) {
@@ -42352,8 +43047,9 @@ namespace cimg_library_suffixed {
             *(ptrd1++) = n1*ux*uy + n2*vx*vy;
             *(ptrd2++) = n1*uy*uy + n2*vy*vy;
           }
-        }
+        } _cimg_abort_catch_openmp
       }
+      cimg_abort_test;
       return res.move_to(*this);
     }
 
@@ -44845,10 +45541,10 @@ namespace cimg_library_suffixed {
       CImg<floatT> vertices;
       if ((size_x==-100 && size_y==-100) || (size_x==width() && size_y==height())) {
         const _functor2d_int func(*this);
-        vertices = isoline3d(primitives,func,isovalue,0,0,width() - 1.f,height() - 1.f,width(),height());
+        vertices = _isoline3d(primitives,func,isovalue,0,0,width() - 1.f,height() - 1.f,width(),height());
       } else {
         const _functor2d_float func(*this);
-        vertices = isoline3d(primitives,func,isovalue,0,0,width() - 1.f,height() - 1.f,size_x,size_y);
+        vertices = _isoline3d(primitives,func,isovalue,0,0,width() - 1.f,height() - 1.f,size_x,size_y);
       }
       return vertices;
     }
@@ -44896,36 +45592,41 @@ namespace cimg_library_suffixed {
     static void isoline3d(tv& add_vertex, tf& add_segment, const tfunc& func, const float isovalue,
                           const float x0, const float y0, const float x1, const float y1,
                           const int size_x, const int size_y) {
+      float dx = 0, dy = 0;
+      const CImg<floatT> Xs = _iso3d_coordinates(x0,x1,size_x,dx), Ys = _iso3d_coordinates(y0,y1,size_y,dy);
+      if (Xs._width<2 || Ys._width<2) return;
+      _isoline3d_slab(add_vertex,add_segment,func,isovalue,Xs,Ys,dx,dy,0,Ys._width - 1,0,0);
+    }
+
+    // Run the marching squares algorithm on rows [y_begin,y_end[ of the sampling grid (Xs,Ys).
+    // If non-null, 'first_line' and 'last_line' receive the indices of the vertices lying on horizontal edges
+    // of the first and last grid lines, so that the vertices shared by consecutive slabs can be welded.
+    template<typename tv, typename tf, typename tfunc>
+    static void _isoline3d_slab(tv& add_vertex, tf& add_segment, const tfunc& func, const float isovalue,
+                                const CImg<floatT>& Xs, const CImg<floatT>& Ys, const float dx, const float dy,
+                                const unsigned int y_begin, const unsigned int y_end,
+                                CImg<intT> *const first_line, CImg<intT> *const last_line) {
       static const unsigned int edges[16] = { 0x0, 0x9, 0x3, 0xa, 0x6, 0xf, 0x5, 0xc, 0xc,
                                               0x5, 0xf, 0x6, 0xa, 0x3, 0x9, 0x0 };
       static const int segments[16][4] = { { -1,-1,-1,-1 }, { 0,3,-1,-1 }, { 0,1,-1,-1 }, { 1,3,-1,-1 },
                                            { 1,2,-1,-1 },   { 0,1,2,3 },   { 0,2,-1,-1 }, { 2,3,-1,-1 },
                                            { 2,3,-1,-1 },   { 0,2,-1,-1},  { 0,3,1,2 },   { 1,2,-1,-1 },
                                            { 1,3,-1,-1 },   { 0,1,-1,-1},  { 0,3,-1,-1},  { -1,-1,-1,-1 } };
-      const unsigned int
-        _nx = (unsigned int)(size_x>=0?size_x:cimg::round((x1-x0)*-size_x/100 + 1)),
-        _ny = (unsigned int)(size_y>=0?size_y:cimg::round((y1-y0)*-size_y/100 + 1)),
-        nx = _nx?_nx:1,
-        ny = _ny?_ny:1,
-        nxm1 = nx - 1,
-        nym1 = ny - 1;
-
-      if (!nxm1 || !nym1) return;
-      const float dx = (x1 - x0)/nxm1, dy = (y1 - y0)/nym1;
+      const unsigned int nx = Xs._width, nxm1 = nx - 1;
       CImg<intT> indices1(nx,1,1,2,-1), indices2(nx,1,1,2);
       CImg<floatT> values1(nx), values2(nx);
-      float X = x0, Y = y0, nX = X + dx, nY = Y + dy;
       int nb_vertices = 0;
 
       // Fill first line with values
-      cimg_forX(values1,x) { values1(x) = (float)func(X,Y); X+=dx; }
+      cimg_forX(values1,x) values1(x) = (float)func(Xs[x],Ys[y_begin]);
 
       // Run the marching squares algorithm
-      for (unsigned int yi = 0, nyi = 1; yi<nym1; ++yi, ++nyi, Y=nY, nY+=dy) {
-        X = x0; nX = X + dx;
+      for (unsigned int yi = y_begin, nyi = yi + 1; yi<y_end; ++yi, ++nyi) {
+        const float Y = Ys[yi], nY = Ys[nyi];
         indices2.fill(-1);
-        values2(0) = (float)func(X,nY);
-        for (unsigned int xi = 0, nxi = 1; xi<nxm1; ++xi, ++nxi, X=nX, nX+=dx) {
+        values2(0) = (float)func(Xs[0],nY);
+        for (unsigned int xi = 0, nxi = 1; xi<nxm1; ++xi, ++nxi) {
+          const float X = Xs[xi], nX = Xs[nxi];
 
           // Determine square configuration
           const float
@@ -44971,9 +45672,11 @@ namespace cimg_library_suffixed {
             }
           }
         }
+        if (first_line && yi==y_begin) indices1.get_channel(0).move_to(*first_line);
         values1.swap(values2);
         indices1.swap(indices2);
       }
+      if (last_line) indices1.get_channel(0).move_to(*last_line);
     }
 
     //! Compute isolines of a function, as a 3D object \overloading.
@@ -44997,6 +45700,38 @@ namespace cimg_library_suffixed {
       return 0;
     }
 
+    // Compute isolines of a thread-safe function as a 3D object, running marching squares on one slab of rows
+    // per thread, then welding the vertices shared by consecutive slabs.
+    // Vertices and primitives are the same, and in the same order, as those returned by 'isoline3d()'.
+    template<typename tf, typename tfunc>
+    static CImg<floatT> _isoline3d(CImgList<tf>& primitives, const tfunc& func, const float isovalue,
+                                   const float x0, const float y0, const float x1, const float y1,
+                                   const int size_x, const int size_y) {
+      primitives.assign();
+      float dx = 0, dy = 0;
+      const CImg<floatT> Xs = _iso3d_coordinates(x0,x1,size_x,dx), Ys = _iso3d_coordinates(y0,y1,size_y,dy);
+      if (Xs._width<2 || Ys._width<2) return CImg<floatT>();
+      const unsigned int nym1 = Ys._width - 1;
+      unsigned int nb_slabs = 1;
+#if cimg_use_openmp!=0
+      if (Xs._width*Ys._width>=(cimg_openmp_sizefactor)*65536)
+        nb_slabs = std::min(nym1,(unsigned int)std::max(1,omp_get_max_threads()));
+#endif
+      CImgList<floatT> vertices(nb_slabs);
+      CImgList<intT> segments(nb_slabs), first_lines(nb_slabs), last_lines(nb_slabs);
+      cimg_pragma_openmp(parallel for cimg_openmp_if(nb_slabs>1))
+      for (int k = 0; k<(int)nb_slabs; ++k) {
+        typename CImg<floatT>::_functor_iso3d_buffer add_vertex(vertices[k]);
+        typename CImg<intT>::_functor_iso3d_buffer add_segment(segments[k]);
+        _isoline3d_slab(add_vertex,add_segment,func,isovalue,Xs,Ys,dx,dy,
+                        nym1*k/nb_slabs,nym1*(k + 1)/nb_slabs,
+                        k?&first_lines[k]:0,k<(int)nb_slabs - 1?&last_lines[k]:0);
+        add_vertex.end();
+        add_segment.end();
+      }
+      return _iso3d_weld(primitives,2,vertices,segments,first_lines,last_lines);
+    }
+
     //! Generate an isosurface of the image instance as a 3D object.
     /**
        \param[out] primitives The returned list of the 3D object primitives
@@ -45027,12 +45762,12 @@ namespace cimg_library_suffixed {
       CImg<floatT> vertices;
       if ((size_x==-100 && size_y==-100 && size_z==-100) || (size_x==width() && size_y==height() && size_z==depth())) {
         const _functor3d_int func(*this);
-        vertices = isosurface3d(primitives,func,isovalue,0,0,0,width() - 1.f,height() - 1.f,depth() - 1.f,
-                                width(),height(),depth());
+        vertices = _isosurface3d(primitives,func,isovalue,0,0,0,width() - 1.f,height() - 1.f,depth() - 1.f,
+                                 width(),height(),depth());
       } else {
         const _functor3d_float func(*this);
-        vertices = isosurface3d(primitives,func,isovalue,0,0,0,width() - 1.f,height() - 1.f,depth() - 1.f,
-                                size_x,size_y,size_z);
+        vertices = _isosurface3d(primitives,func,isovalue,0,0,0,width() - 1.f,height() - 1.f,depth() - 1.f,
+                                 size_x,size_y,size_z);
       }
       return vertices;
     }
@@ -45088,6 +45823,24 @@ namespace cimg_library_suffixed {
                              const float x0, const float y0, const float z0,
                              const float x1, const float y1, const float z1,
                              const int size_x, const int size_y, const int size_z) {
+      float dx = 0, dy = 0, dz = 0;
+      const CImg<floatT>
+        Xs = _iso3d_coordinates(x0,x1,size_x,dx),
+        Ys = _iso3d_coordinates(y0,y1,size_y,dy),
+        Zs = _iso3d_coordinates(z0,z1,size_z,dz);
+      if (Xs._width<2 || Ys._width<2 || Zs._width<2) return;
+      _isosurface3d_slab(add_vertex,add_triangle,func,isovalue,Xs,Ys,Zs,dx,dy,dz,0,Zs._width - 1,0,0);
+    }
+
+    // Run the marching cubes algorithm on planes [z_begin,z_end[ of the sampling grid (Xs,Ys,Zs).
+    // If non-null, 'first_plane' and 'last_plane' receive the indices of the vertices lying on X and Y edges
+    // of the first and last grid planes, so that the vertices shared by consecutive slabs can be welded.
+    template<typename tv, typename tf, typename tfunc>
+    static void _isosurface3d_slab(tv& add_vertex, tf& add_triangle, const tfunc& func, const float isovalue,
+                                   const CImg<floatT>& Xs, const CImg<floatT>& Ys, const CImg<floatT>& Zs,
+                                   const float dx, const float dy, const float dz,
+                                   const unsigned int z_begin, const unsigned int z_end,
+                                   CImg<intT> *const first_plane, CImg<intT> *const last_plane) {
       static const unsigned int edges[256] = {
         0x000, 0x109, 0x203, 0x30a, 0x406, 0x50f, 0x605, 0x70c, 0x80c, 0x905, 0xa0f, 0xb06, 0xc0a, 0xd03, 0xe09, 0xf00,
         0x190, 0x99 , 0x393, 0x29a, 0x596, 0x49f, 0x795, 0x69c, 0x99c, 0x895, 0xb9f, 0xa96, 0xd9a, 0xc93, 0xf99, 0xe90,
@@ -45366,43 +46119,26 @@ namespace cimg_library_suffixed {
         { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 }
       };
 
-      const unsigned int
-        _nx = (unsigned int)(size_x>=0?size_x:cimg::round((x1-x0)*-size_x/100 + 1)),
-        _ny = (unsigned int)(size_y>=0?size_y:cimg::round((y1-y0)*-size_y/100 + 1)),
-        _nz = (unsigned int)(size_z>=0?size_z:cimg::round((z1-z0)*-size_z/100 + 1)),
-        nx = _nx?_nx:1,
-        ny = _ny?_ny:1,
-        nz = _nz?_nz:1,
-        nxm1 = nx - 1,
-        nym1 = ny - 1,
-        nzm1 = nz - 1;
-      if (!nxm1 || !nym1 || !nzm1) return;
-      const float dx = (x1 - x0)/nxm1, dy = (y1 - y0)/nym1, dz = (z1 - z0)/nzm1;
+      const unsigned int nx = Xs._width, ny = Ys._width, nxm1 = nx - 1, nym1 = ny - 1;
       CImg<intT> indices1(nx,ny,1,3,-1), indices2(indices1);
       CImg<floatT> values1(nx,ny), values2(nx,ny);
-      float X = 0, Y = 0, Z = 0, nX = 0, nY = 0, nZ = 0;
       int nb_vertices = 0;
 
       // Fill the first plane with function values
-      Y = y0;
-      cimg_forY(values1,y) {
-        X = x0;
-        cimg_forX(values1,x) { values1(x,y) = (float)func(X,Y,z0); X+=dx; }
-        Y+=dy;
-      }
+      cimg_forXY(values1,x,y) values1(x,y) = (float)func(Xs[x],Ys[y],Zs[z_begin]);
 
       // Run Marching Cubes algorithm
-      Z = z0; nZ = Z + dz;
-      for (unsigned int zi = 0; zi<nzm1; ++zi, Z = nZ, nZ+=dz) {
-        Y = y0; nY = Y + dy;
+      for (unsigned int zi = z_begin; zi<z_end; ++zi) {
+        const float Z = Zs[zi], nZ = Zs[zi + 1];
         indices2.fill(-1);
-        X = x0; for (unsigned int xi = 0; xi<nx; ++xi) { values2(xi,0) = (float)func(X,Y,nZ); X += dx; }
+        cimg_forX(values2,xi) values2(xi,0) = (float)func(Xs[xi],Ys[0],nZ);
 
-        for (unsigned int yi = 0, nyi = 1; yi<nym1; ++yi, ++nyi, Y = nY, nY+=dy) {
-          X = x0; nX = X + dx;
-          values2(0,nyi) = (float)func(X,nY,nZ);
+        for (unsigned int yi = 0, nyi = 1; yi<nym1; ++yi, ++nyi) {
+          const float Y = Ys[yi], nY = Ys[nyi];
+          values2(0,nyi) = (float)func(Xs[0],nY,nZ);
 
-          for (unsigned int xi = 0, nxi = 1; xi<nxm1; ++xi, ++nxi, X = nX, nX+=dx) {
+          for (unsigned int xi = 0, nxi = 1; xi<nxm1; ++xi, ++nxi) {
+            const float X = Xs[xi], nX = Xs[nxi];
 
             // Determine cube configuration
             const float
@@ -45498,9 +46234,11 @@ namespace cimg_library_suffixed {
             }
           }
         }
+        if (first_plane && zi==z_begin) indices1.get_channels(0,1).move_to(*first_plane);
         cimg::swap(values1,values2);
         cimg::swap(indices1,indices2);
       }
+      if (last_plane) indices1.get_channels(0,1).move_to(*last_plane);
     }
 
     //! Compute isosurface of a function, as a 3D object \overloading.
@@ -45534,6 +46272,118 @@ namespace cimg_library_suffixed {
       return 0;
     }
 
+    // Compute isosurface of a thread-safe function as a 3D object, running marching cubes on one slab of planes
+    // per thread, then welding the vertices shared by consecutive slabs.
+    // Vertices and primitives are the same, and in the same order, as those returned by 'isosurface3d()'.
+    template<typename tf, typename tfunc>
+    static CImg<floatT> _isosurface3d(CImgList<tf>& primitives, const tfunc& func, const float isovalue,
+                                      const float x0, const float y0, const float z0,
+                                      const float x1, const float y1, const float z1,
+                                      const int size_x, const int size_y, const int size_z) {
+      primitives.assign();
+      float dx = 0, dy = 0, dz = 0;
+      const CImg<floatT>
+        Xs = _iso3d_coordinates(x0,x1,size_x,dx),
+        Ys = _iso3d_coordinates(y0,y1,size_y,dy),
+        Zs = _iso3d_coordinates(z0,z1,size_z,dz);
+      if (Xs._width<2 || Ys._width<2 || Zs._width<2) return CImg<floatT>();
+      const unsigned int nzm1 = Zs._width - 1;
+      unsigned int nb_slabs = 1;
+#if cimg_use_openmp!=0
+      if ((ulongT)Xs._width*Ys._width*Zs._width>=(cimg_openmp_sizefactor)*65536)
+        nb_slabs = std::min(nzm1,(unsigned int)std::max(1,omp_get_max_threads()));
+#endif
+      CImgList<floatT> vertices(nb_slabs);
+      CImgList<intT> triangles(nb_slabs), first_planes(nb_slabs), last_planes(nb_slabs);
+      cimg_pragma_openmp(parallel for cimg_openmp_if(nb_slabs>1))
+      for (int k = 0; k<(int)nb_slabs; ++k) {
+        typename CImg<floatT>::_functor_iso3d_buffer add_vertex(vertices[k]);
+        typename CImg<intT>::_functor_iso3d_buffer add_triangle(triangles[k]);
+        _isosurface3d_slab(add_vertex,add_triangle,func,isovalue,Xs,Ys,Zs,dx,dy,dz,
+                           nzm1*k/nb_slabs,nzm1*(k + 1)/nb_slabs,
+                           k?&first_planes[k]:0,k<(int)nb_slabs - 1?&last_planes[k]:0);
+        add_vertex.end();
+        add_triangle.end();
+      }
+      return _iso3d_weld(primitives,3,vertices,triangles,first_planes,last_planes);
+    }
+
+    // Return the sampling coordinates of a marching squares/cubes grid along one axis.
+    static CImg<floatT> _iso3d_coordinates(const float x0, const float x1, const int size, float &delta) {
+      const unsigned int
+        _n = (unsigned int)(size>=0?size:cimg::round((x1 - x0)*-size/100 + 1)),
+        n = _n?_n:1;
+      CImg<floatT> res(n);
+      delta = n>1?(x1 - x0)/(n - 1):0;
+      float X = x0;
+      cimg_forX(res,x) { res[x] = X; X+=delta; }
+      return res;
+    }
+
+    // Merge the vertices and primitives extracted on consecutive slabs into a single 3D object.
+    // Vertices of a slab listed in its first plane (or line) are replaced by the corresponding vertices of
+    // the last plane of the previous slab.
+    template<typename tf>
+    static CImg<floatT> _iso3d_weld(CImgList<tf>& primitives, const unsigned int primitive_size,
+                                    const CImgList<floatT>& vertices, const CImgList<intT>& faces,
+                                    const CImgList<intT>& first_planes, const CImgList<intT>& last_planes) {
+      const unsigned int nb_slabs = vertices._width;
+      CImgList<intT> remaps(nb_slabs);
+      CImg<ulongT> offsets_vertices(nb_slabs + 1,1,1,1,0), offsets_primitives(nb_slabs + 1,1,1,1,0);
+
+      // Flag welded vertices and index the other ones locally.
+      cimg_pragma_openmp(parallel for cimg_openmp_if(nb_slabs>1))
+      for (int k = 0; k<(int)nb_slabs; ++k) {
+        CImg<intT> &remap = remaps[k].assign(vertices[k]._width/3,1,1,1,0);
+        cimg_for(first_planes[k],ptr,intT) if (*ptr>=0) remap[*ptr] = -1;
+        int nb_vertices = 0;
+        cimg_for(remap,ptr,intT) if (*ptr>=0) *ptr = nb_vertices++;
+        offsets_vertices[k + 1] = (ulongT)nb_vertices;
+        offsets_primitives[k + 1] = (ulongT)faces[k]._width/primitive_size;
+      }
+      for (unsigned int k = 0; k<nb_slabs; ++k) {
+        offsets_vertices[k + 1]+=offsets_vertices[k];
+        offsets_primitives[k + 1]+=offsets_primitives[k];
+      }
+      if (!offsets_vertices[nb_slabs]) return CImg<floatT>();
+
+      // Copy unique vertices.
+      CImg<floatT> res((unsigned int)offsets_vertices[nb_slabs],3);
+      cimg_pragma_openmp(parallel for cimg_openmp_if(nb_slabs>1))
+      for (int k = 0; k<(int)nb_slabs; ++k) {
+        CImg<intT> &remap = remaps[k];
+        const floatT *ptrs = vertices[k]._data;
+        const int offset = (int)offsets_vertices[k];
+        cimg_for(remap,ptr,intT) {
+          if (*ptr>=0) {
+            *ptr+=offset;
+            res(*ptr,0) = ptrs[0]; res(*ptr,1) = ptrs[1]; res(*ptr,2) = ptrs[2];
+          }
+          ptrs+=3;
+        }
+      }
+
+      // Resolve welded vertices (in slab order, as the last plane of a slab may itself be welded).
+      for (unsigned int k = 1; k<nb_slabs; ++k) {
+        const CImg<intT> &first_plane = first_planes[k], &last_plane = last_planes[k - 1], &prev_remap = remaps[k - 1];
+        CImg<intT> &remap = remaps[k];
+        cimg_foroff(first_plane,off) if (first_plane[off]>=0) remap[first_plane[off]] = prev_remap[last_plane[off]];
+      }
+
+      // Copy primitives.
+      primitives.assign((unsigned int)offsets_primitives[nb_slabs],1,primitive_size);
+      cimg_pragma_openmp(parallel for cimg_openmp_if(nb_slabs>1))
+      for (int k = 0; k<(int)nb_slabs; ++k) {
+        const CImg<intT> &remap = remaps[k];
+        const intT *ptrs = faces[k]._data;
+        for (ulongT l = offsets_primitives[k]; l<offsets_primitives[k + 1]; ++l) {
+          tf *ptrd = primitives[l]._data;
+          for (unsigned int i = 0; i<primitive_size; ++i) *(ptrd++) = (tf)remap[*(ptrs++)];
+        }
+      }
+      return res;
+    }
+
     // Define functors for accessing image values (used in previous functions).
     struct _functor2d_int {
       const CImg<T>& ref;
@@ -45613,6 +46463,25 @@ namespace cimg_library_suffixed {
       void operator()(const t x, const t y, const t z) { CImg<T>::vector((T)x,(T)y,(T)z).move_to(list); }
     };
 
+    struct _functor_iso3d_buffer {
+      CImg<T>& buffer;
+      unsigned int siz;
+      _functor_iso3d_buffer(CImg<T>& _buffer):buffer(_buffer),siz(0) { buffer.assign(); }
+      void reserve(const unsigned int n) {
+        if (siz + n<=buffer._width) return;
+        CImg<T> nbuffer(std::max(1024U,2*buffer._width));
+        if (siz) std::memcpy(nbuffer._data,buffer._data,siz*sizeof(T));
+        nbuffer.move_to(buffer);
+      }
+      template<typename t>
+      void operator()(const t x, const t y, const t z) {
+        reserve(3); buffer[siz++] = (T)x; buffer[siz++] = (T)y; buffer[siz++] = (T)z;
+      }
+      template<typename t>
+      void operator()(const t i, const t j) { reserve(2); buffer[siz++] = (T)i; buffer[siz++] = (T)j; }
+      void end() { if (!siz) buffer.assign(); else if (siz<buffer._width) buffer.crop(0,siz - 1); }
+    };
+
     //! Compute 3D elevation of a function as a 3D object.
     /**
        \param[out] primitives Primitives data of the resulting 3D object.
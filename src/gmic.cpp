@@ -421,6 +421,306 @@ CImg<T> get_gmic_autocrop(const CImg<T>& color=CImg<T>::empty()) {
   return (+*this).gmic_autocrop(color);
 }
 
+// Return index of a blending mode handled by 'gmic_blend()', or -1 if mode must be managed by the stdlib.
+// Set 'is_rgb' for modes that mix the R,G,B channels of background and foreground.
+static int gmic_blend_mode(const char *const name, bool &is_rgb) {
+  static const char *const names[] = {
+    "add","alpha","and","average","blue","burn","darken","difference","divide","dodge","exclusion","freeze",
+    "grainextract","grainmerge","green","hardlight","hardmix","interpolation","lighten","linearburn","linearlight",
+    "multiply","negation","normal","or","overlay","pinlight","red","reflect","screen","softburn","softdodge",
+    "softlight","stamp","subtract","vividlight","xor" };
+  is_rgb = false;
+  if (!*name) return 1;
+  for (unsigned int i = 0; i<sizeof(names)/sizeof(char*); ++i) if (!std::strcmp(name,names[i])) {
+      is_rgb = i==4 || i==14 || i==27;
+      return (int)i;
+    }
+  return -1;
+}
+
+// Select 'a' or 'b' from boolean 'm', as the stdlib does with a masked 'draw_image()'
+// (so that non-finite values in the unselected operand propagate the same way).
+static T _gmic_blend_mask(const bool m, const T a, const T b) {
+  const float fm = (float)m;
+  return (T)(fm*a + b*(1 - fm));
+}
+
+// Compute blending mode 'mode' between background row 'pb' and foreground row 'pf' (channel 'c').
+// Operations are done in the same order and precision as the corresponding '_blend_*' stdlib commands, so that
+// results are the same. Mode is tested once per row, to get loops that can be vectorized.
+static void _gmic_blend_row(const unsigned int mode, const unsigned int c,
+                            const T *const pb, const T *const pf, T *const pm, const unsigned int n) {
+  const T t0 = (T)0, t255 = (T)255;
+  switch (mode) {
+  case 0 : // Add
+    for (unsigned int x = 0; x<n; ++x) pm[x] = cimg::cut((T)(pf[x] + pb[x]),t0,t255);
+    break;
+  case 1 : case 23 : // Alpha, normal
+    std::memcpy(pm,pf,n*sizeof(T));
+    break;
+  case 2 : // And
+    for (unsigned int x = 0; x<n; ++x) pm[x] = (T)((longT)pf[x] & (longT)pb[x]);
+    break;
+  case 3 : // Average
+    for (unsigned int x = 0; x<n; ++x) pm[x] = (T)((T)(pf[x] + pb[x])/(Tfloat)2);
+    break;
+  case 4 : // Blue
+    std::memcpy(pm,c==2?pf:pb,n*sizeof(T));
+    break;
+  case 5 : // Burn
+    for (unsigned int x = 0; x<n; ++x) {
+      const T u = (T)((T)(pb[x] - (Tfloat)255)/(T)(pf[x] + (Tfloat)0.1));
+      pm[x] = cimg::cut((T)((T)(u + (Tfloat)1)*(Tfloat)255),t0,t255);
+    }
+    break;
+  case 6 : // Darken
+    for (unsigned int x = 0; x<n; ++x) pm[x] = std::min(pb[x],pf[x]);
+    break;
+  case 7 : // Difference
+    for (unsigned int x = 0; x<n; ++x) pm[x] = cimg::abs((T)(pf[x] - pb[x]));
+    break;
+  case 8 : // Divide
+    for (unsigned int x = 0; x<n; ++x) {
+      const T u = (T)(1/(Tfloat)(T)(pf[x] + (Tfloat)0.1));
+      pm[x] = cimg::cut((T)((T)(u*pb[x])*(Tfloat)255),t0,t255);
+    }
+    break;
+  case 9 : // Dodge
+    for (unsigned int x = 0; x<n; ++x) {
+      const T u = (T)(1/(Tfloat)(T)(pf[x] - (Tfloat)255.1));
+      pm[x] = cimg::cut((T)((T)(u*pb[x])*(Tfloat)-255),t0,t255);
+    }
+    break;
+  case 10 : // Exclusion
+    for (unsigned int x = 0; x<n; ++x)
+      pm[x] = (T)((T)(pf[x] + (T)((T)(pb[x]*pf[x])/(Tfloat)-127.5)) + pb[x]);
+    break;
+  case 11 : // Freeze
+    for (unsigned int x = 0; x<n; ++x) {
+      const T
+        u = (T)((T)(pf[x]*(Tfloat)-255) - (Tfloat)0.1),
+        v = (T)(pb[x] - (Tfloat)255),
+        w = (T)((T)(v*v)/u);
+      pm[x] = cimg::cut((T)((T)(w + (Tfloat)1)*(Tfloat)255),t0,t255);
+    }
+    break;
+  case 12 : // Grain extract
+    for (unsigned int x = 0; x<n; ++x)
+      pm[x] = cimg::cut((T)((T)((T)(pf[x] - pb[x])*(Tfloat)-1) + (Tfloat)128),t0,t255);
+    break;
+  case 13 : // Grain merge
+    for (unsigned int x = 0; x<n; ++x) pm[x] = cimg::cut((T)((T)(pf[x] + pb[x]) - (Tfloat)128),t0,t255);
+    break;
+  case 14 : // Green
+    std::memcpy(pm,c==1?pf:pb,n*sizeof(T));
+    break;
+  case 15 : // Hard light
+    for (unsigned int x = 0; x<n; ++x) {
+      const T
+        p = (T)((T)(pb[x]*pf[x])/(Tfloat)127.5),
+        q = (T)((T)((T)((T)(pb[x] + pf[x])*(Tfloat)2) - (Tfloat)255) - p);
+      pm[x] = cimg::cut(_gmic_blend_mask(pf[x]>(T)128,q,p),t0,t255);
+    }
+    break;
+  case 16 : // Hard mix
+    for (unsigned int x = 0; x<n; ++x) pm[x] = (T)((T)((T)(pf[x] + pb[x])>=t255)*(Tfloat)255);
+    break;
+  case 17 : { // Interpolation
+    const Tfloat k = (Tfloat)(cimg::PI/255);
+    for (unsigned int x = 0; x<n; ++x) {
+      const T
+        p = (T)std::cos((typename cimg::superset<T,float>::type)(T)(pb[x]*k)),
+        u = (T)std::cos((typename cimg::superset<T,float>::type)(T)(pf[x]*k));
+      pm[x] = cimg::cut((T)((T)((T)(u + p) - (Tfloat)2)*(Tfloat)-63.75),t0,t255);
+    }
+  } break;
+  case 18 : // Lighten
+    for (unsigned int x = 0; x<n; ++x) pm[x] = std::max(pb[x],pf[x]);
+    break;
+  case 19 : // Linear burn
+    for (unsigned int x = 0; x<n; ++x) pm[x] = cimg::cut((T)((T)(pf[x] + pb[x]) - (Tfloat)255),t0,t255);
+    break;
+  case 20 : // Linear light
+    for (unsigned int x = 0; x<n; ++x)
+      pm[x] = cimg::cut((T)((T)((T)(pf[x]*(Tfloat)2) + pb[x]) - (Tfloat)255),t0,t255);
+    break;
+  case 21 : // Multiply
+    for (unsigned int x = 0; x<n; ++x) pm[x] = (T)((T)(pf[x]*pb[x])/(Tfloat)255);
+    break;
+  case 22 : // Negation
+    for (unsigned int x = 0; x<n; ++x)
+      pm[x] = (T)((T)(cimg::abs((T)((T)(pf[x] + pb[x]) - (Tfloat)255))*(Tfloat)-1) + (Tfloat)255);
+    break;
+  case 24 : // Or
+    for (unsigned int x = 0; x<n; ++x) pm[x] = (T)((longT)pf[x] | (longT)pb[x]);
+    break;
+  case 25 : // Overlay
+    for (unsigned int x = 0; x<n; ++x) {
+      const T
+        p = (T)((T)(pb[x]*pf[x])/(Tfloat)127.5),
+        u = (T)((T)((T)((T)(pf[x] + pb[x])*(Tfloat)2) - (Tfloat)255) - p);
+      pm[x] = cimg::cut(_gmic_blend_mask(pb[x]<(T)128,p,u),t0,t255);
+    }
+    break;
+  case 26 : // Pin light
+    for (unsigned int x = 0; x<n; ++x) {
+      const T u = (T)(pf[x]*(Tfloat)2), v = (T)(u - (Tfloat)256);
+      pm[x] = _gmic_blend_mask(v>=t0,std::max(pb[x],v),std::min(pb[x],u));
+    }
+    break;
+  case 27 : // Red
+    std::memcpy(pm,c==0?pf:pb,n*sizeof(T));
+    break;
+  case 28 : // Reflect
+    for (unsigned int x = 0; x<n; ++x) {
+      const T u = (T)((T)(pf[x] - (Tfloat)255.1)*(Tfloat)-1);
+      pm[x] = cimg::cut((T)((T)(pb[x]*pb[x])/u),t0,t255);
+    }
+    break;
+  case 29 : // Screen
+    for (unsigned int x = 0; x<n; ++x) {
+      const T u = (T)((T)(pf[x] - (Tfloat)255)*(T)(pb[x] - (Tfloat)255));
+      pm[x] = (T)((T)((T)(u/(Tfloat)255)*(Tfloat)-1) + (Tfloat)255);
+    }
+    break;
+  case 30 : case 31 : { // Soft burn, soft dodge
+    const T *const pu = mode==30?pb:pf, *const pv = mode==30?pf:pb;
+    for (unsigned int x = 0; x<n; ++x) {
+      const T
+        p = (T)((T)((T)(1/(Tfloat)(T)(pu[x] - (Tfloat)255.1))*pv[x])*(Tfloat)-127.5),
+        q = (T)((T)((T)((T)(pu[x] - (Tfloat)255)/(T)(pv[x] + (Tfloat)0.1))*(Tfloat)127.5) + (Tfloat)255);
+      pm[x] = cimg::cut(_gmic_blend_mask((T)(pf[x] + pb[x])>t255,q,p),t0,t255);
+    }
+  } break;
+  case 32 : // Soft light
+    for (unsigned int x = 0; x<n; ++x) {
+      const T
+        p = (T)(pb[x]/(Tfloat)255), u = (T)(pf[x]/(Tfloat)255), s = (T)(p*p),
+        r = (T)((T)((T)((T)(u*s)*(Tfloat)-2) + (T)((T)(p*u)*(Tfloat)2)) + s);
+      pm[x] = cimg::cut((T)(r*(Tfloat)255),t0,t255);
+    }
+    break;
+  case 33 : // Stamp
+    for (unsigned int x = 0; x<n; ++x)
+      pm[x] = cimg::cut((T)((T)((T)(pf[x]*(Tfloat)2) + pb[x]) - (Tfloat)255),t0,t255);
+    break;
+  case 34 : // Subtract
+    for (unsigned int x = 0; x<n; ++x) pm[x] = cimg::cut((T)((T)(pf[x] - pb[x])*(Tfloat)-1),t0,t255);
+    break;
+  case 35 : // Vivid light
+    for (unsigned int x = 0; x<n; ++x) {
+      const T
+        u = (T)(pf[x]*(Tfloat)2), v = (T)(u - (Tfloat)256),
+        p = (T)((T)(pb[x] - (Tfloat)255)/(T)(u + (Tfloat)0.1)),
+        q = (T)(1/(Tfloat)(T)(v - (Tfloat)255.1));
+      pm[x] = _gmic_blend_mask(v>=t0,cimg::cut((T)((T)(q*pb[x])*(Tfloat)-255),t0,t255),
+                               cimg::cut((T)((T)(p + (Tfloat)1)*(Tfloat)255),t0,t255));
+    }
+    break;
+  default : // Xor
+    for (unsigned int x = 0; x<n; ++x) pm[x] = (T)((longT)pf[x] ^ (longT)pb[x]);
+  }
+}
+
+// Blend image with specified layer, using the mode index returned by 'gmic_blend_mode()'.
+// Same as command 'blend' of the stdlib: the foreground is centered on the background, colors are converted to
+// the richest color mode of both (G or RGB), and alpha channels (with 'opacity') are used for compositing.
+// Everything is computed in a single pass over the rows of the background, without intermediate images.
+CImg<T>& gmic_blend(const CImg<T>& layer, const unsigned int mode, const float opacity,
+                    const bool is_layer_background) {
+  return get_gmic_blend(layer,mode,opacity,is_layer_background).move_to(*this);
+}
+
+CImg<T> get_gmic_blend(const CImg<T>& layer, const unsigned int mode, const float opacity,
+                       const bool is_layer_background) const {
+  if (!opacity) return +*this;
+  const CImg<T>
+    &back = is_layer_background?layer:*this,
+    &fore = is_layer_background?*this:layer;
+  if (!back || !fore || back._spectrum>4 || fore._spectrum>4)
+    throw CImgArgumentException(_cimg_instance
+                                "gmic_blend(): Specified background (%u,%u,%u,%u) and foreground (%u,%u,%u,%u) "
+                                "are not G,GA,RGB or RGBA images.",
+                                cimg_instance,
+                                back._width,back._height,back._depth,back._spectrum,
+                                fore._width,fore._height,fore._depth,fore._spectrum);
+  const unsigned int
+    sb = back._spectrum, sf = fore._spectrum, W = back._width,
+    nb = std::max(sb,sf)>=3?3:1;
+  const bool
+    is_alpha_b = !(sb%2),
+    is_alpha_f = !(sf%2) || fore._width<back._width || fore._height<back._height || fore._depth<back._depth ||
+      opacity!=1;
+  const int
+    xc = (int)(0.5f*(back.width() - fore.width())),
+    yc = (int)(0.5f*(back.height() - fore.height())),
+    zc = (int)(0.5f*(back.depth() - fore.depth())),
+    x0 = std::max(0,xc), x1 = std::min(back.width(),xc + fore.width());
+  const Tfloat fopacity = (Tfloat)opacity;
+  CImg<T> res(W,back._height,back._depth,nb + (is_alpha_b?1:0));
+
+  cimg_pragma_openmp(parallel cimg_openmp_if_size(res.size(),65536)) {
+    CImg<T> rows(W,2*nb + 1); // Foreground colors (nb), foreground alpha, blending result (nb)
+    T *const pfa = rows.data(0,nb);
+    cimg_pragma_openmp(for cimg_openmp_collapse(2))
+    cimg_forYZ(res,y,z) {
+      const int yf = y - yc, zf = z - zc;
+      const bool is_inside = x0<x1 && yf>=0 && yf<fore.height() && zf>=0 && zf<fore.depth();
+
+      // Get foreground row, set to 0 outside the foreground.
+      std::memset(rows._data,0,W*(nb + 1)*sizeof(T));
+      if (is_inside) {
+        for (unsigned int c = 0; c<nb; ++c)
+          std::memcpy(rows.data(x0,c),fore.data(x0 - xc,yf,zf,sf>=3?c:0),(x1 - x0)*sizeof(T));
+        if (is_alpha_f) {
+          T *const ptrd = pfa + x0;
+          const unsigned int n = x1 - x0;
+          if (!(sf%2)) std::memcpy(ptrd,fore.data(x0 - xc,yf,zf,sf - 1),n*sizeof(T));
+          else for (unsigned int x = 0; x<n; ++x) ptrd[x] = (T)255;
+          if (opacity<1) for (unsigned int x = 0; x<n; ++x) ptrd[x] = (T)(ptrd[x]*fopacity);
+        }
+      }
+
+      // Apply blending mode and composite result.
+      const T *const pba = is_alpha_b?back.data(0,y,z,sb - 1):0;
+      for (unsigned int c = 0; c<nb; ++c) {
+        const T *const pb = back.data(0,y,z,sb>=3?c:0);
+        T *const pm = rows.data(0,nb + 1 + c), *const ptrd = res.data(0,y,z,c);
+        _gmic_blend_row(mode,c,pb,rows.data(0,c),pm,W);
+        if (is_alpha_f) {
+          if (is_alpha_b) for (unsigned int x = 0; x<W; ++x) {
+              const float
+                mopacity = (float)pfa[x], nopacity = cimg::abs(mopacity),
+                copacity = 255 - std::max(mopacity,0.f);
+              const T
+                vb = (T)((T)(pb[x]*pba[x])/(Tfloat)255),
+                va = (T)((nopacity*255 + pba[x]*copacity)/255),
+                vc = (T)((nopacity*pm[x] + vb*copacity)/255);
+              ptrd[x] = (T)(vc/(T)(std::max(va,(T)1)/(Tfloat)255));
+            }
+          else for (unsigned int x = 0; x<W; ++x) {
+              const float
+                mopacity = (float)pfa[x], nopacity = cimg::abs(mopacity),
+                copacity = 255 - std::max(mopacity,0.f);
+              ptrd[x] = (T)((nopacity*pm[x] + pb[x]*copacity)/255);
+            }
+        } else std::memcpy(ptrd,pm,W*sizeof(T));
+      }
+
+      // Set resulting alpha channel.
+      if (is_alpha_b) {
+        T *const ptrd = res.data(0,y,z,nb);
+        if (is_alpha_f) for (unsigned int x = 0; x<W; ++x) {
+            const float mopacity = (float)pfa[x];
+            ptrd[x] = (T)((cimg::abs(mopacity)*255 + pba[x]*(255 - std::max(mopacity,0.f)))/255);
+          }
+        else for (unsigned int x = 0; x<W; ++x) ptrd[x] = (T)255;
+      }
+    }
+  }
+  return res;
+}
+
 CImg<T>& gmic_blur(const float sigma_x, const float sigma_y, const float sigma_z, const float sigma_c,
                    const unsigned int boundary_conditions, const bool is_gaussian) {
   if (is_empty()) return *this;
@@ -447,9 +747,12 @@ CImg<T>& gmic_blur_box(const float sigma_x, const float sigma_y, const float sig
                        const unsigned int order, const unsigned int boundary_conditions,
                        const unsigned int nb_iter) {
   if (is_empty()) return *this;
-  if (_width>1) boxfilter(sigma_x,order,'x',boundary_conditions,nb_iter);
-  if (_height>1) boxfilter(sigma_y,order,'y',boundary_conditions,nb_iter);
-  if (_depth>1) boxfilter(sigma_z,order,'z',boundary_conditions,nb_iter);
+  if (!order) blur_box(sigma_x,sigma_y,sigma_z,boundary_conditions,nb_iter);
+  else {
+    if (_width>1) boxfilter(sigma_x,order,'x',boundary_conditions,nb_iter);
+    if (_height>1) boxfilter(sigma_y,order,'y',boundary_conditions,nb_iter);
+    if (_depth>1) boxfilter(sigma_z,order,'z',boundary_conditions,nb_iter);
+  }
   if (_spectrum>1) boxfilter(sigma_c,order,'c',boundary_conditions,nb_iter);
   return *this;
 }
@@ -527,6 +830,29 @@ CImg<T> get_gmic_draw_text(const float x, const float y,
   return (+*this).gmic_draw_text(x,y,sepx,sepy,text,col,bg,opacity,siz,nb_cols);
 }
 
+// Return a 64-bit hash of the image geometry and pixel values, starting from specified seed.
+// Data are read as four independent 64-bit lanes, so that the main loop can be vectorized.
+cimg_uint64 gmic_hash(const cimg_uint64 seed=0) const {
+  const cimg_uint64 p1 = 0x9E3779B185EBCA87ULL, p2 = 0xC2B2AE3D27D4EB4FULL, p3 = 0x165667B19E3779F9ULL;
+  const ulongT siz = size()*sizeof(T);
+  const unsigned char *ptrs = (const unsigned char*)_data, *const ptre = ptrs + siz;
+  cimg_uint64 lanes[4] = { seed + p1 + p2, seed + p2, seed, seed - p1 }, words[4], res;
+  for ( ; ptrs + sizeof(words)<=ptre; ptrs+=sizeof(words)) {
+    std::memcpy(words,ptrs,sizeof(words));
+    for (unsigned int k = 0; k<4; ++k) {
+      const cimg_uint64 lane = lanes[k] + words[k]*p2;
+      lanes[k] = ((lane<<31)|(lane>>33))*p1;
+    }
+  }
+  res = ((lanes[0]<<1)|(lanes[0]>>63)) + ((lanes[1]<<7)|(lanes[1]>>57)) +
+    ((lanes[2]<<12)|(lanes[2]>>52)) + ((lanes[3]<<18)|(lanes[3]>>46));
+  const cimg_uint64 dims[5] = { _width, _height, _depth, _spectrum, sizeof(T) };
+  for (unsigned int k = 0; k<5; ++k) { res^=dims[k]*p1; res = ((res<<27)|(res>>37))*p2 + p3; }
+  for ( ; ptrs<ptre; ++ptrs) { res^=*ptrs*p3; res = ((res<<11)|(res>>53))*p1; }
+  res^=res>>33; res*=p2; res^=res>>29; res*=p3; res^=res>>32;
+  return res;
+}
+
 CImg<T>& gmic_invert_endianness(const char *const stype) {
 
 #define _gmic_invert_endianness(svalue_type,value_type) \
@@ -1743,22 +2069,21 @@ CImg<T>& rotate_CImg3d(const CImg<t>& rot) {
                                 "rotate_CImg3d(): image instance is not a CImg3d (%s).",
                                 cimg_instance,error_message.data());
   const unsigned int nbv = cimg::float2uint((float)(*this)[6]);
-  const T *ptrs = data() + 8;
   const float
     a = (float)rot(0,0), b = (float)rot(1,0), c = (float)rot(2,0),
     d = (float)rot(0,1), e = (float)rot(1,1), f = (float)rot(2,1),
     g = (float)rot(0,2), h = (float)rot(1,2), i = (float)rot(2,2);
-  T *ptrd = data() + 8;
-  for (unsigned int j = 0; j<nbv; ++j) {
+  T *const ptrv = data() + 8;
+  cimg_pragma_openmp(parallel for cimg_openmp_if_size(nbv,65536))
+  for (int j = 0; j<(int)nbv; ++j) {
+    T *const ptrd = ptrv + 3*j;
     const float
-      x = (float)ptrs[0],
-      y = (float)ptrs[1],
-      z = (float)ptrs[2];
-    ptrs+=3;
+      x = (float)ptrd[0],
+      y = (float)ptrd[1],
+      z = (float)ptrd[2];
     ptrd[0] = (T)(a*x + b*y + c*z);
     ptrd[1] = (T)(d*x + e*y + f*z);
     ptrd[2] = (T)(g*x + h*y + i*z);
-    ptrd+=3;
   }
   return *this;
 }
@@ -1775,8 +2100,12 @@ CImg<T>& scale_CImg3d(const float sx, const float sy, const float sz) {
                                 "scale_CImg3d(): image instance is not a CImg3d (%s).",
                                 cimg_instance,error_message.data());
   const unsigned int nbv = cimg::float2uint((float)(*this)[6]);
-  T *ptrd = data() + 8;
-  for (unsigned int j = 0; j<nbv; ++j) { *(ptrd++)*=(T)sx; *(ptrd++)*=(T)sy; *(ptrd++)*=(T)sz; }
+  T *const ptrv = data() + 8;
+  cimg_pragma_openmp(parallel for cimg_openmp_if_size(nbv,65536))
+  for (int j = 0; j<(int)nbv; ++j) {
+    T *const ptrd = ptrv + 3*j;
+    ptrd[0]*=(T)sx; ptrd[1]*=(T)sy; ptrd[2]*=(T)sz;
+  }
   return *this;
 }
 
@@ -1791,8 +2120,12 @@ CImg<T>& shift_CImg3d(const float tx, const float ty, const float tz) {
                                 "shift_CImg3d(): image instance is not a CImg3d (%s).",
                                 cimg_instance,error_message.data());
   const unsigned int nbv = cimg::float2uint((float)(*this)[6]);
-  T *ptrd = data() + 8;
-  for (unsigned int j = 0; j<nbv; ++j) { *(ptrd++)+=(T)tx; *(ptrd++)+=(T)ty; *(ptrd++)+=(T)tz; }
+  T *const ptrv = data() + 8;
+  cimg_pragma_openmp(parallel for cimg_openmp_if_size(nbv,65536))
+  for (int j = 0; j<(int)nbv; ++j) {
+    T *const ptrd = ptrv + 3*j;
+    ptrd[0]+=(T)tx; ptrd[1]+=(T)ty; ptrd[2]+=(T)tz;
+  }
   return *this;
 }
 
@@ -1902,6 +2235,25 @@ static const CImgList<T>& save_gmz(const char *filename, const CImgList<T>& imag
   return images;
 }
 
+static CImgList<T> get_load_gmz(const char *filename, CImgList<charT>& names) {
+  CImgList<T> images = CImgList<T>::get_load_cimg(filename);
+  names.assign();
+  const CImg<T> back = images?images.back():CImg<T>::empty();
+  if (back._width==1 && back._height>=4 && back._depth==1 && back._spectrum==1 &&
+      back[0]=='G' && back[1]=='M' && back[2]=='Z' && !back[3]) {
+    for (unsigned int p = 4; p<back._height; ) { // Retrieve list of image names
+      unsigned int np = p;
+      while (np<back._height && back[np]) ++np;
+      if (np<back._height) CImg<charT>(back.data(p),++np - p).move_to(names);
+      p = np;
+    }
+    images.remove();
+  }
+  if (names.size()>images.size()) names.remove(images.size(),names.size() - 1);
+  else if (names.size()<images.size()) names.insert(images.size() - names.size(),CImg<charT>::string("[unnamed]"));
+  return images;
+}
+
 //--------------- End of CImg<T> plug-in ----------------------------
 
 // Add G'MIC-specific methods to the CImgList<T> class of the CImg library.
@@ -2068,6 +2420,9 @@ using namespace cimg_library;
 #ifndef gmic_winslots
 #define gmic_winslots 10
 #endif
+#ifndef gmic_cacheslots
+#define gmic_cacheslots 64 // Number of slots for caching parsed selections and command lines (must be a power of 2)
+#endif
 
 // Macro to force stringifying selection for error messages.
 #define gmic_selection_err selection2string(selection,images_names,1,gmic_selection)
@@ -2102,7 +2457,7 @@ void gmic::_gmic_substitute_args(const char *const argument, const char *const a
 #define gmic_substitute_args(is_image_expr) { \
   const char *const argument0 = argument; \
   if (is_subst_arg) { \
-    substitute_item(argument,images,images_names,parent_images,parent_images_names,variables_sizes,\
+    substitute_item(argument,images,images_names,parent_images,parent_images_names,variables_scope,\
                     command_selection,is_image_expr).move_to(_argument); \
     argument = _argument; \
   } \
@@ -2304,37 +2659,53 @@ double gmic_round(const double x) {
   return y;
 }
 
-// Manage list of all gmic runs.
-inline gmic_list<void*>& gmic_runs() { static gmic_list<void*> val; return val; }
+// Manage context of the gmic runs.
+// Each call to '_run()' defines a run context (stored on its stack), and chains it to the
+// context of the enclosing run of the same thread. Math parsers capture the current context
+// of the thread that constructs them (see 'cimg_mp_context'), so that their callbacks
+// retrieve it directly, without any global list or lock.
+// Context layout: [0]=gmic instance, [1]=images, [2]=images_names, [3]=parent_images,
+// [4]=parent_images_names, [5]=variables_scope, [6]=command_selection, [7]=enclosing context.
+void **&gmic::current_run() {
+  static thread_local void **p_run = 0;
+  return p_run;
+}
 
-const CImg<void*> get_current_run(const char *const func_name, void *const p_list) {
-  cimg::mutex(24);
-  CImgList<void*> &grl = gmic_runs();
-  int p;
-  for (p = grl.width() - 1; p>=0; --p) {
-    CImg<void*> &gr = grl[p];
-    if (gr[1]==(void*)p_list) break;
+struct _gmic_run_context {
+  void *data[8];
+  _gmic_run_context(void *const p_gmic, void *const p_images, void *const p_images_names,
+                    void *const p_parent_images, void *const p_parent_images_names,
+                    const void *const variables_scope, const void *const command_selection) {
+    data[0] = p_gmic; data[1] = p_images; data[2] = p_images_names;
+    data[3] = p_parent_images; data[4] = p_parent_images_names;
+    data[5] = (void*)variables_scope; data[6] = (void*)command_selection;
+    data[7] = (void*)gmic::current_run();
+    gmic::current_run() = data;
   }
-  const CImg<void*> gr = grl[p].get_shared(); // Return shared image
-  cimg::mutex(24,0);
-  if (p<0) // Instance not found!
+  ~_gmic_run_context() {
+    gmic::current_run() = (void**)data[7];
+  }
+};
+
+void *const *get_current_run(const char *const func_name, void *const p_run) {
+  if (!p_run) // Math parser has not been constructed from a G'MIC run
     throw CImgArgumentException("[" cimg_appname "_math_parser] CImg<>: Function '%s': "
                                 "Cannot determine instance of the G'MIC interpreter.",
                                 func_name);
-  return gr;
+  return (void *const *)p_run;
 }
 
-double gmic::mp_dollar(const char *const str, void *const p_list) {
+double gmic::mp_dollar(const char *const str, void *const p_run) {
   if (!(CImg<>::_cimg_math_parser::is_varname(str) ||
         ((*str=='>' || *str=='<' || *str=='!' || *str=='^' || *str=='|') && !str[1])))
     throw CImgArgumentException("[" cimg_appname "_math_parser] CImg<>: Operator '$': "
                                 "Invalid variable name '%s'.",
                                 str);
 
-  const CImg<void*> gr = get_current_run("Operator '$'",p_list);
+  void *const *const gr = get_current_run("Operator '$'",p_run);
   gmic &gmic_instance = *(gmic*)gr[0];
   CImgList<char> &images_names = *(CImgList<char>*)gr[2];
-  const unsigned int *const variables_sizes = (const unsigned int*)gr[5];
+  const unsigned int *const variables_scope = (const unsigned int*)gr[5];
   double res = cimg::type<double>::nan();
 
   switch (*str) {
@@ -2380,7 +2751,7 @@ double gmic::mp_dollar(const char *const str, void *const p_list) {
     res = (cimg::time() - gmic_instance.reference_time)/1000.;
     break;
   default : {
-    CImg<char> value = gmic_instance.get_variable(str,variables_sizes,&images_names);
+    CImg<char> value = gmic_instance.get_variable(str,variables_scope,&images_names);
     if (value && *value) {
       char end;
       if (std::sscanf(value,"%lf%c",&res,&end)!=1) res = 0;
@@ -2392,17 +2763,17 @@ double gmic::mp_dollar(const char *const str, void *const p_list) {
 
 template<typename T>
 double gmic::mp_get(double *const ptrd, const unsigned int siz, const bool to_string, const char *const str,
-                    void *const p_list, const T& pixel_type) {
+                    void *const p_run, const T& pixel_type) {
   cimg::unused(pixel_type);
-  const CImg<void*> gr = get_current_run("Function 'get()'",p_list);
+  void *const *const gr = get_current_run("Function 'get()'",p_run);
   gmic &gmic_instance = *(gmic*)gr[0];
   CImgList<char>& images_names = *(CImgList<char>*)gr[2];
-  const unsigned int *const variables_sizes = (const unsigned int*)gr[5];
+  const unsigned int *const variables_scope = (const unsigned int*)gr[5];
   CImg<char> _varname(256);
   char *const varname = _varname.data(), end;
 
   if (cimg_sscanf(str,"%255[a-zA-Z0-9_]%c",&(*varname=0),&end)==1 && (*varname<'0' || *varname>'9')) {
-    CImg<char> value = gmic_instance.get_variable(varname,variables_sizes,&images_names);
+    CImg<char> value = gmic_instance.get_variable(varname,variables_scope,&images_names);
     if (!value) { // Undefined variable
       if (!siz) *ptrd = cimg::type<double>::nan();
       else for (unsigned int i = 0; i<siz; ++i) ptrd[i] = cimg::type<double>::nan();
@@ -2448,10 +2819,10 @@ double gmic::mp_get(double *const ptrd, const unsigned int siz, const bool to_st
 }
 
 double gmic::mp_set(const double *const ptrs, const unsigned int siz, const char *const str,
-                    void *const p_list) {
-  const CImg<void*> gr = get_current_run("Function 'set()'",p_list);
+                    void *const p_run) {
+  void *const *const gr = get_current_run("Function 'set()'",p_run);
   gmic &gmic_instance = *(gmic*)gr[0];
-  const unsigned int *const variables_sizes = (const unsigned int*)gr[5];
+  const unsigned int *const variables_scope = (const unsigned int*)gr[5];
   CImg<char> _varname(256);
   char *const varname = _varname.data(), end;
 
@@ -2465,7 +2836,7 @@ double gmic::mp_set(const double *const ptrs, const unsigned int siz, const char
       s_value.assign(24);
       cimg_snprintf(s_value,s_value.width(),"%.17g",*ptrs);
     }
-    gmic_instance.set_variable(str,'=',s_value,0,variables_sizes);
+    gmic_instance.set_variable(str,'=',s_value,0,variables_scope);
   } else
     throw CImgArgumentException("[" cimg_appname "_math_parser] CImg<>: Function 'set()': "
                                 "Invalid variable name '%s'.",
@@ -2474,8 +2845,8 @@ double gmic::mp_set(const double *const ptrs, const unsigned int siz, const char
 }
 
 double gmic::mp_name(const unsigned int ind, double *const out_str, const unsigned int siz,
-                     void *const p_list) {
-  const CImg<void*> gr = get_current_run("Function 'name()'",p_list);
+                     void *const p_run) {
+  void *const *const gr = get_current_run("Function 'name()'",p_run);
   CImgList<char> &images_names = *(CImgList<char>*)gr[2];
 
   std::memset(out_str,0,siz*sizeof(double));
@@ -2491,9 +2862,9 @@ double gmic::mp_name(const unsigned int ind, double *const out_str, const unsign
 // This method is not thread-safe. Ensure it's never run in parallel!
 template<typename T>
 double gmic::mp_run(char *const str,
-                    void *const p_list, const T& pixel_type) {
+                    void *const p_run, const T& pixel_type) {
   cimg::unused(pixel_type);
-  const CImg<void*> gr = get_current_run("Function 'run()'",p_list);
+  void *const *const gr = get_current_run("Function 'run()'",p_run);
   double res = cimg::type<double>::nan();
 
   gmic &gmic_instance = *(gmic*)gr[0];
@@ -2501,7 +2872,7 @@ double gmic::mp_run(char *const str,
   CImgList<char> &images_names = *(CImgList<char>*)gr[2];
   CImgList<T> &parent_images = *(CImgList<T>*)gr[3];
   CImgList<char> &parent_images_names = *(CImgList<char>*)gr[4];
-  const unsigned int *const variables_sizes = (const unsigned int*)gr[5];
+  const unsigned int *const variables_scope = (const unsigned int*)gr[5];
   const CImg<unsigned int> *const command_selection = (const CImg<unsigned int>*)gr[6];
 
   CImg<char> is_error;
@@ -2514,7 +2885,7 @@ double gmic::mp_run(char *const str,
   unsigned int pos = 0;
   try {
     gmic_instance._run(gmic_instance.commands_line_to_CImgList(gmic::strreplace_fw(str)),pos,images,images_names,
-                       parent_images,parent_images_names,variables_sizes,0,0,command_selection);
+                       parent_images,parent_images_names,variables_scope,0,0,command_selection);
   } catch (gmic_exception &e) {
     CImg<char>::string(e.what()).move_to(is_error);
   }
@@ -2532,13 +2903,13 @@ template<typename T>
 double gmic::mp_store(const double *const ptrs, const unsigned int siz,
                       const unsigned int w, const unsigned int h, const unsigned d, const unsigned int s,
                       const bool is_compressed, const char *const str,
-                      void *const p_list, const T& pixel_type) {
+                      void *const p_run, const T& pixel_type) {
   cimg::unused(pixel_type);
-  const CImg<void*> gr = get_current_run("Function 'store()'",p_list);
+  void *const *const gr = get_current_run("Function 'store()'",p_run);
   cimg_pragma_openmp(critical(mp_store))
   {
     gmic &gmic_instance = *(gmic*)gr[0];
-    const unsigned int *const variables_sizes = (const unsigned int*)gr[5];
+    const unsigned int *const variables_scope = (const unsigned int*)gr[5];
     CImg<char> _varname(256);
     char *const varname = _varname.data(), end;
 
@@ -2557,7 +2928,7 @@ double gmic::mp_store(const double *const ptrs, const unsigned int siz,
       g_list.get_serialize(is_compressed).unroll('x').move_to(name);
       name.resize((unsigned int)(name.width() + 9 + std::strlen(varname)),1,1,1,0,0,1);
       std::sprintf(name,"%c*store/%s",gmic_store,_varname.data());
-      gmic_instance.set_variable(_varname.data(),name,variables_sizes);
+      gmic_instance.set_variable(_varname.data(),name,variables_scope);
     } else
       throw CImgArgumentException("[" cimg_appname "_math_parser] CImg<%s>: Function 'store()': "
                                   "Invalid variable name '%s'.",
@@ -2566,32 +2937,14 @@ double gmic::mp_store(const double *const ptrs, const unsigned int siz,
   return cimg::type<double>::nan();
 }
 
-// Manage correspondence between abort pointers and thread ids.
-CImgList<void*> gmic::list_p_is_abort = CImgList<void*>();
+// Manage abort pointer of the current thread.
+// Passing a null pointer returns the current one (never null). Passing '(bool*)-1' unsets it.
 bool *gmic::abort_ptr(bool *const p_is_abort) {
-#if defined(__MACOSX__) || defined(__APPLE__)
-  void* tid = (void*)(cimg_ulong)getpid();
-#elif cimg_OS==1
-  void* tid = (void*)(cimg_ulong)syscall(SYS_gettid);
-#elif cimg_OS==2
-  void* tid = (void*)(cimg_ulong)GetCurrentThreadId();
-#else
-  void* tid = (void*)0;
-#endif // #if defined(__MACOSX__) || defined(__APPLE__)
-  cimg::mutex(21);
-  bool *res = p_is_abort;
-  int ind = -1;
-  cimglist_for(list_p_is_abort,l)
-    if (list_p_is_abort(l,0)==tid) { ind = l; break; }
-  if (p_is_abort) { // Set pointer
-    if (ind>=0) list_p_is_abort(ind,1) = (void*)p_is_abort;
-    else CImg<void*>::vector(tid,(void*)p_is_abort).move_to(list_p_is_abort);
-  } else { // Get pointer
-    static bool _is_abort;
-    res = ind<0?&_is_abort:(bool*)list_p_is_abort(ind,1);
-  }
-  cimg::mutex(21,0);
-  return res;
+  static bool _is_abort = false;
+  static thread_local bool *p_current = 0;
+  if (p_is_abort==(bool*)-1) p_current = 0;
+  else if (p_is_abort) p_current = p_is_abort;
+  return p_current?p_current:&_is_abort;
 }
 
 // Manage mutexes.
@@ -2614,13 +2967,187 @@ struct _gmic_mutex {
 };
 inline _gmic_mutex& gmic_mutex() { static _gmic_mutex val; return val; }
 
+// Manage reusable buffers for temporary strings.
+// Buffers are taken from the interpreter stack 'scratch' and given back (with their allocated memory) in reverse
+// order, when the '_gmic_scratch' object goes out of scope. Strings used by items and scopes are then allocated
+// only once per nesting level, instead of once per item.
+struct _gmic_scratch {
+  CImgList<char> local;
+  CImg<char> *buffers;
+  unsigned int *p_nb, nb_buffers;
+  _gmic_scratch(CImgList<char>& scratch, unsigned int& nb, const unsigned int n):nb_buffers(n) {
+    if (!scratch) scratch.assign(512);
+    if (nb + n<=scratch.size()) { buffers = scratch.data() + nb; nb+=n; p_nb = &nb; }
+    else { local.assign(n); buffers = local.data(); p_nb = 0; } // Stack is full, use local buffers
+  }
+  ~_gmic_scratch() { if (p_nb) *p_nb-=nb_buffers; }
+  CImg<char>& operator[](const unsigned int i) { return buffers[i]; }
+};
+
+// Tokenize a list of comma-separated arguments, in a single pass.
+// Each argument is typed as a number ('n'), a percentage ('%'), an image reference '[...]' ('['), a set of axes
+// among 'xyzc' ('a') or a generic string ('s'), so that builtins can match their arguments structurally with
+// 'match()', rather than trying a cascade of 'cimg_sscanf()' patterns.
+struct _gmic_args {
+  enum { max_size = 16 };
+  const char *strings[max_size]; // Beginning of each argument (after the '[' for image references).
+  unsigned int lengths[max_size], size;
+  double values[max_size];
+  char types[max_size];
+  bool is_uints[max_size];
+
+  _gmic_args(const char *const argument):size(0) {
+    const char *ptr = argument;
+    for (bool is_last = false; !is_last; ++ptr) {
+      const char *ptr0 = ptr;
+      char *ptr_end = 0, type = 's';
+      bool is_uint = false;
+      const double val = std::strtod(ptr,&ptr_end);
+      if (ptr_end!=ptr) { // Number or percentage
+        type = *ptr_end=='%'?'%':'n';
+        if (type=='%') ++ptr_end;
+        if (*ptr_end && *ptr_end!=',') type = 's';
+        else {
+          if (type=='n') { // Check for an unsigned integer, as accepted by '%u'
+            const char *s = ptr;
+            while (cimg::is_blank(*s)) ++s;
+            if (*s=='+' || (*s=='-' && !val)) ++s;
+            is_uint = s<ptr_end && val<=~0U;
+            for ( ; s<ptr_end && is_uint; ++s) is_uint = *s>='0' && *s<='9';
+          }
+          ptr = ptr_end;
+        }
+      }
+      if (type=='s') {
+        if (*ptr=='[') { // Image reference
+          int depth = 0;
+          const char *s = ptr;
+          for ( ; *s; ++s) if (*s=='[') ++depth; else if (*s==']' && !--depth) break;
+          if (*s && (!s[1] || s[1]==',')) { type = '['; ptr0 = ptr + 1; ptr = s + 1; }
+        }
+        if (type=='s') {
+          bool is_axes = *ptr && *ptr!=',';
+          for ( ; *ptr && *ptr!=','; ++ptr) is_axes&=*ptr=='x' || *ptr=='y' || *ptr=='z' || *ptr=='c';
+          if (is_axes) type = 'a';
+        }
+      }
+      if (size<max_size) {
+        strings[size] = ptr0;
+        lengths[size] = (unsigned int)(ptr - ptr0) - (type=='['?1:0);
+        values[size] = type=='n' || type=='%'?val:0;
+        types[size] = type;
+        is_uints[size] = is_uint;
+      }
+      ++size;
+      is_last = !*ptr;
+    }
+  }
+
+  // Return 'true' if arguments (starting from 'offset') match the specified pattern.
+  // Each character stands for one argument: 'f' (number), 'u' (unsigned integer), 'p' (number or percentage),
+  // 'a' (axes), 'i' (image reference) or '*' (any argument). Arguments after a '|' are optional.
+  bool match(const char *const pattern, const unsigned int offset=0) const {
+    if (size>max_size) return false;
+    unsigned int i = offset;
+    bool is_optional = false;
+    for (const char *p = pattern; *p; ++p) {
+      if (*p=='|') { is_optional = true; continue; }
+      if (i>=size) return is_optional;
+      const char type = types[i];
+      if (!(*p=='f'?type=='n':
+            *p=='u'?type=='n' && is_uints[i]:
+            *p=='p'?type=='n' || type=='%':
+            *p=='a'?type=='a':
+            *p=='i'?type=='[':
+            *p=='*')) return false;
+      ++i;
+    }
+    return i==size;
+  }
+
+  double operator[](const unsigned int i) const { return values[i]; }
+  bool is_percent(const unsigned int i) const { return types[i]=='%'; }
+  bool is_value(const unsigned int i) const { return types[i]=='n' || types[i]=='%'; }
+
+  // Copy argument 'i' as a null-terminated string, into buffer 'res' of size 'siz'.
+  // Return 'false' if the buffer is too small.
+  bool get(const unsigned int i, char *const res, const unsigned int siz) const {
+    if (lengths[i]>=siz) return false;
+    std::memcpy(res,strings[i],lengths[i]);
+    res[lengths[i]] = 0;
+    return true;
+  }
+};
+
+// Manage scope of local variables, for nested pipelines.
+// A scope is identified by its nesting level. Entering it costs nothing, and leaving it removes only the variables
+// that have been defined inside, by unrolling the interpreter log 'variables_log' (see 'mark_variables_slot()').
+struct _gmic_variables_scope {
+  gmic *p_gmic;
+  unsigned int level, nb_log;
+  _gmic_variables_scope(gmic& gmic_instance):p_gmic(&gmic_instance),level(++gmic_instance.variables_level),
+                                             nb_log(gmic_instance.nb_variables_log) {}
+  ~_gmic_variables_scope() { leave(); }
+  void leave() {
+    if (!p_gmic) return;
+    p_gmic->unroll_variables_log(nb_log);
+    --p_gmic->variables_level;
+    p_gmic = 0;
+  }
+};
+
+// Reusable buffer for formatting messages of the current thread.
+// Buffers are indexed by the nesting depth of message functions, so that a message formatted while another one
+// is still in use (e.g. from a 'log_callback' that runs the interpreter again) gets its own buffer.
+struct _gmic_message_buffer {
+  CImg<char> message;
+  _gmic_message_buffer(const unsigned int siz) {
+    CImgList<char> &buffers = pool();
+    const unsigned int depth = level()++;
+    if (depth>=buffers.size()) buffers.insert(depth + 1 - buffers.size());
+    CImg<char> &buffer = buffers[depth];
+    if (buffer._width<siz) buffer.assign(siz);
+    message.assign(buffer.data(),siz,1,1,1,true);
+  }
+  ~_gmic_message_buffer() { --level(); }
+  static CImgList<char>& pool() { static thread_local CImgList<char> val; return val; }
+  static unsigned int& level() { static thread_local unsigned int val = 0; return val; }
+};
+
+// Shared state of threads running a 'foreach_parallel...done' block.
+// Each selected image is stored in its own list, and the next image to process is given to the first available
+// thread (mutex 16 protects 'ind_next' and the fields updated when an image is done).
+// An image moved out of the image list is backed up when a previous image is still being processed, so that it
+// can be restored if that previous image stops the block (error or 'onfail'), as a sequential 'foreach' would do.
+template<typename T>
+struct _gmic_foreach {
+  CImg<CImgList<T> > g_lists, g_backups;
+  CImg<CImgList<char> > g_lists_c;
+  CImgList<char> statuses;
+  CImg<unsigned char> is_moved, is_done;
+  CImgList<T> *images, *parent_images;
+  CImgList<char> *images_names, *parent_images_names;
+  const CImg<unsigned int> *command_selection;
+  const CImgList<char> *commands_line;
+  CImg<unsigned int> *blocks;
+  gmic_exception exception;
+  unsigned int position, ind_next, ind_stop, nb_done_prefix;
+  bool is_stop;
+  _gmic_foreach(const unsigned int nb_items):g_lists(nb_items),g_backups(nb_items),g_lists_c(nb_items),
+                                             statuses(nb_items),is_moved(nb_items,1,1,1,0),
+                                             is_done(nb_items,1,1,1,0),images(0),parent_images(0),
+                                             images_names(0),parent_images_names(0),command_selection(0),
+                                             commands_line(0),blocks(0),position(0),ind_next(0),
+                                             ind_stop(~0U),nb_done_prefix(0),is_stop(false) {}
+};
+
 // Thread structure and routine for command 'parallel'.
 template<typename T>
 struct _gmic_parallel {
   CImgList<char> *images_names, *parent_images_names, commands_line;
   CImg<_gmic_parallel<T> > *gmic_threads;
   CImgList<T> *images, *parent_images;
-  CImg<unsigned int> variables_sizes;
+  unsigned int variables_scope;
   const CImg<unsigned int> *command_selection;
   bool is_thread_running;
   gmic_exception exception;
@@ -2632,7 +3159,7 @@ struct _gmic_parallel {
   HANDLE thread_id;
 #endif // #ifdef PTHREAD_CANCEL_ENABLE
 #endif // #ifdef gmic_is_parallel
-  _gmic_parallel() { variables_sizes.assign(gmic_varslots); }
+  _gmic_parallel():variables_scope(0) {}
 };
 
 template<typename T>
@@ -2648,7 +3175,7 @@ static void *gmic_parallel(void *arg) {
     st.gmic_instance.is_debug_info = false;
     st.gmic_instance._run(st.commands_line,pos,*st.images,*st.images_names,
                           *st.parent_images,*st.parent_images_names,
-                          st.variables_sizes,0,0,st.command_selection);
+                          &st.variables_scope,0,0,st.command_selection);
   } catch (gmic_exception &e) {
     cimg_forY(*st.gmic_threads,l)
       (*st.gmic_threads)[l].gmic_instance.is_abort_thread = true;
@@ -2661,18 +3188,335 @@ static void *gmic_parallel(void *arg) {
   return 0;
 }
 
+// Start thread for command 'parallel' (or run it, if parallel computing is disabled).
+template<typename T>
+static void gmic_parallel_start(_gmic_parallel<T> &st) {
+#ifdef gmic_is_parallel
+#ifdef PTHREAD_CANCEL_ENABLE
+
+#if defined(__MACOSX__) || defined(__APPLE__)
+  const cimg_uint64 stacksize = (cimg_uint64)8*1024*1024;
+  pthread_attr_t thread_attr;
+  if (!pthread_attr_init(&thread_attr) && !pthread_attr_setstacksize(&thread_attr,stacksize))
+    // Reserve enough stack size for the new thread.
+    pthread_create(&st.thread_id,&thread_attr,gmic_parallel<T>,(void*)&st);
+  else
+#endif // #if defined(__MACOSX__) || defined(__APPLE__)
+    pthread_create(&st.thread_id,0,gmic_parallel<T>,(void*)&st);
+
+#elif cimg_OS==2 // #ifdef PTHREAD_CANCEL_ENABLE
+  st.thread_id = CreateThread(0,0,(LPTHREAD_START_ROUTINE)gmic_parallel<T>,(void*)&st,0,0);
+#endif // #ifdef PTHREAD_CANCEL_ENABLE
+#else // #ifdef gmic_is_parallel
+  gmic_parallel<T>((void*)&st);
+#endif // #ifdef gmic_is_parallel
+}
+
+// Persistent worker threads for 'foreach_parallel...done' blocks.
+// A pool belongs to the interpreter running the blocks. Its workers keep their own interpreter from one block to
+// the next (only its state is refreshed with 'init_thread()'), and wait for jobs on their own semaphore.
+// Threads are started on demand, and stopped when the owning interpreter is destroyed.
+#if defined(gmic_is_parallel) && (defined(PTHREAD_CANCEL_ENABLE) || cimg_OS==2)
+#define _gmic_has_worker_threads
+#endif // #if defined(gmic_is_parallel) && (defined(PTHREAD_CANCEL_ENABLE) || cimg_OS==2)
+
+struct _gmic_semaphore {
+#if defined(_gmic_has_worker_threads) && defined(PTHREAD_CANCEL_ENABLE)
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  unsigned int count;
+  _gmic_semaphore():count(0) { pthread_mutex_init(&mutex,0); pthread_cond_init(&cond,0); }
+  ~_gmic_semaphore() { pthread_cond_destroy(&cond); pthread_mutex_destroy(&mutex); }
+  void post() {
+    pthread_mutex_lock(&mutex);
+    ++count;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+  }
+  void wait() {
+    pthread_mutex_lock(&mutex);
+    while (!count) pthread_cond_wait(&cond,&mutex);
+    --count;
+    pthread_mutex_unlock(&mutex);
+  }
+#elif defined(_gmic_has_worker_threads) // #if defined(_gmic_has_worker_threads) && defined(PTHREAD_CANCEL_ENABLE)
+  HANDLE semaphore;
+  _gmic_semaphore() { semaphore = CreateSemaphore(0,0,0x7fffffff,0); }
+  ~_gmic_semaphore() { CloseHandle(semaphore); }
+  void post() { ReleaseSemaphore(semaphore,1,0); }
+  void wait() { WaitForSingleObject(semaphore,INFINITE); }
+#endif // #if defined(_gmic_has_worker_threads) && defined(PTHREAD_CANCEL_ENABLE)
+};
+
+struct _gmic_worker_pool;
+struct _gmic_worker {
+  gmic gmic_instance;
+  _gmic_worker_pool *pool;
+#ifdef _gmic_has_worker_threads
+  _gmic_semaphore job_posted;
+#ifdef PTHREAD_CANCEL_ENABLE
+  pthread_t thread_id;
+#else // #ifdef PTHREAD_CANCEL_ENABLE
+  HANDLE thread_id;
+#endif // #ifdef PTHREAD_CANCEL_ENABLE
+#endif // #ifdef _gmic_has_worker_threads
+};
+
+#ifdef _gmic_has_worker_threads
+#ifdef PTHREAD_CANCEL_ENABLE
+static void *gmic_worker(void *arg);
+#else // #ifdef PTHREAD_CANCEL_ENABLE
+static DWORD WINAPI gmic_worker(LPVOID arg);
+#endif // #ifdef PTHREAD_CANCEL_ENABLE
+#endif // #ifdef _gmic_has_worker_threads
+
+struct _gmic_worker_pool {
+  CImg<void*> workers;
+  void (*job)(gmic&,void*);
+  void *job_data;
+  bool is_stop;
+#ifdef _gmic_has_worker_threads
+  _gmic_semaphore job_done;
+#endif // #ifdef _gmic_has_worker_threads
+
+  _gmic_worker_pool():job(0),job_data(0),is_stop(false) {}
+
+  ~_gmic_worker_pool() {
+    is_stop = true;
+#ifdef _gmic_has_worker_threads
+    cimg_forX(workers,l) worker(l).job_posted.post();
+#endif // #ifdef _gmic_has_worker_threads
+    cimg_forX(workers,l) {
+#if defined(_gmic_has_worker_threads) && defined(PTHREAD_CANCEL_ENABLE)
+      pthread_join(worker(l).thread_id,0);
+#elif defined(_gmic_has_worker_threads) // #if defined(_gmic_has_worker_threads) && defined(PTHREAD_CANCEL_ENABLE)
+      WaitForSingleObject(worker(l).thread_id,INFINITE);
+      CloseHandle(worker(l).thread_id);
+#endif // #if defined(_gmic_has_worker_threads) && defined(PTHREAD_CANCEL_ENABLE)
+      delete &worker(l);
+    }
+  }
+
+  _gmic_worker& worker(const unsigned int l) { return *(_gmic_worker*)workers[l]; }
+
+  // Make sure at least 'nb' workers are started.
+  void reserve(const unsigned int nb) {
+    if (nb<=workers._width) return;
+    CImg<void*> nworkers(nb);
+    for (unsigned int l = 0; l<nb; ++l) nworkers[l] = l<workers._width?workers[l]:0;
+    nworkers.swap(workers);
+    for (unsigned int l = nworkers._width; l<nb; ++l) {
+      _gmic_worker &w = *new _gmic_worker;
+      w.pool = this;
+      workers[l] = (void*)&w;
+#if defined(_gmic_has_worker_threads) && defined(PTHREAD_CANCEL_ENABLE)
+#if defined(__MACOSX__) || defined(__APPLE__)
+      const cimg_uint64 stacksize = (cimg_uint64)8*1024*1024;
+      pthread_attr_t thread_attr;
+      if (!pthread_attr_init(&thread_attr) && !pthread_attr_setstacksize(&thread_attr,stacksize))
+        // Reserve enough stack size for the new thread.
+        pthread_create(&w.thread_id,&thread_attr,gmic_worker,(void*)&w);
+      else
+#endif // #if defined(__MACOSX__) || defined(__APPLE__)
+        pthread_create(&w.thread_id,0,gmic_worker,(void*)&w);
+#elif defined(_gmic_has_worker_threads) // #if defined(_gmic_has_worker_threads) && defined(PTHREAD_CANCEL_ENABLE)
+      w.thread_id = CreateThread(0,0,(LPTHREAD_START_ROUTINE)gmic_worker,(void*)&w,0,0);
+#endif // #if defined(_gmic_has_worker_threads) && defined(PTHREAD_CANCEL_ENABLE)
+    }
+  }
+
+  // Run 'job' on the first 'nb' workers (sequentially, if parallel computing is disabled), and wait for them.
+  void run(const unsigned int nb, void (*const _job)(gmic&,void*), void *const _job_data) {
+    reserve(nb);
+    job = _job;
+    job_data = _job_data;
+#ifdef _gmic_has_worker_threads
+    for (unsigned int l = 0; l<nb; ++l) worker(l).job_posted.post();
+    for (unsigned int l = 0; l<nb; ++l) job_done.wait();
+#else // #ifdef _gmic_has_worker_threads
+    for (unsigned int l = 0; l<nb; ++l) job(worker(l).gmic_instance,job_data);
+#endif // #ifdef _gmic_has_worker_threads
+  }
+};
+
+#ifdef _gmic_has_worker_threads
+#ifdef PTHREAD_CANCEL_ENABLE
+static void *gmic_worker(void *arg) {
+#else // #ifdef PTHREAD_CANCEL_ENABLE
+static DWORD WINAPI gmic_worker(LPVOID arg) {
+#endif // #ifdef PTHREAD_CANCEL_ENABLE
+  _gmic_worker &w = *(_gmic_worker*)arg;
+  _gmic_worker_pool &pool = *w.pool;
+  for ( ; ; ) {
+    w.job_posted.wait();
+    if (pool.is_stop) break;
+    pool.job(w.gmic_instance,pool.job_data);
+    pool.job_done.post();
+  }
+  return 0;
+}
+#endif // #ifdef _gmic_has_worker_threads
+
+// Job run by the workers of a 'foreach_parallel...done' block.
+template<typename T>
+static void gmic_foreach_job(gmic &gmic_instance, void *const p_foreach) {
+  _gmic_foreach<T> &fe = *(_gmic_foreach<T>*)p_foreach;
+  gmic_instance.abort_ptr(gmic_instance.is_abort);
+  gmic_instance.is_debug_info = false;
+  gmic_instance.run_foreach(p_foreach,*fe.images,*fe.images_names,*fe.parent_images,*fe.parent_images_names,
+                            fe.command_selection);
+}
+
+// Thread structure and routine for asynchronous runs (see 'gmic::run_async()').
+// Shared state of a 'gmic_task' is protected by mutex 21.
+struct _gmic_task {
+  CImg<char> commands_line;
+  gmic *gmic_instance;
+  void *images, *images_names;
+  gmic_exception exception;
+  float progress;
+  unsigned int nb_refs;
+  volatile bool is_abort; // Written by the thread cancelling the task, polled by the threads running it
+  bool is_done, is_joined;
+#if defined(gmic_is_parallel) && defined(PTHREAD_CANCEL_ENABLE)
+  pthread_t thread_id;
+#elif defined(gmic_is_parallel) && cimg_OS==2
+  HANDLE thread_id;
+#endif // #if defined(gmic_is_parallel) && defined(PTHREAD_CANCEL_ENABLE)
+
+  _gmic_task():gmic_instance(0),images(0),images_names(0),progress(-1),nb_refs(1),
+               is_abort(false),is_done(false),is_joined(false) {}
+
+  bool get_is_done() {
+    cimg::mutex(21);
+    const bool res = is_done;
+    cimg::mutex(21,0);
+    return res;
+  }
+
+  // Wait for thread to finish (only the first caller actually joins it).
+  void join() {
+    cimg::mutex(21);
+    const bool is_joiner = !is_joined;
+    is_joined = true;
+    cimg::mutex(21,0);
+    if (is_joiner) {
+#if defined(gmic_is_parallel) && defined(PTHREAD_CANCEL_ENABLE)
+      pthread_join(thread_id,0);
+#elif defined(gmic_is_parallel) && cimg_OS==2
+      WaitForSingleObject(thread_id,INFINITE);
+      CloseHandle(thread_id);
+#endif // #if defined(gmic_is_parallel) && defined(PTHREAD_CANCEL_ENABLE)
+    } else while (!get_is_done()) cimg::sleep(1);
+  }
+};
+
+template<typename T>
+#if cimg_OS==2 && !defined(PTHREAD_CANCEL_ENABLE)
+DWORD WINAPI gmic_task_run(LPVOID arg) {
+#else
+static void *gmic_task_run(void *arg) {
+#endif
+  _gmic_task &st = *(_gmic_task*)arg;
+  try {
+    st.gmic_instance->run(st.commands_line,*(CImgList<T>*)st.images,*(CImgList<char>*)st.images_names,
+                          &st.progress,(bool*)&st.is_abort);
+  } catch (gmic_exception &e) {
+    st.exception._command.assign(e._command);
+    st.exception._message.assign(e._message);
+  }
+  cimg::mutex(21);
+  st.is_done = true;
+  cimg::mutex(21,0);
+#if defined(gmic_is_parallel) && defined(PTHREAD_CANCEL_ENABLE)
+  pthread_exit(0);
+#endif // #if defined(gmic_is_parallel) && defined(PTHREAD_CANCEL_ENABLE)
+  return 0;
+}
+
+gmic_task::gmic_task():_state(0) {}
+
+gmic_task::gmic_task(const gmic_task& task):_state(task._state) {
+  if (!_state) return;
+  cimg::mutex(21);
+  ++((_gmic_task*)_state)->nb_refs;
+  cimg::mutex(21,0);
+}
+
+gmic_task& gmic_task::operator=(const gmic_task& task) {
+  if (task._state!=_state) {
+    gmic_task tmp(task);
+    cimg::swap(_state,tmp._state);
+  }
+  return *this;
+}
+
+gmic_task::~gmic_task() {
+  if (!_state) return;
+  _gmic_task &st = *(_gmic_task*)_state;
+  cimg::mutex(21);
+  const bool is_last = !--st.nb_refs;
+  cimg::mutex(21,0);
+  if (is_last) {
+    st.is_abort = true;
+    st.join();
+    delete &st;
+  }
+}
+
+bool gmic_task::is_valid() const {
+  return _state!=0;
+}
+
+bool gmic_task::is_done() const {
+  return !_state || ((_gmic_task*)_state)->get_is_done();
+}
+
+bool gmic_task::wait(const unsigned int milliseconds) const {
+  if (!_state) return true;
+  _gmic_task &st = *(_gmic_task*)_state;
+  if (milliseconds!=~0U) {
+    const cimg_uint64 time0 = cimg::time();
+    while (!st.get_is_done())
+      if (cimg::time() - time0>=milliseconds) return false;
+      else cimg::sleep(1);
+  }
+  st.join();
+  return true;
+}
+
+const gmic_task& gmic_task::cancel() const {
+  if (_state) ((_gmic_task*)_state)->is_abort = true;
+  return *this;
+}
+
+float gmic_task::progress() const {
+  return _state?((_gmic_task*)_state)->progress:-1;
+}
+
+const gmic_exception& gmic_task::exception() const {
+  static const gmic_exception empty;
+  return is_done() && _state?((_gmic_task*)_state)->exception:empty;
+}
+
+void gmic_task::get() const {
+  wait();
+  const gmic_exception &e = exception();
+  if (e._message) throw gmic_exception(e.command(),e.what());
+}
+
 // Array of G'MIC built-in commands (must be sorted in lexicographic order!).
 const char *gmic::builtin_commands_names[] = {
   "!=","%","&","*","*3d","+","+3d","-","-3d","/","/3d","::","<","<<","<=","=","==",">",">=",">>",
   "a","abs","acos","acosh","add","add3d","and","append","asin","asinh","atan","atan2","atanh","autocrop","axes",
-  "b","bilateral","blur","boxfilter","break","bsl","bsr",
-  "c","camera","check","check3d","col3d","color3d","command","continue","convolve","correlate","cos","cosh","crop",
-    "cumulate","cursor","cut",
+  "b","bilateral","blend","blur","boxfilter","boxstats","break","bsl","bsr",
+  "c","cache","camera","check","check3d","col3d","color3d","command","continue","convolve","correlate","cos","cosh",
+    "crop","cumulate","cursor","cut",
   "d","db3d","debug","delete","denoise","deriche","dijkstra","dilate","discard","displacement","display","distance",
     "div","div3d","do","done","double3d",
   "e","echo","eigen","eikonal","elif","ellipse","else","endian","eq","equalize","erf","erode","error","eval","exec",
     "exp",
-  "f","f3d","fft","fi","files","fill","flood","focale3d","for","foreach",
+  "f","f3d","fft","fi","files","fill","flood","focale3d","for","foreach","foreach_parallel",
   "ge","graph","gt","guided",
   "h","histogram",
   "i","if","ifft","image","index","inpaint","input","invert","isoline3d","isosurface3d",
@@ -2742,6 +3586,73 @@ int gmic::levenshtein(const char *const s, const char *const t) {
   return _levenshtein(ns,nt,d,0,0);
 }
 
+// Return true if list 'copy' has the same content as list 'list'.
+static bool gmic_is_same(const CImgList<char>& copy, const CImgList<char>& list) {
+  if (copy._width!=list._width) return false;
+  cimglist_for(list,l)
+    if (!copy[l].is_sameXYZC(list[l]) ||
+        (copy[l]._data!=list[l]._data && std::memcmp(copy[l]._data,list[l]._data,list[l].size()))) return false;
+  return true;
+}
+
+// Share interpreter environment with the interpreter of a new thread.
+// Command lists already held by the interpreter (when it is reused, as in 'foreach_parallel') are kept if unchanged.
+void gmic::init_thread(gmic &gmic_instance) {
+  for (unsigned int i = 0; i<gmic_comslots; ++i) {
+    if (!gmic_is_same(gmic_instance.commands[i],commands[i]))
+      gmic_instance.commands[i].assign(commands[i],true);
+    if (!gmic_is_same(gmic_instance.commands_names[i],commands_names[i]))
+      gmic_instance.commands_names[i].assign(commands_names[i],true);
+    if (!gmic_is_same(gmic_instance.commands_has_arguments[i],commands_has_arguments[i]))
+      gmic_instance.commands_has_arguments[i].assign(commands_has_arguments[i],true);
+  }
+  for (unsigned int i = 0; i<gmic_varslots; ++i) {
+    if (i>=6*gmic_varslots/7) { // Share inter-thread global variables
+      gmic_instance.variables[i] = variables[i];
+      gmic_instance.variables_names[i] = variables_names[i];
+    } else {
+      if (i>=gmic_varslots/2) { // Make a copy of single-thread global variables
+        gmic_instance._variables[i].assign(_variables[i]);
+        gmic_instance._variables_names[i].assign(_variables_names[i]);
+      }
+      gmic_instance.variables[i] = &gmic_instance._variables[i];
+      gmic_instance.variables_names[i] = &gmic_instance._variables_names[i];
+    }
+  }
+  gmic_instance.callstack.assign(callstack);
+  gmic_instance.commands_files.assign(commands_files,true);
+  gmic_instance.light3d.assign(light3d);
+  gmic_instance.status.assign(status);
+  gmic_instance.debug_filename = debug_filename;
+  gmic_instance.debug_line = debug_line;
+  gmic_instance.focale3d = focale3d;
+  gmic_instance.light3d_x = light3d_x;
+  gmic_instance.light3d_y = light3d_y;
+  gmic_instance.light3d_z = light3d_z;
+  gmic_instance.specular_lightness3d = specular_lightness3d;
+  gmic_instance.specular_shininess3d = specular_shininess3d;
+  gmic_instance._progress = 0;
+  gmic_instance.progress = &gmic_instance._progress;
+  gmic_instance.is_change = is_change;
+  gmic_instance.is_debug = is_debug;
+  gmic_instance.is_start = false;
+  gmic_instance.is_quit = false;
+  gmic_instance.is_return = false;
+  gmic_instance.is_double3d = is_double3d;
+  gmic_instance.verbosity = verbosity;
+  gmic_instance.render3d = render3d;
+  gmic_instance.renderd3d = renderd3d;
+  gmic_instance._is_abort = _is_abort;
+  gmic_instance.is_abort = is_abort;
+  gmic_instance.is_abort_thread = false;
+  gmic_instance.progress_callback = progress_callback;
+  gmic_instance.log_callback = log_callback;
+  gmic_instance.callback_data = callback_data;
+  gmic_instance.nb_carriages_default = nb_carriages_default;
+  gmic_instance.nb_carriages_stdout = nb_carriages_stdout;
+  gmic_instance.reference_time = reference_time;
+}
+
 // Wait for threads to finish.
 template<typename T>
 void gmic::wait_threads(void *const p_gmic_threads, const bool try_abort, const T& pixel_type) {
@@ -2819,10 +3730,17 @@ const char* gmic::basename(const char *const str)  {
   return p;
 }
 
+// Deallocate a pixel buffer allocated by the library.
+//-----------------------------------------------------
+void gmic_free(void *const ptr) {
+  cimg::memfree(ptr);
+}
+
 // Constructors / destructors.
 //----------------------------
 #define gmic_new_attr commands(0), commands_names(0), commands_has_arguments(0), \
-    _variables(0), _variables_names(0), variables(0), variables_names(0)
+    _variables(0), _variables_names(0), variables(0), variables_names(0), cached_commands_lines(0), \
+    foreach_workers(0)
 
 #define display_window(n) (*(CImgDisplay*)display_windows[n])
 
@@ -2872,22 +3790,9 @@ gmic& gmic::assign(const char *const commands_line, CImgList<T>& images, CImgLis
 }
 
 gmic::~gmic() {
+  delete (_gmic_worker_pool*)foreach_workers;
   cimg_forX(display_windows,l) delete &display_window(l);
-  cimg::mutex(21);
-#if defined(__MACOSX__) || defined(__APPLE__)
-  void* tid = (void*)(cimg_ulong)getpid();
-#elif cimg_OS==1
-  void* tid = (void*)(cimg_ulong)syscall(SYS_gettid);
-#elif cimg_OS==2
-  void* tid = (void*)(cimg_ulong)GetCurrentThreadId();
-#else
-  void* tid = (void*)0;
-#endif
-  int ind = -1;
-  cimglist_for(list_p_is_abort,l)
-    if (list_p_is_abort(l,0)==tid) { ind = l; break; }
-  if (ind>=0) list_p_is_abort.remove(ind);
-  cimg::mutex(21,0);
+  if (abort_ptr(0)==is_abort) abort_ptr((bool*)-1);
 
   delete[] commands;
   delete[] commands_names;
@@ -2896,6 +3801,7 @@ gmic::~gmic() {
   delete[] _variables_names;
   delete[] variables;
   delete[] variables_names;
+  delete[] cached_commands_lines;
   cimg::exception_mode(cimg_exception_mode);
 }
 
@@ -3197,13 +4103,258 @@ CImgList<char> gmic::commands_line_to_CImgList(const char *const commands_line)
   return items;
 }
 
+// Get items of a G'MIC command line, from the cache of already parsed command lines if possible.
+// Cached items are moved out of the cache, and must be given back with 'set_cached_commands_line()'
+// once no longer used (so that recursive calls cannot invalidate them).
+//------------------------------------------------------------------------------------------------------
+void gmic::get_cached_commands_line(const char *const commands_line, CImgList<char>& items,
+                                    CImg<unsigned int>& blocks, CImg<char>& key) {
+  const unsigned int hash = hashcode(commands_line,false)&(gmic_cacheslots - 1);
+  CImg<char> &ckey = cached_commands_lines_keys[hash];
+  if (!is_debug && ckey && !std::strcmp(ckey,commands_line)) { // Cache hit
+    key.swap(ckey);
+    items.swap(cached_commands_lines[hash]);
+    blocks.swap(cached_commands_blocks[hash]);
+  } else { // Cache miss -> recycle key buffer of the evicted entry
+    const unsigned int siz = (unsigned int)std::strlen(commands_line) + 1;
+    commands_line_to_CImgList(commands_line).move_to(items);
+    blocks.assign(); // Computed when needed, by '_run()'
+    key.swap(ckey);
+    if (key._width<siz) key.assign(siz);
+    std::memcpy(key,commands_line,siz);
+  }
+}
+
+void gmic::set_cached_commands_line(CImgList<char>& items, CImg<unsigned int>& blocks, CImg<char>& key) {
+  const unsigned int hash = hashcode(key,false)&(gmic_cacheslots - 1);
+  cached_commands_lines_keys[hash].swap(key);
+  cached_commands_lines[hash].swap(items);
+  cached_commands_blocks[hash].swap(blocks);
+}
+
+// Return block type of a command line item (for the matching of control flow blocks).
+//------------------------------------------------------------------------------------
+enum { _gmic_if = 1, _gmic_fi = 2, _gmic_else = 4, _gmic_loop = 8, _gmic_done = 16, _gmic_onfail = 32,
+       _gmic_do = 64, _gmic_while = 128, _gmic_debug_info = 256 };
+
+// Tell if a string is a valid selection suffix for a block command (e.g. in 'local[0]', 'l..' or 'foreach$1').
+// Quoted arguments like '"l[0] { blur 3 }"' are not blocks.
+inline bool _gmic_is_block_suffix(const char *s) {
+  if (!*s || *s=='$') return true;
+  if (*s!='[' && *s!='.') return false;
+  for ( ; *s; ++s) if (is_blank(*s)) return false;
+  return true;
+}
+
+inline unsigned int _gmic_block_type(const char *it) {
+  if (*it==1) return _gmic_debug_info;
+  const bool is_get = *it=='+';
+  it+=(is_get || *it=='-');
+  switch (*it) {
+  case 'i' : return !is_get && !std::strcmp("if",it)?_gmic_if:0;
+  case 'f' :
+    if (!is_get && !std::strcmp("fi",it)) return _gmic_fi;
+    if ((!is_get && !std::strcmp("for",it)) ||
+        (!std::strncmp("foreach",it,7) &&
+         (_gmic_is_block_suffix(it + 7) ||
+          (!std::strncmp("_parallel",it + 7,9) && _gmic_is_block_suffix(it + 16))))) return _gmic_loop;
+    break;
+  case 'e' : return !is_get && (!std::strcmp("else",it) || !std::strcmp("elif",it))?_gmic_else:0;
+  case 'r' : return !is_get && !std::strcmp("repeat",it)?_gmic_loop:0;
+  case 'l' :
+    return (!std::strncmp("local",it,5) && _gmic_is_block_suffix(it + 5)) ||
+      _gmic_is_block_suffix(it + 1)?_gmic_loop:0;
+  case '}' : return !is_get && !it[1]?_gmic_done:0;
+  case 'd' :
+    if (!is_get && !std::strcmp("done",it)) return _gmic_done;
+    return !is_get && !std::strcmp("do",it)?_gmic_do:0;
+  case 'o' : return !is_get && !std::strcmp("onfail",it)?_gmic_onfail:0;
+  case 'w' : return !is_get && !std::strcmp("while",it)?_gmic_while:0;
+  }
+  return 0;
+}
+
+// Compute matching of control flow blocks in a command line.
+//------------------------------------------------------------
+// Return a (N,6) image, where N is the number of items. For each item position p,
+// rows 0-4 give the position where the scan of the items starting at p stops, when looking for
+// the end of the current block (N if not found):
+//   - row 0: 'fi' ending the current 'if...fi' block.
+//   - row 1: 'fi', 'else' or 'elif' ending the current 'if' branch.
+//   - row 2: 'done' or '}' ending the current 'repeat', 'for', 'foreach' or 'local' block.
+//   - row 3: 'done', '}' or 'onfail' ending the current 'repeat', 'for', 'foreach' or 'local' block.
+//   - row 4: 'while' ending the current 'do...while' block.
+// Row 5 gives the position of the last debug info item up to p (~0U if none).
+CImg<unsigned int> gmic::commands_line_blocks(const CImgList<char>& commands_line) {
+  const unsigned int N = commands_line.size();
+  CImg<unsigned int> res(N,6), types(N);
+  CImg<int> depths(N,3);
+
+  // Compute item types and block depths.
+  int depth_if = 0, depth_loop = 0, depth_do = 0;
+  unsigned int last_debug_info = ~0U;
+  cimg_forX(res,p) {
+    const unsigned int type = types[p] = _gmic_block_type(commands_line[p]);
+    if (type==_gmic_debug_info) last_debug_info = (unsigned int)p;
+    res(p,5) = last_debug_info;
+    depths(p,0) = depth_if; depths(p,1) = depth_loop; depths(p,2) = depth_do;
+    depth_if+=type==_gmic_if?1:type==_gmic_fi?-1:0;
+    depth_loop+=type==_gmic_loop?1:type==_gmic_done?-1:0;
+    depth_do+=type==_gmic_do?1:type==_gmic_while?-1:0;
+  }
+
+  // Find block ends, backward: 'ends(d + N,k)' is the nearest item ending a block of kind 'k' at depth 'd'.
+  CImg<unsigned int> ends(2*N + 1,5,1,1,N);
+  for (int p = (int)N - 1; p>=0; --p) {
+    const unsigned int type = types[p];
+    const int d_if = depths(p,0) + (int)N, d_loop = depths(p,1) + (int)N, d_do = depths(p,2) + (int)N;
+    if (type==_gmic_fi) ends(d_if,0) = ends(d_if,1) = (unsigned int)p;
+    else if (type==_gmic_else) ends(d_if,1) = (unsigned int)p;
+    else if (type==_gmic_done) ends(d_loop,2) = ends(d_loop,3) = (unsigned int)p;
+    else if (type==_gmic_onfail) ends(d_loop,3) = (unsigned int)p;
+    else if (type==_gmic_while) ends(d_do,4) = (unsigned int)p;
+    res(p,0) = ends(d_if,0); res(p,1) = ends(d_if,1);
+    res(p,2) = ends(d_loop,2); res(p,3) = ends(d_loop,3);
+    res(p,4) = ends(d_do,4);
+  }
+  return res;
+}
+
+// Check that control flow blocks of a command line are balanced.
+//----------------------------------------------------------------
+// Return 0 if they are, or the name of the first unmatched or missing block delimiter.
+const char *gmic::check_commands_line_blocks(const CImgList<char>& commands_line) {
+  int depth_if = 0, depth_loop = 0, depth_do = 0;
+  cimglist_for(commands_line,p) {
+    const unsigned int type = _gmic_block_type(commands_line[p]);
+    depth_if+=type==_gmic_if?1:type==_gmic_fi?-1:0;
+    depth_loop+=type==_gmic_loop?1:type==_gmic_done?-1:0;
+    depth_do+=type==_gmic_do?1:type==_gmic_while?-1:0;
+    if (depth_if<0) return "fi";
+    if (depth_loop<0) return "done";
+    if (depth_do<0) return "while";
+    if (type==_gmic_else && !depth_if) return "else";
+  }
+  return depth_if?"fi":depth_loop?"done":depth_do?"while":0;
+}
+
+// Skip items of a command line, up to the end of the current block.
+//-------------------------------------------------------------------
+// Return the position of the item ending the block (or the number of items if not found),
+// using precomputed matching of blocks (see 'commands_line_blocks()').
+// Debug info of skipped items are parsed as if items were scanned one by one.
+unsigned int gmic::skip_block(const CImgList<char>& commands_line, CImg<unsigned int>& blocks,
+                              const unsigned int position, const unsigned int kind,
+                              unsigned int& next_debug_line, unsigned int& next_debug_filename) {
+  if (position>=commands_line.size()) return commands_line.size();
+  if (blocks.width()!=(int)commands_line.size()) commands_line_blocks(commands_line).move_to(blocks);
+  const unsigned int
+    res = blocks(position,kind),
+    ind_debug_info = blocks(std::min(res,commands_line.size() - 1),5);
+  if (ind_debug_info!=~0U && ind_debug_info>=position)
+    is_debug_info|=get_debug_info(commands_line[ind_debug_info].data(),next_debug_line,next_debug_filename);
+  return res;
+}
+
+// Run body of a 'foreach_parallel...done' block, on images taken from shared state 'p_foreach'.
+// Each image is processed as in a 'foreach...done' block, until all images have been given to the threads, or
+// an error (or an 'onfail' block) stops the dispatching of remaining images.
+template<typename T>
+void gmic::run_foreach(void *const p_foreach, CImgList<T>& images, CImgList<char>& images_names,
+                       CImgList<T>& parent_images, CImgList<char>& parent_images_names,
+                       const CImg<unsigned int> *const command_selection) {
+  _gmic_foreach<T> &fe = *(_gmic_foreach<T>*)p_foreach;
+  const CImgList<char> &commands_line = *fe.commands_line;
+  CImg<unsigned int> &blocks = *fe.blocks;
+  const unsigned int
+    nb_items = fe.g_lists._width,
+    callstack_size = callstack.size(),
+    variables_scope = 0,
+    _debug_line = debug_line;
+  const int o_verbosity = verbosity;
+  if (!foreachdones) foreachdones.assign(3,8,1,1,0);
+
+  for ( ; ; ) {
+    cimg::mutex(16);
+    const unsigned int ind = fe.is_stop || fe.ind_next>=nb_items?~0U:fe.ind_next++;
+    const bool is_backup = ind!=~0U && fe.is_moved[ind] && fe.nb_done_prefix<ind;
+    cimg::mutex(16,0);
+    if (ind==~0U) break;
+    CImgList<T> &g_list = fe.g_lists[ind];
+    CImgList<char> &g_list_c = fe.g_lists_c[ind];
+    if (is_backup) fe.g_backups[ind].assign(g_list); // A previous image may still stop the block
+
+    CImg<char>::string("*foreach").move_to(callstack);
+    unsigned int *const fed = foreachdones.data(0,nb_foreachdones++);
+    fed[0] = ind; // Iteration counter
+    fed[1] = nb_items - ind;
+    fed[2] = _debug_line;
+
+    unsigned int position = fe.position, next_debug_line = ~0U, next_debug_filename = ~0U;
+    gmic_exception exception;
+    bool is_onfail = false;
+    debug_line = _debug_line;
+    verbosity = o_verbosity;
+    try {
+      _run(commands_line,position,g_list,g_list_c,images,images_names,&variables_scope,0,0,
+           command_selection,&blocks);
+    } catch (gmic_exception &e) {
+      if ((position = skip_block(commands_line,blocks,position,3,next_debug_line,next_debug_filename))<
+          commands_line.size() && _gmic_block_type(commands_line[position])==_gmic_onfail) { // Onfail block found
+        verbosity = o_verbosity;
+        is_onfail = true;
+        try {
+          _run(commands_line,++position,g_list,g_list_c,
+               parent_images,parent_images_names,&variables_scope,0,0,0,&blocks);
+        } catch (gmic_exception &e2) {
+          cimg::swap(exception._command,e2._command);
+          cimg::swap(exception._message,e2._message);
+        }
+      } else {
+        cimg::swap(exception._command,e._command);
+        cimg::swap(exception._message,e._message);
+      }
+    }
+    if (callstack.size()>callstack_size) callstack.remove(callstack_size,callstack.size() - 1);
+    nb_dowhiles = nb_fordones = nb_foreachdones = nb_repeatdones = 0;
+    is_return = false;
+
+    cimg::mutex(16);
+    fe.is_done[ind] = 1;
+    fe.statuses[ind].assign(status);
+    if (exception._message || is_onfail) { // Keep first stopping image, as a sequential 'foreach' would do
+      if (ind<fe.ind_stop) {
+        fe.ind_stop = ind;
+        cimg::swap(fe.exception._command,exception._command);
+        cimg::swap(fe.exception._message,exception._message);
+      }
+      fe.is_stop = true;
+    }
+    while (fe.nb_done_prefix<fe.ind_stop && fe.nb_done_prefix<nb_items && fe.is_done[fe.nb_done_prefix])
+      fe.g_backups[fe.nb_done_prefix++].assign(); // Image can't be discarded anymore
+    cimg::mutex(16,0);
+  }
+}
+
+// Send log message to user-defined callback.
+//-------------------------------------------
+void gmic::notify_log(const unsigned int level, const char *const s_callstack, const unsigned int nb_images,
+                      const char *const message) {
+  if (!s_callstack) { log_callback(message,level,callback_data); return; }
+  CImg<char> full_message((unsigned int)(std::strlen(s_callstack) + std::strlen(message) + 32));
+  if (nb_images==~0U) cimg_snprintf(full_message,full_message.width(),"[gmic]%s %s",s_callstack,message);
+  else cimg_snprintf(full_message,full_message.width(),"[gmic]-%u%s %s",nb_images,s_callstack,message);
+  log_callback(full_message,level,callback_data);
+}
+
 // Print log message.
 //-------------------
 gmic& gmic::print(const char *format, ...) {
   if (verbosity<1 && !is_debug) return *this;
   va_list ap;
   va_start(ap,format);
-  CImg<char> message(65536);
+  _gmic_message_buffer message_buffer(65536);
+  CImg<char> &message = message_buffer.message;
   message[message.width() - 2] = 0;
   cimg_vsnprintf(message,message.width(),format,ap);
   strreplace_fw(message);
@@ -3211,6 +4362,10 @@ gmic& gmic::print(const char *format, ...) {
   va_end(ap);
 
   // Display message.
+  if (log_callback) {
+    notify_log(0,callstack2string(),~0U,message.data() + (*message=='\r'));
+    return *this;
+  }
   cimg::mutex(29);
   unsigned int &nb_carriages = cimg::output()==stdout?nb_carriages_stdout:nb_carriages_default;
   const bool is_cr = *message=='\r';
@@ -3225,12 +4380,47 @@ gmic& gmic::print(const char *format, ...) {
   return *this;
 }
 
+// Print warning message.
+//-----------------------
+gmic& gmic::warn(const char *format, ...) {
+  if (verbosity<1 && !is_debug) return *this;
+  va_list ap;
+  va_start(ap,format);
+  _gmic_message_buffer message_buffer(1024);
+  CImg<char> &message = message_buffer.message;
+  message[message.width() - 2] = 0;
+  cimg_vsnprintf(message,message.width(),format,ap);
+  strreplace_fw(message);
+  if (message[message.width() - 2]) cimg::strellipsize(message,message.width() - 2);
+  va_end(ap);
+
+  // Display message.
+  if (log_callback) {
+    notify_log(1,callstack2string(),~0U,message.data() + (*message=='\r'));
+    return *this;
+  }
+  cimg::mutex(29);
+  unsigned int &nb_carriages = cimg::output()==stdout?nb_carriages_stdout:nb_carriages_default;
+  const bool is_cr = *message=='\r';
+  if (is_cr) std::fputc('\r',cimg::output());
+  else for (unsigned int i = 0; i<nb_carriages; ++i) std::fputc('\n',cimg::output());
+  nb_carriages = 1;
+  std::fprintf(cimg::output(),
+               "[gmic]%s %s%s*** Warning *** %s%s",
+               callstack2string().data(),cimg::t_magenta,cimg::t_bold,
+               message.data() + (is_cr?1:0),cimg::t_normal);
+  std::fflush(cimg::output());
+  cimg::mutex(29,0);
+  return *this;
+}
+
 // Print error message, and quit interpreter.
 //-------------------------------------------
 gmic& gmic::error(const bool output_header, const char *const format, ...) {
   va_list ap;
   va_start(ap,format);
-  CImg<char> message(1024);
+  _gmic_message_buffer message_buffer(1024);
+  CImg<char> &message = message_buffer.message;
   message[message.width() - 2] = 0;
   cimg_vsnprintf(message,message.width(),format,ap);
   strreplace_fw(message);
@@ -3240,7 +4430,9 @@ gmic& gmic::error(const bool output_header, const char *const format, ...) {
   // Display message.
   const bool is_cr = *message=='\r';
   const CImg<char> s_callstack = callstack2string();
-  if (verbosity>=1 || is_debug) {
+  if (log_callback) {
+    if (verbosity>=1 || is_debug) notify_log(2,s_callstack,~0U,message.data() + (is_cr?1:0));
+  } else if (verbosity>=1 || is_debug) {
     cimg::mutex(29);
     if (is_cr) std::fputc('\r',cimg::output());
     else for (unsigned int i = 0; i<nb_carriages_default; ++i) std::fputc('\n',cimg::output());
@@ -3287,7 +4479,8 @@ gmic& gmic::debug(const char *format, ...) {
   if (!is_debug) return *this;
   va_list ap;
   va_start(ap,format);
-  CImg<char> message(1024);
+  _gmic_message_buffer message_buffer(1024);
+  CImg<char> &message = message_buffer.message;
   message[message.width() - 2] = 0;
   cimg_vsnprintf(message,message.width(),format,ap);
   if (message[message.width() - 2]) cimg::strellipsize(message,message.width() - 2);
@@ -3334,14 +4527,14 @@ gmic& gmic::debug(const char *format, ...) {
 // For image-encoded variables, only the string header is returned.
 // Returned image is a shared image, when possible.
 CImg<char> gmic::get_variable(const char *const name,
-                              const unsigned int *const variables_sizes,
+                              const unsigned int *const variables_scope,
                               const CImgList<char> *const images_names) const {
   CImg<char> res;
   const unsigned int hash = hashcode(name,true);
   const bool
     is_global = *name=='_',
     is_thread_global = is_global && name[1]=='_';
-  const int l_max = is_global || !variables_sizes?0:(int)variables_sizes[hash];
+  const int l_max = is_global?0:(int)variables_bound(hash,variables_scope);
   if (is_thread_global) cimg::mutex(30);
   const CImgList<char>
     &__variables = *variables[hash],
@@ -3378,6 +4571,44 @@ CImg<char> gmic::get_variable(const char *const name,
   return res;
 }
 
+// Manage scopes of local variables.
+//----------------------------------
+// Local variables defined in a scope are appended at the end of their slots. Table 'variables_scopes' stores,
+// for each slot, the level of the last scope that defined a variable in it, and the slot size at that time.
+// Previous values are pushed in 'variables_log', so that leaving a scope only restores the slots it modified.
+
+// Return index of the first variable of slot 'hash' that is visible from the specified scope.
+unsigned int gmic::variables_bound(const unsigned int hash, const unsigned int *const variables_scope) const {
+  if (!variables_scope || !*variables_scope) return 0; // Top-level scope: all variables are visible
+  return variables_scopes(hash,0)==*variables_scope?variables_scopes(hash,1):variables[hash]->size();
+}
+
+// Register slot 'hash' before a new local variable is defined in it.
+void gmic::mark_variables_slot(const unsigned int hash, const unsigned int *const variables_scope) {
+  if (!variables_scope || !*variables_scope || variables_scopes(hash,0)==*variables_scope) return;
+  if (nb_variables_log>=variables_log._height)
+    variables_log.resize(3,std::max(2*variables_log._height,64U),1,1,0);
+  unsigned int *const vl = variables_log.data(0,nb_variables_log++);
+  vl[0] = hash; vl[1] = variables_scopes(hash,0); vl[2] = variables_scopes(hash,1);
+  variables_scopes(hash,0) = *variables_scope;
+  variables_scopes(hash,1) = variables[hash]->size();
+}
+
+// Remove local variables registered after the specified log position, and restore the corresponding slots.
+void gmic::unroll_variables_log(const unsigned int nb_log) {
+  while (nb_variables_log>nb_log) {
+    const unsigned int
+      *const vl = variables_log.data(0,--nb_variables_log),
+      hash = *vl, siz = variables_scopes(hash,1);
+    if (variables[hash]->size()>siz) {
+      variables_names[hash]->remove(siz,variables[hash]->size() - 1);
+      variables[hash]->remove(siz,variables[hash]->size() - 1);
+    }
+    variables_scopes(hash,0) = vl[1];
+    variables_scopes(hash,1) = vl[2];
+  }
+}
+
 // Set variable value.
 //--------------------
 // 'operation' can be { 0 (add new variable), '=' (replace or add), '.' (append), ',' (prepend),
@@ -3385,7 +4616,7 @@ CImg<char> gmic::get_variable(const char *const name,
 // Return the new variable value.
 const char *gmic::set_variable(const char *const name, const char operation,
                                const char *const value, const double *const pvalue,
-                               const unsigned int *const variables_sizes) {
+                               const unsigned int *const variables_scope) {
   if (!name || (!value && !pvalue)) return "";
   bool is_name_found = false, is_new_variable = false;
   double lvalue = 0, rvalue = 0;
@@ -3397,7 +4628,7 @@ const char *gmic::set_variable(const char *const name, const char operation,
     is_thread_global = is_global && name[1]=='_';
   if (is_thread_global) cimg::mutex(30);
   const unsigned int hash = hashcode(name,true);
-  const int lind = is_global || !variables_sizes?0:(int)variables_sizes[hash];
+  const int lind = is_global?0:(int)variables_bound(hash,variables_scope);
   CImgList<char>
     &__variables = *variables[hash],
     &__variables_names = *variables_names[hash];
@@ -3408,7 +4639,7 @@ const char *gmic::set_variable(const char *const name, const char operation,
     const char *const cname = value + 8;
     const bool is_cglobal = *cname=='_';
     const unsigned int chash = hashcode(cname,true);
-    const int clind = is_cglobal || !variables_sizes?0:(int)variables_sizes[chash];
+    const int clind = is_cglobal?0:(int)variables_bound(chash,variables_scope);
     CImgList<char>
       &__cvariables = *variables[chash],
       &__cvariables_names = *variables_names[chash];
@@ -3480,6 +4711,7 @@ const char *gmic::set_variable(const char *const name, const char operation,
 
   // Otherwise, create new variable.
   if (is_new_variable) { // New variable
+    if (!is_global) mark_variables_slot(hash,variables_scope);
     ind = __variables.width();
     CImg<char>::string(name).move_to(__variables_names);
     s_value.move_to(__variables);
@@ -3503,7 +4735,7 @@ const char *gmic::set_variable(const char *const name, const char operation,
 }
 
 const char *gmic::set_variable(const char *const name, const CImg<unsigned char>& value,
-                               const unsigned int *const variables_sizes) {
+                               const unsigned int *const variables_scope) {
   if (!name || !value) return "";
   bool is_name_found = false;
   CImg<char> s_value((char*)value.data(),value.width(),value.height(),value.depth(),value.spectrum(),true);
@@ -3513,7 +4745,7 @@ const char *gmic::set_variable(const char *const name, const CImg<unsigned char>
     is_thread_global = is_global && name[1]=='_';
   if (is_thread_global) cimg::mutex(30);
   const unsigned int hash = hashcode(name,true);
-  const int lind = is_global || !variables_sizes?0:(int)variables_sizes[hash];
+  const int lind = is_global?0:(int)variables_bound(hash,variables_scope);
   CImgList<char>
     &__variables = *variables[hash],
     &__variables_names = *variables_names[hash];
@@ -3524,6 +4756,7 @@ const char *gmic::set_variable(const char *const name, const CImg<unsigned char>
     }
   if (is_name_found) s_value.move_to(__variables[ind]); // Update variable
   else  { // New variable
+    if (!is_global) mark_variables_slot(hash,variables_scope);
     ind = __variables.width();
     CImg<char>::string(name).move_to(__variables_names);
     s_value.move_to(__variables);
@@ -3536,7 +4769,7 @@ const char *gmic::set_variable(const char *const name, const CImg<unsigned char>
 //------------------------------------------
 gmic& gmic::add_commands(const char *const data_commands, const char *const commands_file, const bool add_debug_info,
                          unsigned int *count_new, unsigned int *count_replaced,
-                         bool *const is_entrypoint) {
+                         bool *const is_entrypoint, CImgList<char> *const block_warnings) {
   if (!data_commands || !*data_commands) return *this;
   cimg::mutex(23);
   CImg<char> s_body(256*1024), s_line(256*1024), s_name(257), debug_info(32);
@@ -3602,6 +4835,8 @@ gmic& gmic::add_commands(const char *const data_commands, const char *const comm
     if ((!is_last_slash && std::strchr(lines,':') && // Check for a command definition (or implicit '_main_')
          cimg_sscanf(nlines,"%255[a-zA-Z0-9_] %c%262143[^\n]",ns_name,&sep,s_body.data())>=2 &&
          (*nlines<'0' || *nlines>'9') && sep==':' && *s_body!='=') || ((*s_name=0), hash<0)) {
+      if (hash>=0 && block_warnings)
+    check_command_blocks(commands_names[hash][pos],commands[hash][pos],commands_file,*block_warnings);
       const char *_s_body = s_body;
       if (sep==':') while (*_s_body && cimg::is_blank(*_s_body)) ++_s_body;
       CImg<char> body = CImg<char>::string(hash<0 && !*s_name?lines:_s_body);
@@ -3626,6 +4861,9 @@ gmic& gmic::add_commands(const char *const data_commands, const char *const comm
         commands_has_arguments[hash].insert(1,pos);
         if (count_new) ++*count_new;
       } else if (count_replaced) ++*count_replaced;
+      commands_names[hash][pos].assign(); // Unshare previous definition, if any (see 'add_commands_stdlib()')
+      commands_has_arguments[hash][pos].assign();
+      commands[hash][pos].assign();
       CImg<char>::string(s_name).move_to(commands_names[hash][pos]);
       CImg<char>::vector((char)command_has_arguments(body)).
         move_to(commands_has_arguments[hash][pos]);
@@ -3649,6 +4887,8 @@ gmic& gmic::add_commands(const char *const data_commands, const char *const comm
       } else commands[hash][pos].append(body,'x'); // Insert code without debug info
     }
   }
+  if (hash>=0 && block_warnings)
+    check_command_blocks(commands_names[hash][pos],commands[hash][pos],commands_file,*block_warnings);
 
   if (is_debug) {
     CImg<unsigned int> hdist(gmic_comslots);
@@ -3665,11 +4905,70 @@ gmic& gmic::add_commands(const char *const data_commands, const char *const comm
   return *this;
 }
 
+// Check control flow blocks of a custom command, and append a warning message if they are not balanced.
+//--------------------------------------------------------------------------------------------------------
+void gmic::check_command_blocks(const char *const command_name, const char *const body,
+                                const char *const commands_file, CImgList<char>& block_warnings) {
+  const unsigned int o_debug_line = debug_line, o_debug_filename = debug_filename;
+  const int o_verbosity = verbosity;
+  const bool o_is_debug = is_debug, o_is_debug_info = is_debug_info;
+  CImg<char> o_status;
+  status.move_to(o_status); // Save status because 'commands_line_to_CImgList()' may change it, with 'error()'
+  verbosity = -1;
+  is_debug = false;
+  const char *s_block = 0;
+  try {
+    s_block = check_commands_line_blocks(commands_line_to_CImgList(body));
+  } catch (...) { } // Unclosed double quotes are reported when the command is run
+  debug_line = o_debug_line;
+  debug_filename = o_debug_filename;
+  verbosity = o_verbosity;
+  is_debug = o_is_debug;
+  is_debug_info = o_is_debug_info;
+  o_status.move_to(status);
+  if (s_block) {
+    CImg<char> message(std::strlen(command_name) + (commands_file?std::strlen(commands_file):0) + 128);
+    cimg_snprintf(message,message.width(),
+                  "Command '%s'%s%s%s: Unbalanced control flow blocks (unmatched or missing '%s').",
+                  command_name,commands_file?" (file '":"",commands_file?commands_file:"",commands_file?"')":"",
+                  s_block);
+    CImg<char>::string(message).move_to(block_warnings);
+  }
+}
+
+// Add commands of the standard library.
+//---------------------------------------
+// The standard library is parsed only once, by the first instance that needs it.
+// Other instances get shared copies of the parsed commands (as threads of command 'parallel'),
+// so command bodies are not duplicated in memory. Must be called when no commands are defined yet.
+gmic& gmic::add_commands_stdlib() {
+  static CImgList<char> *stdlib_commands = 0, *stdlib_commands_names = 0, *stdlib_commands_has_arguments = 0;
+  cimg::mutex(24);
+  if (!stdlib_commands) {
+    add_commands(decompress_stdlib().data());
+    stdlib_commands = new CImgList<char>[gmic_comslots];
+    stdlib_commands_names = new CImgList<char>[gmic_comslots];
+    stdlib_commands_has_arguments = new CImgList<char>[gmic_comslots];
+    for (unsigned int l = 0; l<gmic_comslots; ++l) {
+      commands[l].move_to(stdlib_commands[l]);
+      commands_names[l].move_to(stdlib_commands_names[l]);
+      commands_has_arguments[l].move_to(stdlib_commands_has_arguments[l]);
+    }
+  }
+  for (unsigned int l = 0; l<gmic_comslots; ++l) {
+    commands[l].assign(stdlib_commands[l],true);
+    commands_names[l].assign(stdlib_commands_names[l],true);
+    commands_has_arguments[l].assign(stdlib_commands_has_arguments[l],true);
+  }
+  cimg::mutex(24,0);
+  return *this;
+}
+
 // Add commands from a file.
 //---------------------------
 gmic& gmic::add_commands(std::FILE *const file, const char *const commands_file, const bool add_debug_info,
                          unsigned int *count_new, unsigned int *count_replaced,
-                         bool *const is_entrypoint) {
+                         bool *const is_entrypoint, CImgList<char> *const block_warnings) {
   if (!file) return *this;
 
   // Try reading it first as a .cimg file.
@@ -3677,7 +4976,7 @@ gmic& gmic::add_commands(std::FILE *const file, const char *const commands_file,
     CImg<char> buffer;
     buffer.load_cimg(file).unroll('x');
     buffer.resize(buffer.width() + 1,1,1,1,0);
-    add_commands(buffer.data(),commands_file,add_debug_info,count_new,count_replaced,is_entrypoint);
+    add_commands(buffer.data(),commands_file,add_debug_info,count_new,count_replaced,is_entrypoint,block_warnings);
   } catch (...) { // If failed, read as a text file
     std::rewind(file);
     std::fseek(file,0,SEEK_END);
@@ -3687,7 +4986,7 @@ gmic& gmic::add_commands(std::FILE *const file, const char *const commands_file,
       CImg<char> buffer((unsigned int)siz + 1);
       if (std::fread(buffer.data(),sizeof(char),siz,file)) {
         buffer[siz] = 0;
-        add_commands(buffer.data(),commands_file,add_debug_info,count_new,count_replaced,is_entrypoint);
+        add_commands(buffer.data(),commands_file,add_debug_info,count_new,count_replaced,is_entrypoint,block_warnings);
       }
     }
   }
@@ -3712,6 +5011,12 @@ CImg<unsigned int> gmic::selection2cimg(const char *const string, const unsigned
     if (ind<index_max) return CImg<unsigned int>::vector(ind);
   }
 
+  // Look for the same selection, already parsed for the same number of items.
+  const unsigned int hash = hashcode(string,false)&(gmic_cacheslots - 1);
+  if (cached_selections_keys[hash] && cached_selections_sizes[hash]==index_max &&
+      !std::strcmp(cached_selections_keys[hash],string))
+    return CImg<unsigned int>(cached_selections[hash],false);
+
   // Manage remaining cases.
   const char *const stype = is_selection?"selection":"subset";
   const int
@@ -3720,7 +5025,7 @@ CImg<unsigned int> gmic::selection2cimg(const char *const string, const unsigned
 
   CImg<bool> is_selected(1,index_max,1,1,false);
   CImg<char> name, item;
-  bool is_inverse = *string=='^';
+  bool is_inverse = *string=='^', has_label = false;
   const char *it = string + (is_inverse?1:0);
   for (bool stopflag = false; !stopflag; ) {
     float ind0 = 0, ind1 = 0, step = 1;
@@ -3757,7 +5062,7 @@ CImg<unsigned int> gmic::selection2cimg(const char *const string, const unsigned
     } else if (cimg_sscanf(item,"%255[a-zA-Z0-9_]%c",name.assign(256).data(),&end)==1 && // Label
                (*name<'0' || *name>'9')) {
       cimglist_for(names,l) if (names[l] && !std::strcmp(names[l],name)) {
-        is_selected(l) = true; is_label = true;
+        is_selected(l) = true; is_label = has_label = true;
       }
       if (!is_label)
         error(true,"Command '%s': Invalid %s %c%s%c (undefined label '%s').",
@@ -3803,6 +5108,12 @@ CImg<unsigned int> gmic::selection2cimg(const char *const string, const unsigned
   index = 0;
   if (is_inverse) { cimg_forY(is_selected,l) if (!is_selected[l]) selection[index++] = (unsigned int)l; }
   else cimg_forY(is_selected,l) if (is_selected[l]) selection[index++] = (unsigned int)l;
+
+  if (!has_label) { // Selections with labels depend on image names and are not cached
+    CImg<char>::string(string).move_to(cached_selections_keys[hash]);
+    cached_selections[hash].assign(selection);
+    cached_selections_sizes[hash] = index_max;
+  }
   return selection;
 }
 
@@ -3902,7 +5213,8 @@ gmic& gmic::print(const CImgList<T>& list, const CImg<unsigned int> *const calls
   if (verbosity<1 && !is_debug) return *this;
   va_list ap;
   va_start(ap,format);
-  CImg<char> message(65536);
+  _gmic_message_buffer message_buffer(65536);
+  CImg<char> &message = message_buffer.message;
   message[message.width() - 2] = 0;
   cimg_vsnprintf(message,message.width(),format,ap);
   strreplace_fw(message);
@@ -3910,6 +5222,11 @@ gmic& gmic::print(const CImgList<T>& list, const CImg<unsigned int> *const calls
   va_end(ap);
 
   // Display message.
+  if (log_callback) {
+    notify_log(0,!callstack_selection || *callstack_selection?callstack2string(callstack_selection).data():0,
+               list.size(),message.data() + (*message=='\r'));
+    return *this;
+  }
   cimg::mutex(29);
   unsigned int &nb_carriages = cimg::output()==stdout?nb_carriages_stdout:nb_carriages_default;
   const bool is_cr = *message=='\r';
@@ -3934,7 +5251,8 @@ gmic& gmic::warn(const CImgList<T>& list, const CImg<unsigned int> *const callst
   if (!force_visible && verbosity<1 && !is_debug) return *this;
   va_list ap;
   va_start(ap,format);
-  CImg<char> message(1024);
+  _gmic_message_buffer message_buffer(1024);
+  CImg<char> &message = message_buffer.message;
   message[message.width() - 2] = 0;
   cimg_vsnprintf(message,message.width(),format,ap);
   strreplace_fw(message);
@@ -3943,6 +5261,11 @@ gmic& gmic::warn(const CImgList<T>& list, const CImg<unsigned int> *const callst
 
   // Display message.
   const CImg<char> s_callstack = callstack2string(callstack_selection);
+  if (log_callback) {
+    notify_log(1,!callstack_selection || *callstack_selection?s_callstack.data():0,
+               list.size(),message.data() + (*message=='\r'));
+    return *this;
+  }
   cimg::mutex(29);
   unsigned int &nb_carriages = cimg::output()==stdout?nb_carriages_stdout:nb_carriages_default;
   const bool is_cr = *message=='\r';
@@ -3977,7 +5300,8 @@ gmic& gmic::error(const bool output_header, const CImgList<T>& list,
                   const char *const command, const char *const format, ...) {
   va_list ap;
   va_start(ap,format);
-  CImg<char> message(1024);
+  _gmic_message_buffer message_buffer(1024);
+  CImg<char> &message = message_buffer.message;
   message[message.width() - 2] = 0;
   cimg_vsnprintf(message,message.width(),format,ap);
   strreplace_fw(message);
@@ -3987,7 +5311,11 @@ gmic& gmic::error(const bool output_header, const CImgList<T>& list,
   // Display message.
   const bool is_cr = *message=='\r';
   const CImg<char> s_callstack = callstack2string(callstack_selection);
-  if (verbosity>=1 || is_debug) {
+  if (log_callback) {
+    if (verbosity>=1 || is_debug)
+      notify_log(2,!callstack_selection || *callstack_selection?s_callstack.data():0,
+                 list.size(),message.data() + (is_cr?1:0));
+  } else if (verbosity>=1 || is_debug) {
     cimg::mutex(29);
     if (is_cr) std::fputc('\r',cimg::output());
     else for (unsigned int i = 0; i<nb_carriages_default; ++i) std::fputc('\n',cimg::output());
@@ -4061,7 +5389,8 @@ gmic& gmic::debug(const CImgList<T>& list, const char *format, ...) {
   if (!is_debug) return *this;
   va_list ap;
   va_start(ap,format);
-  CImg<char> message(1024);
+  _gmic_message_buffer message_buffer(1024);
+  CImg<char> &message = message_buffer.message;
   message[message.width() - 2] = 0;
   cimg_vsnprintf(message,message.width(),format,ap);
   if (message[message.width() - 2]) cimg::strellipsize(message,message.width() - 2);
@@ -4189,6 +5518,7 @@ gmic& gmic::_gmic(const char *const commands_line,
   delete[] _variables_names;
   delete[] variables;
   delete[] _variables_names;
+  delete[] cached_commands_lines;
   commands = new CImgList<char>[gmic_comslots];
   commands_names = new CImgList<char>[gmic_comslots];
   commands_has_arguments = new CImgList<char>[gmic_comslots];
@@ -4209,8 +5539,18 @@ gmic& gmic::_gmic(const char *const commands_line,
     variables_names[l] = &_variables_names[l];
   }
 
+  cached_commands_lines = new CImgList<char>[gmic_cacheslots];
+  cached_commands_lines_keys.assign(gmic_cacheslots);
+  cached_selections_keys.assign(gmic_cacheslots);
+  cached_selections.assign(gmic_cacheslots);
+  cached_selections_sizes.assign(gmic_cacheslots);
+  cached_commands_blocks.assign(gmic_cacheslots);
+  variables_scopes.assign(gmic_varslots/2,2,1,1,0);
+  variables_log.assign();
+
   commands_files.assign();
   callstack.assign();
+  scratch.assign();
   dowhiles.assign();
   fordones.assign();
   foreachdones.assign();
@@ -4235,6 +5575,7 @@ gmic& gmic::_gmic(const char *const commands_line,
 
   nb_dowhiles = nb_fordones = nb_foreachdones = nb_repeatdones = 0;
   nb_carriages_default = nb_carriages_stdout = 0;
+  nb_scratch = nb_variables_log = variables_level = 0;
   debug_filename = debug_line = ~0U;
   cimg_exception_mode = cimg::exception_mode();
 
@@ -4254,11 +5595,14 @@ gmic& gmic::_gmic(const char *const commands_line,
   _is_abort = false;
   is_abort = &_is_abort;
   is_abort_thread = false;
+  progress_callback = 0;
+  log_callback = 0;
+  callback_data = 0;
 
   starting_commands_line = commands_line;
 
   // Import standard library and custom commands.
-  if (include_stdlib) add_commands(gmic::decompress_stdlib().data());
+  if (include_stdlib) add_commands_stdlib();
   add_commands(custom_commands);
 
   // Set pre-defined global variables.
@@ -4441,7 +5785,7 @@ gmic& gmic::display_images(const CImgList<T>& images, const CImgList<char>& imag
   if (!is_display_available) {
     cimg::unused(exit_on_anykey);
     print(images,0,"Display image%s",gmic_selection.data());
-    if (is_verbose) {
+    if (is_verbose && !log_callback) {
       cimg::mutex(29);
       if (XYZ) std::fprintf(cimg::output(),", from point (%u,%u,%u)",XYZ[0],XYZ[1],XYZ[2]);
       std::fprintf(cimg::output()," (console output only, no display %s).\n",
@@ -4487,7 +5831,7 @@ gmic& gmic::display_images(const CImgList<T>& images, const CImgList<char>& imag
   cimg::strellipsize(gmic_names,80,false);
 
   print(images,0,"Display image%s = '%s'",gmic_selection.data(),gmic_names.data());
-  if (is_verbose) {
+  if (is_verbose && !log_callback) {
     cimg::mutex(29);
     if (XYZ) std::fprintf(cimg::output(),", from point (%u,%u,%u).\n",XYZ[0],XYZ[1],XYZ[2]);
     else std::fprintf(cimg::output(),".\n");
@@ -4596,11 +5940,14 @@ template<typename T>
 CImg<char> gmic::substitute_item(const char *const source,
                                  CImgList<T>& images, CImgList<char>& images_names,
                                  CImgList<T>& parent_images, CImgList<char>& parent_images_names,
-                                 const unsigned int *const variables_sizes,
+                                 const unsigned int *const variables_scope,
                                  const CImg<unsigned int> *const command_selection,
                                  const bool is_image_expr) {
   if (!source) return CImg<char>();
-  CImg<char> substituted_items(64), inbraces, substr(40), vs;
+  _gmic_scratch scratch_substitute(scratch,nb_scratch,2);
+  CImg<char> inbraces, vs,
+    &substituted_items = scratch_substitute[0]._width>=64?scratch_substitute[0]:scratch_substitute[0].assign(64),
+    &substr = scratch_substitute[1]._width>=40?scratch_substitute[1]:scratch_substitute[1].assign(40);
   char *ptr_sub = substituted_items.data();
   CImg<unsigned int> _ind;
   const char dot = is_image_expr?'.':0;
@@ -4665,7 +6012,7 @@ CImg<char> gmic::substitute_item(const char *const source,
             }
           }
           inbraces.assign(ptr_beg,l_inbraces + 1).back() = 0;
-          substitute_item(inbraces,images,images_names,parent_images,parent_images_names,variables_sizes,
+          substitute_item(inbraces,images,images_names,parent_images,parent_images_names,variables_scope,
                           command_selection,false).move_to(inbraces);
           strreplace_fw(inbraces);
         }
@@ -5082,7 +6429,7 @@ CImg<char> gmic::substitute_item(const char *const source,
         l_inbraces = (int)(ptr_end - ptr_beg - 1);
         if (l_inbraces>0) {
           inbraces.assign(ptr_beg,l_inbraces + 1).back() = 0;
-          substitute_item(inbraces,images,images_names,parent_images,parent_images_names,variables_sizes,
+          substitute_item(inbraces,images,images_names,parent_images,parent_images_names,variables_scope,
                           command_selection,false).move_to(inbraces);
         }
         is_braces = true;
@@ -5197,7 +6544,7 @@ CImg<char> gmic::substitute_item(const char *const source,
                   (cimg_sscanf(nsource + 1,"%255[a-zA-Z0-9_]",substr.assign(256).data())==1)) &&
                  (*substr<'0' || *substr>'9')) {
         const CImg<char>& name = is_braces?inbraces:substr;
-        CImg<char> value = get_variable(name,variables_sizes,&images_names);
+        CImg<char> value = get_variable(name,variables_scope,&images_names);
         const unsigned int l_name = is_braces?l_inbraces + 3:(unsigned int)std::strlen(name) + 1;
         if (value) {
           if (*value==gmic_store && !std::strncmp(value.data() + 1,"*store/",7) && value[8])
@@ -5210,25 +6557,24 @@ CImg<char> gmic::substitute_item(const char *const source,
       } else if (is_braces) {
         nsource+=l_inbraces + 3;
         if (l_inbraces>0) {
-          const CImgList<char>
-            ncommands_line = commands_line_to_CImgList(strreplace_fw(inbraces));
+          CImgList<char> ncommands_line;
+          CImg<unsigned int> ncommands_blocks;
+          CImg<char> ncommands_key;
+          get_cached_commands_line(strreplace_fw(inbraces),ncommands_line,ncommands_blocks,ncommands_key);
           unsigned int nposition = 0;
           CImg<char>::string("*substitute").move_to(callstack);
-          CImg<unsigned int> nvariables_sizes(gmic_varslots);
-          cimg_forX(nvariables_sizes,l) nvariables_sizes[l] = variables[l]->size();
+          _gmic_variables_scope nvariables_scope(*this);
           const unsigned int psize = images.size();
           _run(ncommands_line,nposition,images,images_names,parent_images,parent_images_names,
-               nvariables_sizes,0,inbraces,command_selection);
+               &nvariables_scope.level,0,inbraces,command_selection,&ncommands_blocks);
           if (images.size()!=psize)
             error(true,images,0,0,
                   "Item substitution '${\"%s\"}': Expression incorrectly changes the number of images (from %u to %u).",
                   cimg::strellipsize(inbraces,64,false),psize,images.size());
-          for (unsigned int l = 0; l<gmic_varslots/2; ++l) if (variables[l]->size()>nvariables_sizes[l]) {
-              variables_names[l]->remove(nvariables_sizes[l],variables[l]->size() - 1);
-              variables[l]->remove(nvariables_sizes[l],variables[l]->size() - 1);
-            }
+          nvariables_scope.leave();
           callstack.remove();
           is_return = false;
+          set_cached_commands_line(ncommands_line,ncommands_blocks,ncommands_key);
         }
         if (status.width()>1)
           CImg<char>(status.data(),(unsigned int)std::strlen(status),1,1,1,true).
@@ -5272,11 +6618,49 @@ gmic& gmic::run(const char *const commands_line,
   return *this;
 }
 
+template<typename T>
+gmic_task gmic::run_async(const char *const commands_line,
+                          gmic_list<T> &images, gmic_list<char> &images_names) {
+  gmic_task task;
+  _gmic_task &st = *new _gmic_task;
+  task._state = (void*)&st;
+  CImg<char>::string(commands_line).move_to(st.commands_line);
+  st.gmic_instance = this;
+  st.images = (void*)&images;
+  st.images_names = (void*)&images_names;
+  bool is_thread = false;
+#if defined(gmic_is_parallel) && defined(PTHREAD_CANCEL_ENABLE)
+  const cimg_uint64 stacksize = (cimg_uint64)8*1024*1024;
+  pthread_attr_t thread_attr;
+  if (!pthread_attr_init(&thread_attr)) {
+    pthread_attr_setstacksize(&thread_attr,stacksize); // Reserve enough stack size for the new thread
+    is_thread = !pthread_create(&st.thread_id,&thread_attr,gmic_task_run<T>,(void*)&st);
+    pthread_attr_destroy(&thread_attr);
+  }
+#elif defined(gmic_is_parallel) && cimg_OS==2
+  st.thread_id = CreateThread(0,8*1024*1024,(LPTHREAD_START_ROUTINE)gmic_task_run<T>,(void*)&st,0,0);
+  is_thread = st.thread_id!=0;
+#endif // #if defined(gmic_is_parallel) && defined(PTHREAD_CANCEL_ENABLE)
+  if (!is_thread) { // No threading available: run synchronously
+    st.is_joined = true;
+    gmic_task_run<T>((void*)&st);
+  }
+  return task;
+}
+
+gmic& gmic::set_callbacks(const gmic_progress_callback p_progress_callback,
+                          const gmic_log_callback p_log_callback, void *const user_data) {
+  progress_callback = p_progress_callback;
+  log_callback = p_log_callback;
+  callback_data = user_data;
+  return *this;
+}
+
 template<typename T>
 gmic& gmic::_run(const gmic_list<char>& commands_line,
                  gmic_list<T> &images, gmic_list<char> &images_names,
                  float *const p_progress, bool *const p_is_abort) {
-  CImg<unsigned int> variables_sizes(gmic_varslots,1,1,1,0);
+  const unsigned int variables_scope = 0;
   unsigned int position = 0;
   setlocale(LC_NUMERIC,"C");
   callstack.assign(1U);
@@ -5303,7 +6687,7 @@ gmic& gmic::_run(const gmic_list<char>& commands_line,
     it+=*it=='-';
     if (!std::strcmp("debug",it)) { is_debug = true; break; }
   }
-  return _run(commands_line,position,images,images_names,images,images_names,variables_sizes,0,0,0);
+  return _run(commands_line,position,images,images_names,images,images_names,&variables_scope,0,0,0);
 }
 
 #if defined(_MSC_VER) && !defined(_WIN64)
@@ -5314,32 +6698,19 @@ template<typename T>
 gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
                  CImgList<T>& images, CImgList<char>& images_names,
                  CImgList<T>& parent_images, CImgList<char>& parent_images_names,
-                 const unsigned int *const variables_sizes,
+                 const unsigned int *const variables_scope,
                  bool *const is_noarg, const char *const parent_arguments,
-                 const CImg<unsigned int> *const command_selection) {
+                 const CImg<unsigned int> *const command_selection, CImg<unsigned int> *const p_blocks) {
   if (*callstack.back()!='*' && (!commands_line || position>=commands_line._width)) {
     if (is_debug) debug(images,"Return from empty command '%s/'.",
                         callstack.back().data());
     return *this;
   }
 
-  // Add current run to managed list of gmic runs.
-  cimg::mutex(24);
-  CImgList<void*> &grl = gmic_runs();
-  const CImg<void*> &grb = grl.back();
-  const bool push_run = !grl || grb[0]!=this || grb[1]!=&images;
-  if (push_run) {
-    CImg<void*> gr(7);
-    gr[0] = (void*)this;
-    gr[1] = (void*)&images;
-    gr[2] = (void*)&images_names;
-    gr[3] = (void*)&parent_images;
-    gr[4] = (void*)&parent_images_names;
-    gr[5] = (void*)variables_sizes;
-    gr[6] = (void*)command_selection;
-    gr.move_to(grl);
-  }
-  cimg::mutex(24,0);
+  // Set context of current run (restored when leaving, even on exceptions).
+  const _gmic_run_context run_context((void*)this,(void*)&images,(void*)&images_names,
+                                      (void*)&parent_images,(void*)&parent_images_names,
+                                      variables_scope,command_selection);
 
   typedef typename cimg::superset<T,float>::type Tfloat;
   typedef typename cimg::superset<T,cimg_long>::type Tlong;
@@ -5353,13 +6724,18 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
   CImgList<char> g_list_c;
   CImgList<T> g_list;
 
-  CImg<unsigned int> ind, ind0, ind1;
+  CImg<unsigned int> ind, ind0, ind1, _blocks, &blocks = p_blocks?*p_blocks:_blocks;
   CImg<unsigned char> g_img_uc;
   CImg<float> vertices;
   CImg<T> g_img;
 
-  CImg<char> name, o_status, _argument_text, _argx, _argy, _argz, _argc, _title, _indices, _message, _formula, _color,
-    _command(257), _s_selection(256);
+  _gmic_scratch scratch_run(scratch,nb_scratch,14);
+  CImg<char> name, o_status,
+    &_argument_text = scratch_run[0], &_argx = scratch_run[1], &_argy = scratch_run[2], &_argz = scratch_run[3],
+    &_argc = scratch_run[4], &_title = scratch_run[5], &_indices = scratch_run[6], &_message = scratch_run[7],
+    &_formula = scratch_run[8], &_color = scratch_run[9], &_item = scratch_run[10], &_argument = scratch_run[11],
+    &_command = scratch_run[12]._width==257?scratch_run[12]:scratch_run[12].assign(257),
+    &_s_selection = scratch_run[13]._width==256?scratch_run[13]:scratch_run[13].assign(256);
   char _c0 = 0,
     *argument_text = &_c0,
     *argx = &_c0,
@@ -5377,7 +6753,8 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
   *_command = '+';
 
 // Macros below allows to allocate memory for string variables only when necessary.
-#define gmic_use_var(name,siz) (name = (name!=&_c0?name:&(*_##name.assign(siz).data() = 0)))
+#define gmic_use_var(name,siz) \
+  (name = (name!=&_c0?name:&(*(_##name._width<(siz)?_##name.assign(siz):_##name).data() = 0)))
 #define gmic_use_argument_text gmic_use_var(argument_text,81)
 #define gmic_use_argx gmic_use_var(argx,256)
 #define gmic_use_argy gmic_use_var(argy,256)
@@ -5388,18 +6765,13 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
 #define gmic_use_message gmic_use_var(message,1024)
 #define gmic_use_formula gmic_use_var(formula,4096)
 #define gmic_use_color gmic_use_var(color,4096)
-#define gmic_if_flr \
-  if ((!_is_get && !std::strcmp("repeat",it)) || \
-      (*it=='l' && ((!std::strncmp("local",it,5) && (!it[5] || it[5]=='.' || it[5]=='[')) || \
-                    (!it[1] || it[1]=='.' || it[1]=='['))) || \
-      (*it=='f' && ((!_is_get && !std::strcmp("for",it)) || \
-                    (!std::strncmp("foreach",it,7) && (!it[7] || it[7]=='.' || it[7]=='[')))))
+#define gmic_skip_block(kind) skip_block(commands_line,blocks,position,kind,next_debug_line,next_debug_filename)
 
   unsigned int next_debug_line = ~0U, next_debug_filename = ~0U, is_high_connectivity, uind = 0,
     boundary = 0, pattern = 0, exit_on_anykey = 0, wind = 0, interpolation = 0, hash = 0;
   char end, sep = 0, sep0 = 0, sep1 = 0, sepx = 0, sepy = 0, sepz = 0, sepc = 0, axis = 0;
   double vmin = 0, vmax = 0, value, value0, value1, nvalue, nvalue0, nvalue1;
-  bool is_cond, _is_get = false, is_end_local = false, check_elif = false, run_entrypoint = false;
+  bool is_cond, is_end_local = false, check_elif = false, run_entrypoint = false;
   float opacity = 0;
   int err;
 
@@ -5461,13 +6833,17 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
         is_debug_info|=get_debug_info(commands_line[position_argument++].data(),next_debug_line,next_debug_filename);
       if (position_argument<commands_line.size()) initial_argument = commands_line[position_argument];
 
-      CImg<char> _item, _argument;
       const bool is_subst_item = (bool)commands_line[position].back();
-      if (is_subst_item)
+      unsigned int l_item;
+      if (is_subst_item) {
         substitute_item(initial_item,images,images_names,parent_images,parent_images_names,
-                        variables_sizes,command_selection,false).move_to(_item);
-      else
-        CImg<char>::string(initial_item).move_to(_item);
+                        variables_scope,command_selection,false).move_to(_item);
+        l_item = _item._width;
+      } else { // Copy item into the buffer of the previous one, if large enough
+        l_item = (unsigned int)std::strlen(initial_item) + 1;
+        if (_item._width<l_item) _item.assign(l_item);
+        std::memcpy(_item,initial_item,l_item);
+      }
 
       char *item = _item;
       const char *argument = initial_argument;
@@ -5580,8 +6956,8 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
         // Extract selection.
         // (same as but faster than 'err = cimg_sscanf(item,"%255[^[]%c%255[a-zA-Z_0-9.eE%^,:+-]%c%c",
         //                                             command,&sep0,s_selection,&sep1,&end);
-        if (selsiz<_item._width) { // Expand size for getting a possibly large selection
-          _s_selection.assign(_item.width());
+        if (selsiz<l_item) { // Expand size for getting a possibly large selection
+          _s_selection.assign(l_item);
           s_selection = _s_selection.data();
           *s_selection = 0;
         }
@@ -5743,7 +7119,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
       }
 
       // Cancellation point.
-      if (*is_abort || is_abort_thread)
+      if (*(volatile bool*)is_abort || is_abort_thread)
         throw CImgAbortException();
 
       // Begin command interpretation.
@@ -6104,6 +7480,93 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
         if (!is_get && item[1]=='r' && item[2]=='e' && item[3]=='a' && item[4]=='k' && !item[5]) // Redirect 'break'
           goto gmic_commands_others;
 
+        // Blend.
+        if (!std::strcmp("blend",command)) {
+          gmic_substitute_args(false);
+          const _gmic_args args(argument);
+          bool is_rgb = false, is_layer_background = false, is_valid_argument = false;
+          int mode = -1;
+          opacity = 1;
+          *argx = 0;
+          ind.assign();
+          unsigned int o = 0; // Is layer specified?
+          if (args.types[0]=='[' && args.get(0,gmic_use_indices,256) &&
+              (ind=selection2cimg(indices,images.size(),images_names,"blend")).height()==1) o = 1;
+          else if (args.types[0]=='s' && args.lengths[0] && args.lengths[0]<=std::min(3U,images._width) &&
+                   !std::strncmp(args.strings[0],"...",args.lengths[0])) { // Layer specified as '.', '..' or '...'
+            ind.assign(1,1,1,1,images.size() - args.lengths[0]);
+            o = 1;
+          }
+          if (args.size<=o + (o?3:2) && (args.size<=o || args.get(o,gmic_use_argx,256)) &&
+              (mode=CImg<T>::gmic_blend_mode(argx,is_rgb))>=0) {
+            is_valid_argument = true;
+            if (args.size>o + 1) {
+              if (args.is_value(o + 1)) opacity = (float)(args.is_percent(o + 1)?args[o + 1]/100:args[o + 1]);
+              else is_valid_argument = !args.lengths[o + 1];
+            }
+            if (args.size>o + 2) {
+              if (args.types[o + 2]=='n') is_layer_background = (bool)args[o + 2];
+              else is_valid_argument&=!args.lengths[o + 2];
+            }
+          }
+
+          // Check that images are G,GA,RGB or RGBA images that can be blended natively.
+          if (is_valid_argument) {
+            if (o) {
+              const unsigned int sl = images[*ind]._spectrum;
+              is_valid_argument = images[*ind] && sl<=4;
+              cimg_forY(selection,l) if (is_valid_argument) {
+                const CImg<T> &img = images[selection[l]];
+                is_valid_argument = img && img._spectrum<=4 && (!is_rgb || std::max(img._spectrum,sl)>=3);
+              }
+            } else if (selection) {
+              unsigned int s = images[selection.back()]._spectrum;
+              is_valid_argument = images[selection.back()] && s<=4;
+              for (int l = selection.height() - 2; l>=0 && is_valid_argument; --l) {
+                const CImg<T> &img = images[selection[l]];
+                const unsigned int nb = std::max(img._spectrum,s)>=3?3:1;
+                is_valid_argument = img && img._spectrum<=4 && (!is_rgb || nb==3);
+                s = nb + (img._spectrum%2?0:1);
+              }
+            }
+          }
+
+          if (is_valid_argument) {
+            if (o) {
+              print(images,0,"Blend %s image%s with %s image [%u], using '%s' mode and opacity %g.",
+                    is_layer_background?"foreground":"background",
+                    gmic_selection.data(),
+                    is_layer_background?"background":"foreground",
+                    *ind,*argx?argx:"alpha",opacity);
+              const CImg<T> layer = gmic_image_arg(*ind);
+              cimg_forY(selection,l) gmic_apply(gmic_blend(layer,(unsigned int)mode,opacity,is_layer_background));
+            } else {
+              print(images,0,"Blend image%s together, using '%s' mode and opacity %g.",
+                    gmic_selection.data(),
+                    *argx?argx:"alpha",opacity);
+              if (selection) {
+                g_img.assign(gmic_check(images[selection.back()]),false);
+                for (int l = selection.height() - 2; l>=0; --l)
+                  gmic_check(images[selection[l]]).get_gmic_blend(g_img,(unsigned int)mode,opacity,false).
+                    move_to(g_img);
+                if (is_get) {
+                  images_names.insert(images_names[selection[0]].get_copymark());
+                  g_img.move_to(images);
+                } else {
+                  g_img.move_to(images[selection[0]]);
+                  remove_images(images,images_names,selection,1,selection.height() - 1);
+                }
+              }
+            }
+            is_change = true; ++position; continue;
+          }
+
+          // When command 'blend' is invoked with a mode that is not pointwise, or with arguments that are
+          // expressions, custom version in stdlib is used rather than the built-in version.
+          is_builtin_command = false;
+          goto gmic_commands_others;
+        }
+
         // Blur.
         if (!std::strcmp("blur",command)) {
           gmic_substitute_args(false);
@@ -6112,24 +7575,15 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
           sep = *argx = 0;
           boundary = 1;
 
-          const char *p_argument = argument;
-          if (cimg_sscanf(argument,"%255[xyzc]%c",gmic_use_argx,&sep)==2 && sep==',') {
-            p_argument+=1 + std::strlen(argx);
-          } else sep = *argx = 0;
-
-          if ((cimg_sscanf(p_argument,"%f%c",
-                           &sigma,&end)==1 ||
-               (cimg_sscanf(p_argument,"%f%c%c",
-                            &sigma,&sep,&end)==2 && sep=='%') ||
-               cimg_sscanf(p_argument,"%f,%u%c",
-                           &sigma,&boundary,&end)==2 ||
-               (cimg_sscanf(p_argument,"%f%c,%u%c",
-                            &sigma,&sep,&boundary,&end)==3 && sep=='%') ||
-               cimg_sscanf(p_argument,"%f,%u,%u%c",
-                           &sigma,&boundary,&is_gaussian,&end)==3 ||
-               (cimg_sscanf(p_argument,"%f%c,%u,%u%c",
-                            &sigma,&sep,&boundary,&is_gaussian,&end)==4 && sep=='%')) &&
-              sigma>=0 && boundary<=3 && is_gaussian<=1) {
+          const _gmic_args args(argument);
+          const unsigned int o = args.size>1 && args.types[0]=='a' && args.get(0,gmic_use_argx,256)?1:0;
+          if (args.match("p|uu",o)) {
+            sigma = (float)args[o];
+            if (args.is_percent(o)) sep = '%';
+            if (args.size>o + 1) boundary = (unsigned int)args[o + 1];
+            if (args.size>o + 2) is_gaussian = (unsigned int)args[o + 2];
+          }
+          if (sigma>=0 && boundary<=3 && is_gaussian<=1) {
             print(images,0,"Blur image%s%s%s%s with standard deviation %g%s, %s boundary conditions "
                   "and %s kernel.",
                   gmic_selection.data(),
@@ -6159,27 +7613,16 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
           sep = *argx = 0;
           boundary = 1;
           value = 1;
-          const char *p_argument = argument;
-          if (cimg_sscanf(argument,"%255[xyzc]%c",gmic_use_argx,&sep)==2 && sep==',') {
-            p_argument+=1 + std::strlen(argx);
-          } else sep = *argx = 0;
-          if ((cimg_sscanf(p_argument,"%f%c",
-                           &sigma,&end)==1 ||
-               (cimg_sscanf(p_argument,"%f%c%c",
-                            &sigma,&sep,&end)==2 && sep=='%') ||
-               cimg_sscanf(p_argument,"%f,%u%c",
-                           &sigma,&order,&end)==2 ||
-               (cimg_sscanf(p_argument,"%f%c,%u%c",
-                            &sigma,&sep,&order,&end)==3 && sep=='%') ||
-               cimg_sscanf(p_argument,"%f,%u,%u%c",
-                           &sigma,&order,&boundary,&end)==3 ||
-               (cimg_sscanf(p_argument,"%f%c,%u,%u%c",
-                            &sigma,&sep,&order,&boundary,&end)==4 && sep=='%') ||
-               cimg_sscanf(p_argument,"%f,%u,%u,%lf%c",
-                           &sigma,&order,&boundary,&value,&end)==4 ||
-               (cimg_sscanf(p_argument,"%f%c,%u,%u,%lf%c",
-                            &sigma,&sep,&order,&boundary,&value,&end)==5 && sep=='%')) &&
-              sigma>=0 && boundary<=3 && order<=2 && value>=0) {
+          const _gmic_args args(argument);
+          const unsigned int o = args.size>1 && args.types[0]=='a' && args.get(0,gmic_use_argx,256)?1:0;
+          if (args.match("p|uuf",o)) {
+            sigma = (float)args[o];
+            if (args.is_percent(o)) sep = '%';
+            if (args.size>o + 1) order = (unsigned int)args[o + 1];
+            if (args.size>o + 2) boundary = (unsigned int)args[o + 2];
+            if (args.size>o + 3) value = args[o + 3];
+          }
+          if (sigma>=0 && boundary<=3 && order<=2 && value>=0) {
             const unsigned int nb_iter = (unsigned int)cimg::round(value);
             print(images,0,"Blur image%s%s%s%s with normalized box filter of size %g%s, order %u and "
                   "%s boundary conditions (%u iteration%s).",
@@ -6203,6 +7646,40 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
           is_change = true; ++position; continue;
         }
 
+        // Box statistics.
+        if (!std::strcmp("boxstats",command)) {
+          gmic_substitute_args(false);
+          float radii[] = { -1,-1,-1 };
+          bool is_percents[] = { false,false,false };
+          unsigned int statistic = 1;
+          const _gmic_args args(argument);
+          if (args.match("p|u")) {
+            radii[0] = radii[1] = radii[2] = (float)args[0];
+            is_percents[0] = is_percents[1] = is_percents[2] = args.is_percent(0);
+            if (args.size>1) statistic = (unsigned int)args[1];
+          } else if (args.match("ppp|u")) {
+            for (unsigned int k = 0; k<3; ++k) { radii[k] = (float)args[k]; is_percents[k] = args.is_percent(k); }
+            if (args.size>3) statistic = (unsigned int)args[3];
+          }
+          if (radii[0]>=0 && radii[1]>=0 && radii[2]>=0 && statistic<=3) {
+            print(images,0,"Compute local %s of image%s, over boxes of radii (%g%s,%g%s,%g%s).",
+                  statistic==0?"sums":statistic==1?"means":statistic==2?"variances":"covariances",
+                  gmic_selection.data(),
+                  radii[0],is_percents[0]?"%":"",
+                  radii[1],is_percents[1]?"%":"",
+                  radii[2],is_percents[2]?"%":"");
+            cimg_forY(selection,l) {
+              const CImg<T> &img = images[selection[l]];
+              const unsigned int
+                rx = (unsigned int)cimg::round(is_percents[0]?radii[0]*img.width()/100:radii[0]),
+                ry = (unsigned int)cimg::round(is_percents[1]?radii[1]*img.height()/100:radii[1]),
+                rz = (unsigned int)cimg::round(is_percents[2]?radii[2]*img.depth()/100:radii[2]);
+              gmic_apply(box_stats(rx,ry,rz,statistic));
+            }
+          } else arg_error("boxstats");
+          is_change = true; ++position; continue;
+        }
+
         // Bitwise right shift.
         gmic_arithmetic_command("bsr",
                                 operator>>=,
@@ -6302,6 +7779,147 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
           ++position; continue;
         }
 
+        // Cache result of a command.
+        if (!std::strcmp("cache",command)) {
+          gmic_substitute_args(false);
+          CImg<char> cached_command = CImg<char>::string(argument), filename, filename_tmp;
+          const char *cache_key = "";
+          float max_size = 1024;
+          char *const s_key = std::strchr(cached_command,',');
+          if (s_key) {
+            *s_key = 0;
+            cache_key = s_key + 1;
+            char *const s_max_size = std::strchr(s_key + 1,',');
+            if (s_max_size) {
+              *s_max_size = 0;
+              if (cimg_sscanf(s_max_size + 1,"%f%c",&max_size,&end)!=1 || max_size<0) arg_error("cache");
+            }
+          }
+          strreplace_fw(cached_command);
+          if (!*cached_command) arg_error("cache");
+
+          // Compute cache key from the command, the user-defined key and the selected images.
+          cimg_uint64 key = cached_command.gmic_hash(gmic_version);
+          key = CImg<char>::string(cache_key).gmic_hash(key);
+          cimg_forY(selection,l) key = gmic_check(images[selection[l]]).gmic_hash(key);
+
+          // Retrieve cache folder.
+          _gmic_variables_scope nvariables_scope(*this);
+          unsigned int nposition = 0;
+          CImg<char>::string("*cache").move_to(callstack);
+          g_list.assign(); g_list_c.assign();
+          hash = hashcode("path_cache",false);
+          if (search_sorted("path_cache",commands_names[hash],commands_names[hash].size(),pattern)) {
+            _run(commands_line_to_CImgList("path_cache"),nposition,g_list,g_list_c,images,images_names,
+                 &nvariables_scope.level,0,0,0);
+            is_return = false;
+          } else CImg<char>::string(path_rc()).move_to(status);
+          callstack.remove();
+          filename.assign(status.width() + 32);
+          cimg_snprintf(filename,filename.width(),"%sgmic_cache_%08x%08x.gmz",
+                        status.data(),(unsigned int)(key>>32),(unsigned int)key);
+          const bool is_hit = cimg::fsize(filename)>0;
+          print(images,0,"Run command '%s' on image%s, with cache file '%s' (%s).",
+                cimg::strellipsize(CImg<char>(cached_command),64,false),gmic_selection.data(),
+                filename.data(),is_hit?"hit":"miss");
+
+          gmic_exception exception;
+          bool is_cached = false;
+          if (is_hit) try { // Load cached images, and mark them as recently used
+              g_list = CImg<T>::get_load_gmz(filename,g_list_c);
+              std::FILE *const file = cimg::std_fopen(filename,"r+b");
+              int c = 0;
+              if (file && (c=std::fgetc(file))!=EOF && !std::fseek(file,0,SEEK_SET)) std::fputc(c,file);
+              if (file) cimg::fclose(file);
+              is_cached = true;
+            } catch (CImgException&) { g_list.assign(); g_list_c.assign(); }
+
+          if (!is_cached) { // Run command on selected images
+            g_list.assign(selection.height());
+            g_list_c.assign(selection.height());
+            cimg_forY(selection,l) {
+              uind = selection[l];
+              if (is_get || images[uind].is_shared()) g_list[l].assign(images[uind],false);
+              else g_list[l].swap(images[uind]);
+              g_list_c[l] = images_names[uind];
+            }
+            CImg<char>::string("*cache").move_to(callstack);
+            try {
+              nposition = 0;
+              --verbosity;
+              _run(commands_line_to_CImgList(cached_command),nposition,g_list,g_list_c,images,images_names,
+                   &nvariables_scope.level,0,0,0);
+            } catch (gmic_exception &e) {
+              cimg::swap(exception._command,e._command);
+              cimg::swap(exception._message,e._message);
+            }
+            ++verbosity;
+            is_return = false;
+            callstack.remove();
+
+            if (!exception._message) try { // Store results in cache, then evict least recently used entries
+                filename_tmp.assign(filename.width() + 32);
+                cimg_snprintf(filename_tmp,filename_tmp.width(),"%s_%s",filename.data(),cimg::filenamerand());
+                CImg<T>::save_gmz(filename_tmp,g_list,g_list_c);
+                std::remove(filename);
+                if (std::rename(filename_tmp,filename)) std::remove(filename_tmp);
+                else if (max_size>0) {
+                  cimg_snprintf(filename_tmp,filename_tmp.width(),"%sgmic_cache_*.gmz",status.data());
+                  const CImgList<char> files = cimg::files(filename_tmp,true,0,true);
+                  CImg<double> entries(files.size(),2);
+                  double cache_size = 0;
+                  int attr[6];
+                  cimglist_for(files,l) {
+                    for (int k = 0; k<6; ++k) attr[k] = k<3?k:k + 1; // Year, month, day, hour, minute, second
+                    cimg::fdate(files[l],attr,6);
+                    entries(l,0) = ((((attr[0]*12. + attr[1])*31 + attr[2])*24 + attr[3])*60 + attr[4])*60 + attr[5];
+                    entries(l,1) = (double)std::max((cimg_int64)0,cimg::fsize(files[l]));
+                    cache_size+=entries(l,1);
+                  }
+                  CImg<unsigned int> permutations;
+                  entries.get_shared_row(0).get_sort(permutations,true);
+                  for (unsigned int l = 0; l<permutations._width && cache_size>max_size*1024.*1024; ++l) {
+                    const unsigned int ind_file = permutations[l];
+                    if (!std::strcmp(files[ind_file],filename)) continue;
+                    if (!std::remove(files[ind_file])) cache_size-=entries(ind_file,1);
+                  }
+                }
+              } catch (CImgException&) {
+                std::remove(filename_tmp);
+                warn(images,0,false,
+                     "Command 'cache': Unable to write cache file '%s'.",
+                     filename.data());
+              }
+          }
+          nvariables_scope.leave();
+
+          // Insert resulting images in the image list.
+          if (is_get) {
+            cimglist_for(g_list_c,l) g_list_c[l].copymark();
+            g_list_c.move_to(images_names,~0U);
+            g_list.move_to(images,~0U);
+          } else {
+            const unsigned int nb = std::min((unsigned int)selection.height(),g_list.size());
+            for (unsigned int i = 0; i<nb; ++i) {
+              uind = selection[i];
+              if (images[uind].is_shared()) images[uind] = g_list[i];
+              else images[uind].swap(g_list[i]);
+              images_names[uind].swap(g_list_c[i]);
+            }
+            if (nb) { g_list.remove(0,nb - 1); g_list_c.remove(0,nb - 1); }
+            if (nb<(unsigned int)selection.height())
+              remove_images(images,images_names,selection,nb,selection.height() - 1);
+            else if (g_list) {
+              const unsigned uind0 = selection?selection.back() + 1:images.size();
+              g_list_c.move_to(images_names,uind0);
+              g_list.move_to(images,uind0);
+            }
+          }
+          g_list.assign(); g_list_c.assign();
+          if (exception._message) throw exception;
+          is_change = true; ++position; continue;
+        }
+
         // Crop.
         if (!std::strcmp("crop",command)) {
           gmic_substitute_args(false);
@@ -6536,6 +8154,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
           name.assign(argument,(unsigned int)std::strlen(argument) + 1);
           const char *arg_command_text = gmic_argument_text_printed();
           unsigned int offset_argument_text = 0, count_new = 0, count_replaced = 0;
+          CImgList<char> block_warnings;
           char *arg_command = name;
           strreplace_fw(arg_command);
 
@@ -6550,7 +8169,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
             print(images,0,"Import commands from file '%s'%s",
                   arg_command_text,
                   add_debug_info?" with debug info":"");
-            add_commands(file,arg_command,add_debug_info,&count_new,&count_replaced);
+            add_commands(file,arg_command,add_debug_info,&count_new,&count_replaced,0,&block_warnings);
             cimg::fclose(file);
 
           } else if (!cimg::strncasecmp(arg_command,"http://",7) ||
@@ -6570,7 +8189,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
               verbosity = 0;
               is_debug = false;
               try {
-                add_commands(file,arg_command,add_debug_info,&count_new,&count_replaced);
+                add_commands(file,arg_command,add_debug_info,&count_new,&count_replaced,0,&block_warnings);
                 cimg::fclose(file);
               } catch (...) {
                 cimg::fclose(file);
@@ -6590,9 +8209,9 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
             print(images,0,"Import custom commands from expression '%s'",
                   arg_command_text);
             cimg::strunescape(arg_command);
-            add_commands(arg_command,0,add_debug_info,&count_new,&count_replaced);
+            add_commands(arg_command,0,add_debug_info,&count_new,&count_replaced,0,&block_warnings);
           }
-          if (is_verbose) {
+          if (is_verbose && !log_callback) {
             unsigned int count_total = 0;
             for (unsigned int l = 0; l<gmic_comslots; ++l) count_total+=commands[l].size();
             cimg::mutex(29);
@@ -6608,6 +8227,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
             std::fflush(cimg::output());
             cimg::mutex(29,0);
           }
+          cimglist_for(block_warnings,l) warn(images,0,false,"%s",block_warnings[l].data());
           ++position; continue;
         }
 
@@ -6627,7 +8247,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
             uind = selection[l];
             CImg<T>& img = gmic_check(images[uind]);
             if (!img.is_CImg3d(is_full_check,&(*gmic_use_message=0))) {
-              if (is_very_verbose) {
+              if (is_very_verbose && !log_callback) {
                 cimg::mutex(29);
                 std::fprintf(cimg::output()," -> invalid.");
                 std::fflush(cimg::output());
@@ -6638,7 +8258,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
                     uind,gmic_selection_err.data(),message);
             }
           }
-          if (is_very_verbose) {
+          if (is_very_verbose && !log_callback) {
             cimg::mutex(29);
             std::fprintf(cimg::output()," -> valid.");
             std::fflush(cimg::output());
@@ -6857,7 +8477,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
               cimg::mutex(29,0);
             }
             for (unsigned int k = 0; k<(unsigned int)nb_frames; ++k) {
-              if (nb_frames>1 && is_verbose) {
+              if (nb_frames>1 && is_verbose && !log_callback) {
                 cimg::mutex(29);
                 std::fprintf(cimg::output(),"\r  > Image %u/%u        ",
                              k + 1,(unsigned int)nb_frames);
@@ -7447,16 +9067,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
                   item);
           check_elif = false;
           if (is_very_verbose) print(images,0,"Reach 'else' block.");
-          for (int nb_levels = 1; nb_levels && position<commands_line.size(); ++position) {
-            it = commands_line[position].data();
-            if (*it==1)
-              is_debug_info|=get_debug_info(commands_line[position].data(),next_debug_line,next_debug_filename);
-            else {
-              it+=*it=='-';
-              if (!std::strcmp("if",it)) ++nb_levels;
-              else if (!std::strcmp("fi",it)) { if (!--nb_levels) --position; }
-            }
-          }
+          position = gmic_skip_block(0);
           continue;
         }
 
@@ -7673,32 +9284,17 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
           bool no_min_max = false;
           sep = sep0 = sep1 = 0;
           value0 = value1 = 0;
-          if (((cimg_sscanf(argument,"%f%c",
-                            &nb_levels,&end)==1 && (no_min_max=true)) ||
-               ((cimg_sscanf(argument,"%f%c%c",
-                             &nb_levels,&sep,&end)==2 && sep=='%') && (no_min_max=true)) ||
-               cimg_sscanf(argument,"%f,%lf,%lf%c",
-                           &nb_levels,&value0,&value1,&end)==3 ||
-               (cimg_sscanf(argument,"%f%c,%lf,%lf%c",
-                            &nb_levels,&sep,&value0,&value1,&end)==4 && sep=='%') ||
-               (cimg_sscanf(argument,"%f,%lf%c,%lf%c",
-                            &nb_levels,&value0,&sep0,&value1,&end)==4 && sep0=='%') ||
-               (cimg_sscanf(argument,"%f%c,%lf%c,%lf%c",
-                            &nb_levels,&sep,&value0,&sep0,&value1,&end)==5 && sep=='%' &&
-                sep0=='%') ||
-               (cimg_sscanf(argument,"%f,%lf,%lf%c%c",
-                            &nb_levels,&value0,&value1,&sep1,&end)==4 && sep1=='%') ||
-               (cimg_sscanf(argument,"%f%c,%lf,%lf%c%c",
-                            &nb_levels,&sep,&value0,&value1,&sep1,&end)==5 && sep=='%' &&
-                sep1=='%') ||
-               (cimg_sscanf(argument,"%f,%lf%c,%lf%c%c",
-                            &nb_levels,&value0,&sep0,&value1,&sep1,&end)==5 && sep0=='%' &&
-                sep1=='%') ||
-               (cimg_sscanf(argument,"%f%c,%lf%c,%lf%c%c",
-                            &nb_levels,&sep,&value0,&sep0,&value1,&sep1,&end)==6 && sep=='%' &&
-                sep0=='%' && sep1=='%')) &&
-              nb_levels>=0.5) { nb_levels = cimg::round(nb_levels); ++position; }
-          else { nb_levels = 256; value0 = 0; value1 = 100; sep = 0; sep0 = sep1 = '%'; }
+          const _gmic_args args(argument);
+          if ((args.match("p") || args.match("ppp")) && (nb_levels = (float)args[0])>=0.5) {
+            nb_levels = cimg::round(nb_levels);
+            if (args.is_percent(0)) sep = '%';
+            if (args.size==1) no_min_max = true;
+            else {
+              value0 = args[1]; if (args.is_percent(1)) sep0 = '%';
+              value1 = args[2]; if (args.is_percent(2)) sep1 = '%';
+            }
+            ++position;
+          } else { nb_levels = 256; value0 = 0; value1 = 100; sep = 0; sep0 = sep1 = '%'; }
           if (no_min_max) { value0 = 0; value1 = 100; sep0 = sep1 = '%'; }
           print(images,0,"Equalize histogram of image%s, with %g%s levels in range [%g%s,%g%s].",
                 gmic_selection.data(),
@@ -7829,20 +9425,10 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
           ++position;
 
           if (!is_cond) {
-            int nb_levels = 0;
-            for (nb_levels = 1; nb_levels && position<commands_line.size(); ++position) {
-              it = commands_line[position].data();
-              if (*it==1)
-                is_debug_info|=get_debug_info(commands_line[position].data(),next_debug_line,next_debug_filename);
-              else {
-                _is_get = *it=='+';
-                it+=(_is_get || *it=='-');
-                gmic_if_flr ++nb_levels; else if ((*it=='}' && !it[1]) || !std::strcmp("done",it)) --nb_levels;
-              }
-            }
-            if (nb_levels)
+            if ((position = gmic_skip_block(2))>=commands_line.size())
               error(true,images,0,0,
                     "Command 'for': Missing associated 'done' command.");
+            ++position;
             if (!is_first) { --nb_fordones; callstack.remove(); }
           } else if (is_first) {
             if (is_debug_info && debug_line!=~0U) {
@@ -7863,21 +9449,10 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
         if (!std::strcmp("foreach",command)) {
           if (!selection) {
             if (is_very_verbose) print(images,0,"Skip 'foreach...done' block.");
-            int nb_levels = 0;
-            for (nb_levels = 1; nb_levels && position<commands_line.size(); ++position) {
-              it = commands_line[position].data();
-              if (*it==1)
-                is_debug_info|=get_debug_info(commands_line[position].data(),next_debug_line,next_debug_filename);
-              else {
-                _is_get = *it=='+';
-                it+=(_is_get || *it=='-');
-                gmic_if_flr ++nb_levels;
-                else if (!_is_get && ((*it=='}' && !it[1]) || !std::strcmp("done",it))) --nb_levels;
-              }
-            }
-            if (nb_levels)
+            if ((position = gmic_skip_block(2))>=commands_line.size())
               error(true,images,0,0,
                     "Command 'foreach': Missing associated 'done' command.");
+            ++position;
           } else {
             if (is_debug_info && debug_line!=~0U) {
               gmic_use_argx;
@@ -7929,34 +9504,18 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
               try {
                 if (next_debug_line!=~0U) { debug_line = next_debug_line; next_debug_line = ~0U; }
                 if (next_debug_filename!=~0U) { debug_filename = next_debug_filename; next_debug_filename = ~0U; }
-                _run(commands_line,position = _position,g_list,g_list_c,images,images_names,variables_sizes,is_noarg,0,
-                     command_selection);
+                _run(commands_line,position = _position,g_list,g_list_c,images,images_names,variables_scope,is_noarg,0,
+                     command_selection,&blocks);
               } catch (gmic_exception &e) {
                 check_elif = false;
-                int nb_levels = 0;
-                for (nb_levels = 1; nb_levels && position<commands_line.size(); ++position) {
-                  it = commands_line[position].data();
-                  if (*it==1)
-                    is_debug_info|=get_debug_info(commands_line[position].data(),next_debug_line,next_debug_filename);
-                  else {
-                    _is_get = *it=='+';
-                    if (*it==1)
-                      is_debug_info|=get_debug_info(commands_line[position].data(),next_debug_line,next_debug_filename);
-                    else {
-                      it+=(_is_get || *it=='-');
-                      gmic_if_flr ++nb_levels;
-                      else if (!_is_get && ((*it=='}' && !it[1]) || !std::strcmp("done",it))) --nb_levels;
-                      else if (!_is_get && nb_levels==1 && !std::strcmp("onfail",it)) break;
-                    }
-                  }
-                }
-                if (nb_levels==1 && position<commands_line.size()) { // Onfail block found
+                if ((position = gmic_skip_block(3))<commands_line.size() &&
+                    _gmic_block_type(commands_line[position])==_gmic_onfail) { // Onfail block found
                   verbosity = o_verbosity; // Restore verbosity
                   if (is_very_verbose) print(images,0,"Reach 'onfail' block.");
                   is_cond = true;
                   try {
                     _run(commands_line,++position,g_list,g_list_c,
-                         parent_images,parent_images_names,variables_sizes,is_noarg,0,0);
+                         parent_images,parent_images_names,variables_scope,is_noarg,0,0,&blocks);
                   } catch (gmic_exception &e2) {
                     cimg::swap(exception._command,e2._command);
                     cimg::swap(exception._message,e2._message);
@@ -8009,6 +9568,123 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
           continue;
         }
 
+        // Foreach (parallel).
+        if (!std::strcmp("foreach_parallel",command)) {
+          const unsigned int _position = position;
+          if ((position = gmic_skip_block(2))>=commands_line.size())
+            error(true,images,0,0,
+                  "Command 'foreach_parallel': Missing associated 'done' command.");
+          ++position;
+          if (!selection) {
+            if (is_very_verbose) print(images,0,"Skip 'foreach_parallel...done' block.");
+            continue;
+          }
+          unsigned int nb_threads = 0;
+          if (cimg_sscanf(get_variable("_cpus"),"%u%c",&nb_threads,&end)!=1 || !nb_threads)
+            nb_threads = cimg::nb_cpus();
+          nb_threads = std::min((unsigned int)selection.height(),nb_threads);
+          print(images,0,"Run 'foreach_parallel...done' block on image%s, with %u thread%s.",
+                gmic_selection.data(),nb_threads,nb_threads>1?"s":"");
+
+          // Move selected images to their own lists.
+          _gmic_foreach<T> fe(selection.height());
+          fe.images = &images;
+          fe.images_names = &images_names;
+          fe.parent_images = &parent_images;
+          fe.parent_images_names = &parent_images_names;
+          fe.command_selection = command_selection;
+          fe.commands_line = &commands_line;
+          fe.blocks = &blocks;
+          fe.position = _position;
+          cimg::mutex(27);
+          if (!is_get) cimg_forY(selection,l) {
+              const CImg<T> &img = images[selection[l]];
+              if (!img.is_shared() && (img.width() || img.height()) && !img._spectrum) {
+                cimg::mutex(27,0);
+                selection2string(selection,images_names,1,name);
+                error(true,images,0,0,
+                      "Command 'foreach_parallel': Invalid selection%s "
+                      "(image [%u] is already used in another thread).",
+                      name.data() + (*name=='s'?1:0),selection[l]);
+              }
+            }
+          cimg_forY(selection,l) {
+            uind = selection[l];
+            CImgList<T> &f_list = fe.g_lists[l];
+            if (is_get || images[uind].is_shared()) f_list.assign(images[uind]);
+            else {
+              images[uind].move_to(f_list);
+              fe.is_moved[l] = 1;
+
+              // Small hack to be able to track images of the selection passed to the new environment.
+              std::memcpy(&images[uind]._width,&f_list[0]._data,sizeof(void*));
+              images[uind]._spectrum = 0;
+            }
+            fe.g_lists_c[l].assign(images_names[uind]);
+          }
+          cimg::mutex(27,0);
+
+          // Run workers, with a copy of the local variables visible from the current scope.
+          if (!foreach_workers) foreach_workers = (void*)new _gmic_worker_pool;
+          _gmic_worker_pool &workers = *(_gmic_worker_pool*)foreach_workers;
+          workers.reserve(nb_threads);
+          for (unsigned int w = 0; w<nb_threads; ++w) {
+            gmic &gmic_instance = workers.worker(w).gmic_instance;
+            init_thread(gmic_instance);
+            for (unsigned int i = 0; i<gmic_varslots/2; ++i) {
+              const unsigned int bound = variables_bound(i,variables_scope), nb_vars = variables[i]->size();
+              if (bound<nb_vars) {
+                variables[i]->get_images(bound,nb_vars - 1).move_to(gmic_instance._variables[i]);
+                variables_names[i]->get_images(bound,nb_vars - 1).move_to(gmic_instance._variables_names[i]);
+              } else {
+                gmic_instance._variables[i].assign();
+                gmic_instance._variables_names[i].assign();
+              }
+            }
+          }
+          workers.run(nb_threads,gmic_foreach_job<T>,(void*)&fe);
+          for (unsigned int w = 0; w<nb_threads; ++w) is_change|=workers.worker(w).gmic_instance.is_change;
+
+          // Transfer back images to the image list, in selection order.
+          int off = 0;
+          cimg::mutex(27);
+          cimg_forY(selection,l) {
+            uind = selection[l] + off;
+            CImgList<T> &f_list = fe.g_lists[l];
+            CImgList<char> &f_list_c = fe.g_lists_c[l];
+            if (is_get) { // Images that have not been processed, or that follow a stop, are discarded
+              if ((unsigned int)l<fe.ind_next && (unsigned int)l<=fe.ind_stop) {
+                f_list.move_to(images,~0U);
+                f_list_c.move_to(images_names,~0U);
+              }
+            } else if ((unsigned int)l>fe.ind_stop && (unsigned int)l<fe.ind_next) {
+              // Image processed after a stop: restore its input (shared images are left unchanged).
+              if (fe.is_moved[l]) fe.g_backups[l][0].move_to(images[uind]);
+            } else {
+              if (!f_list) {
+                images.remove(uind);
+                images_names.remove(uind);
+                --off;
+              } else if (f_list.size()==1) {
+                f_list[0].move_to(images[uind]);
+                f_list_c[0].move_to(images_names[uind]);
+              } else {
+                images.remove(uind);
+                images_names.remove(uind);
+                off+=f_list.width() - 1;
+                f_list.move_to(images,uind);
+                f_list_c.move_to(images_names,uind);
+              }
+            }
+            f_list.assign();
+            f_list_c.assign();
+          }
+          cimg::mutex(27,0);
+          if (fe.ind_next) fe.statuses[std::min(fe.ind_stop,fe.ind_next - 1)].move_to(status);
+          if (fe.exception._message) throw fe.exception;
+          continue;
+        }
+
         // Fill.
         if (!std::strcmp("fill",command)) {
           gmic_substitute_args(true);
@@ -8859,7 +10535,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
             g_list.swap(images);
             g_list_c.swap(images_names);
           }
-          if (is_verbose) {
+          if (is_verbose && !log_callback) {
             cimg::mutex(29);
             std::fprintf(cimg::output()," (%u image%s left).",
                          images.size(),images.size()==1?"":"s");
@@ -8923,33 +10599,17 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
           try {
             if (next_debug_line!=~0U) { debug_line = next_debug_line; next_debug_line = ~0U; }
             if (next_debug_filename!=~0U) { debug_filename = next_debug_filename; next_debug_filename = ~0U; }
-            _run(commands_line,position,g_list,g_list_c,images,images_names,variables_sizes,is_noarg,0,
-                 command_selection);
+            _run(commands_line,position,g_list,g_list_c,images,images_names,variables_scope,is_noarg,0,
+                 command_selection,&blocks);
           } catch (gmic_exception &e) {
             check_elif = false;
-            int nb_levels = 0;
-            for (nb_levels = 1; nb_levels && position<commands_line.size(); ++position) {
-              it = commands_line[position].data();
-              if (*it==1)
-                is_debug_info|=get_debug_info(commands_line[position].data(),next_debug_line,next_debug_filename);
-              else {
-                _is_get = *it=='+';
-                if (*it==1)
-                  is_debug_info|=get_debug_info(commands_line[position].data(),next_debug_line,next_debug_filename);
-                else {
-                  it+=(_is_get || *it=='-');
-                  gmic_if_flr ++nb_levels;
-                  else if (!_is_get && ((*it=='}' && !it[1]) || !std::strcmp("done",it))) --nb_levels;
-                  else if (!_is_get && nb_levels==1 && !std::strcmp("onfail",it)) break;
-                }
-              }
-            }
-            if (nb_levels==1 && position<commands_line.size()) { // Onfail block found
+            if ((position = gmic_skip_block(3))<commands_line.size() &&
+                _gmic_block_type(commands_line[position])==_gmic_onfail) { // Onfail block found
               verbosity = o_verbosity; // Restore verbosity
               if (is_very_verbose) print(images,0,"Reach 'onfail' block.");
               try {
                 _run(commands_line,++position,g_list,g_list_c,
-                     parent_images,parent_images_names,variables_sizes,is_noarg,0,0);
+                     parent_images,parent_images_names,variables_scope,is_noarg,0,0,&blocks);
               } catch (gmic_exception &e2) {
                 cimg::swap(exception._command,e2._command);
                 cimg::swap(exception._message,e2._message);
@@ -9710,22 +11370,19 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
         if (!std::strcmp("normalize",command)) {
           gmic_substitute_args(true);
           ind0.assign(); ind1.assign();
-          sep0 = sep1 = *argx = *argy = *indices = 0;
+          sep0 = sep1 = *indices = 0;
           value0 = value1 = value = 0;
-          if ((cimg_sscanf(argument,"%255[][a-zA-Z0-9_.eE%+-],%255[][a-zA-Z0-9_.eE%+-]%c",
-                           gmic_use_argx,gmic_use_argy,&end)==2 ||
-               cimg_sscanf(argument,"%255[][a-zA-Z0-9_.eE%+-],%255[][a-zA-Z0-9_.eE%+-],%lf%c",
-                           argx,argy,&value,&end)==3) &&
-              ((cimg_sscanf(argx,"[%255[a-zA-Z0-9_.%+-]%c%c",gmic_use_indices,&sep0,&end)==2 &&
-                sep0==']' &&
+          const _gmic_args args(argument);
+          if (args.match("**|f") &&
+              ((args.types[0]=='[' && args.get(0,gmic_use_indices,256) &&
                 (ind0=selection2cimg(indices,images.size(),images_names,"normalize")).height()==1) ||
-               (cimg_sscanf(argx,"%lf%c%c",&value0,&sep0,&end)==2 && sep0=='%') ||
-               cimg_sscanf(argx,"%lf%c",&value0,&end)==1) &&
-              ((cimg_sscanf(argy,"[%255[a-zA-Z0-9_.%+-]%c%c",gmic_use_formula,&sep1,&end)==2 &&
-                sep1==']' &&
+               args.is_value(0)) &&
+              ((args.types[1]=='[' && args.get(1,gmic_use_formula,256) &&
                 (ind1=selection2cimg(formula,images.size(),images_names,"normalize")).height()==1) ||
-               (cimg_sscanf(argy,"%lf%c%c",&value1,&sep1,&end)==2 && sep1=='%') ||
-               cimg_sscanf(argy,"%lf%c",&value1,&end)==1)) {
+               args.is_value(1))) {
+            value0 = args[0]; if (args.is_percent(0)) sep0 = '%';
+            value1 = args[1]; if (args.is_percent(1)) sep1 = '%';
+            if (args.size>2) value = args[2];
             if (ind0) { value0 = images[*ind0].min(); sep0 = 0; }
             if (ind1) { value1 = images[*ind1].max(); sep1 = 0; }
             print(images,0,"Normalize image%s in range [%g%s,%g%s], with constant-case ratio %g.",
@@ -9744,8 +11401,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
               }
               gmic_apply(normalize((T)nvalue0,(T)nvalue1,(float)value));
             }
-          } else if (cimg_sscanf(argument,"[%255[a-zA-Z0-9_.%+-]%c%c",gmic_use_indices,&sep0,&end)==2 &&
-                     sep0==']' &&
+          } else if (args.match("i") && args.get(0,gmic_use_indices,256) &&
                      (ind0=selection2cimg(indices,images.size(),images_names,"normalize")).height()==1) {
             if (images[*ind0]) value1 = (double)images[*ind0].max_min(value0);
             print(images,0,"Normalize image%s in range [%g,%g].",
@@ -9834,19 +11490,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
           if (s[0]!='*' || (s[1]!='l' && (s[1]!='f' || s[4]!='e')))
             error(true,images,0,0,
                   "Command 'onfail': Not associated to a 'foreach' or 'local' command within the same scope.");
-          for (int nb_levels = 1; nb_levels && position<commands_line.size(); ++position) {
-            it = commands_line[position].data();
-            if (*it==1)
-              is_debug_info|=get_debug_info(commands_line[position].data(),next_debug_line,next_debug_filename);
-            else {
-              _is_get = *it=='+';
-              it+=(_is_get || *it=='-');
-              gmic_if_flr ++nb_levels;
-              else if (!_is_get && ((*it=='}' && !it[1]) || !std::strcmp("done",it))) {
-                --nb_levels; if (!nb_levels) --position;
-              }
-            }
-          }
+          position = gmic_skip_block(2);
           continue;
         }
 
@@ -10569,7 +12213,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
               const CImgList<char> ncommands_line = commands_line_to_CImgList(formula);
               unsigned int nposition = 0;
               CImg<char>::string("").move_to(callstack); // Anonymous scope
-              _run(ncommands_line,nposition,images,images_names,images,images_names,variables_sizes,0,0,0);
+              _run(ncommands_line,nposition,images,images_names,images,images_names,variables_scope,0,0,0);
               callstack.remove();
 
             } else { // Not found -> Try generic image saver
@@ -10710,57 +12354,10 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
             // Prepare thread structures.
             cimg_forY(_gmic_threads,l) {
               gmic &gmic_instance = _gmic_threads[l].gmic_instance;
-              for (unsigned int i = 0; i<gmic_comslots; ++i) {
-                gmic_instance.commands[i].assign(commands[i],true);
-                gmic_instance.commands_names[i].assign(commands_names[i],true);
-                gmic_instance.commands_has_arguments[i].assign(commands_has_arguments[i],true);
-              }
-              for (unsigned int i = 0; i<gmic_varslots; ++i) {
-                if (i>=6*gmic_varslots/7) { // Share inter-thread global variables
-                  gmic_instance.variables[i] = variables[i];
-                  gmic_instance.variables_names[i] = variables_names[i];
-                } else {
-                  if (i>=gmic_varslots/2) { // Make a copy of single-thread global variables
-                    gmic_instance._variables[i].assign(_variables[i]);
-                    gmic_instance._variables_names[i].assign(_variables_names[i]);
-                    _gmic_threads[l].variables_sizes[i] = variables_sizes[i];
-                  } else _gmic_threads[l].variables_sizes[i] = 0;
-                  gmic_instance.variables[i] = &gmic_instance._variables[i];
-                  gmic_instance.variables_names[i] = &gmic_instance._variables_names[i];
-                }
-              }
-              gmic_instance.callstack.assign(callstack);
-              gmic_instance.commands_files.assign(commands_files,true);
+              init_thread(gmic_instance);
               gmic_use_title;
               cimg_snprintf(title,_title.width(),"*thread%d",l);
               CImg<char>::string(title).move_to(gmic_instance.callstack);
-              gmic_instance.light3d.assign(light3d);
-              gmic_instance.status.assign(status);
-              gmic_instance.debug_filename = debug_filename;
-              gmic_instance.debug_line = debug_line;
-              gmic_instance.focale3d = focale3d;
-              gmic_instance.light3d_x = light3d_x;
-              gmic_instance.light3d_y = light3d_y;
-              gmic_instance.light3d_z = light3d_z;
-              gmic_instance.specular_lightness3d = specular_lightness3d;
-              gmic_instance.specular_shininess3d = specular_shininess3d;
-              gmic_instance._progress = 0;
-              gmic_instance.progress = &gmic_instance._progress;
-              gmic_instance.is_change = is_change;
-              gmic_instance.is_debug = is_debug;
-              gmic_instance.is_start = false;
-              gmic_instance.is_quit = false;
-              gmic_instance.is_return = false;
-              gmic_instance.is_double3d = is_double3d;
-              gmic_instance.verbosity = verbosity;
-              gmic_instance.render3d = render3d;
-              gmic_instance.renderd3d = renderd3d;
-              gmic_instance._is_abort = _is_abort;
-              gmic_instance.is_abort = is_abort;
-              gmic_instance.is_abort_thread = false;
-              gmic_instance.nb_carriages_default = nb_carriages_default;
-              gmic_instance.nb_carriages_stdout = nb_carriages_stdout;
-              gmic_instance.reference_time = reference_time;
               _gmic_threads[l].images = &images;
               _gmic_threads[l].images_names = &images_names;
               _gmic_threads[l].parent_images = &parent_images;
@@ -10781,28 +12378,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
             }
 
             // Run threads.
-            cimg_forY(_gmic_threads,l) {
-#ifdef gmic_is_parallel
-#ifdef PTHREAD_CANCEL_ENABLE
-
-#if defined(__MACOSX__) || defined(__APPLE__)
-              const cimg_uint64 stacksize = (cimg_uint64)8*1024*1024;
-              pthread_attr_t thread_attr;
-              if (!pthread_attr_init(&thread_attr) && !pthread_attr_setstacksize(&thread_attr,stacksize))
-                // Reserve enough stack size for the new thread.
-                pthread_create(&_gmic_threads[l].thread_id,&thread_attr,gmic_parallel<T>,(void*)&_gmic_threads[l]);
-              else
-#endif // #if defined(__MACOSX__) || defined(__APPLE__)
-                pthread_create(&_gmic_threads[l].thread_id,0,gmic_parallel<T>,(void*)&_gmic_threads[l]);
-
-#elif cimg_OS==2 // #ifdef PTHREAD_CANCEL_ENABLE
-              _gmic_threads[l].thread_id = CreateThread(0,0,(LPTHREAD_START_ROUTINE)gmic_parallel<T>,
-                                                        (void*)&_gmic_threads[l],0,0);
-#endif // #ifdef PTHREAD_CANCEL_ENABLE
-#else // #ifdef gmic_is_parallel
-              gmic_parallel<T>((void*)&_gmic_threads[l]);
-#endif // #ifdef gmic_is_parallel
-            }
+            cimg_forY(_gmic_threads,l) gmic_parallel_start(_gmic_threads[l]);
 
             // Wait threads if immediate waiting mode selected.
             if (wait_mode) {
@@ -10855,6 +12431,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
           else
             print(images,0,"Disable progress index.");
           *progress = (float)value;
+          if (progress_callback) progress_callback(*progress,callback_data);
           ++position; continue;
         }
 
@@ -11139,7 +12716,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
             g_list.move_to(images,0);
             g_list_c.move_to(images_names,0);
           }
-          if (is_verbose) {
+          if (is_verbose && !log_callback) {
             cimg::mutex(29);
             std::fprintf(cimg::output()," (%u image%s left).",
                          images.size(),images.size()==1?"":"s");
@@ -11171,21 +12748,10 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
 
           if (!nb) {
             if (is_very_verbose) print(images,0,"Skip 'repeat...done' block (0 iterations).");
-            int nb_levels = 0;
-            for (nb_levels = 1; nb_levels && position<commands_line.size(); ++position) {
-              it = commands_line[position].data();
-              if (*it==1)
-                is_debug_info|=get_debug_info(commands_line[position].data(),next_debug_line,next_debug_filename);
-              else {
-                _is_get = *it=='+';
-                it+=(_is_get || *it=='-');
-                gmic_if_flr ++nb_levels;
-                else if (!_is_get && ((*it=='}' && !it[1]) || !std::strcmp("done",it))) --nb_levels;
-              }
-            }
-            if (nb_levels)
+            if ((position = gmic_skip_block(2))>=commands_line.size())
               error(true,images,0,0,
                     "Command 'repeat': Missing associated 'done' command.");
+            ++position;
           } else {
             if (is_debug_info && debug_line!=~0U) {
               gmic_use_argx;
@@ -11990,7 +13556,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
               name.unroll('y').move_to(g_list);
               g_list.get_serialize((bool)is_compressed,(unsigned int)(9 + std::strlen(formula))).move_to(name);
               std::sprintf(name,"%c*store/%s",gmic_store,_formula.data());
-              set_variable(formula,name,variables_sizes);
+              set_variable(formula,name,variables_scope);
             } else for (unsigned int n = 0; n<pattern; ++n) { // Assignment to multiple variables
               if (!*current)
                 error(true,images,0,0,
@@ -12008,7 +13574,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
               tmp.get_serialize((bool)is_compressed).unroll('x').move_to(name);
               name.resize((unsigned int)(name.width() + 9 + std::strlen(current)),1,1,1,0,0,1);
               std::sprintf(name,"%c*store/%s",gmic_store,current);
-              set_variable(current,name,variables_sizes);
+              set_variable(current,name,variables_scope);
 
               if (saved) { // Other variables names follow
                 *next = saved;
@@ -12859,7 +14425,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
                 }
               }
             }
-            if (is_verbose) {
+            if (is_verbose && !log_callback) {
               cimg::mutex(29);
               unsigned int isiz = 0;
               for (unsigned int l = 0; l<gmic_comslots; ++l) isiz+=commands[l].size();
@@ -13404,18 +14970,12 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
                                               gmic_argument_text_printed(),
                                               is_cond?"holds":"does not hold");
             if (!is_cond) {
-              for (int nb_levels = 1; nb_levels && position<commands_line.size(); ++position) {
+              position = gmic_skip_block(1);
+              if (position<commands_line.size()) {
                 it = commands_line[position].data();
-                if (*it==1)
-                  is_debug_info|=get_debug_info(commands_line[position].data(),next_debug_line,next_debug_filename);
-                else {
-                  it+=*it=='-';
-                  if (!std::strcmp("if",it)) ++nb_levels;
-                  else if (!std::strcmp("fi",it)) { --nb_levels; if (!nb_levels) --position; }
-                  else if (nb_levels==1) {
-                    if (!std::strcmp("else",it)) --nb_levels;
-                    else if (!std::strcmp("elif",it)) { --nb_levels; check_elif = true; --position; }
-                  }
+                it+=*it=='-';
+                if (*it=='e') { // Found 'else' or 'elif'
+                  if (it[2]=='s') ++position; else check_elif = true;
                 }
               }
               continue;
@@ -13445,80 +15005,34 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
             }
             const char *stb = 0, *ste = 0;
             unsigned int callstack_ind = 0;
-            int nb_levels = 0;
             if (callstack_repeat) {
               print(images,0,"%s %scurrent 'repeat...done' block.",
                     Com,is_continue?"to next iteration of ":"");
-              for (nb_levels = 1; nb_levels && position<commands_line.size(); ++position) {
-                it = commands_line[position].data();
-                if (*it==1)
-                  is_debug_info|=get_debug_info(commands_line[position].data(),next_debug_line,next_debug_filename);
-                else {
-                  _is_get = *it=='+';
-                  it+=(_is_get || *it=='-');
-                  gmic_if_flr ++nb_levels;
-                  else if (!_is_get && ((*it=='}' && !it[1]) || !std::strcmp("done",it))) --nb_levels;
-                }
-              }
+              position = gmic_skip_block(2);
               callstack_ind = callstack_repeat;
               stb = "repeat"; ste = "done";
             } else if (callstack_do) {
               print(images,0,"%s %scurrent 'do...while' block.",
                     Com,is_continue?"to next iteration of ":"");
-              for (nb_levels = 1; nb_levels && position<commands_line.size(); ++position) {
-                it = commands_line[position].data();
-                it+=*it=='-';
-                if (!std::strcmp("do",it)) ++nb_levels;
-                else if (!std::strcmp("while",it)) --nb_levels;
-              }
+              position = gmic_skip_block(4);
               callstack_ind = callstack_do;
               stb = "do"; ste = "while";
             } else if (callstack_for) {
               print(images,0,"%s %scurrent 'for...done' block.",
                     Com,is_continue?"to next iteration of ":"");
-              for (nb_levels = 1; nb_levels && position<commands_line.size(); ++position) {
-                it = commands_line[position].data();
-                if (*it==1)
-                  is_debug_info|=get_debug_info(commands_line[position].data(),next_debug_line,next_debug_filename);
-                else {
-                  _is_get = *it=='+';
-                  it+=(_is_get || *it=='-');
-                  gmic_if_flr ++nb_levels;
-                  else if (!_is_get && ((*it=='}' && !it[1]) || !std::strcmp("done",it))) --nb_levels;
-                }
-              }
+              position = gmic_skip_block(2);
               callstack_ind = callstack_for;
               stb = "for"; ste = "done";
             } else if (callstack_foreach) {
               print(images,0,"%s %scurrent 'foreach...done' block.",
                     Com,is_continue?"to next iteration of ":"");
-              for (nb_levels = 1; nb_levels && position<commands_line.size(); ++position) {
-                it = commands_line[position].data();
-                if (*it==1)
-                  is_debug_info|=get_debug_info(commands_line[position].data(),next_debug_line,next_debug_filename);
-                else {
-                  _is_get = *it=='+';
-                  it+=(_is_get || *it=='-');
-                  gmic_if_flr ++nb_levels;
-                  else if (!_is_get && ((*it=='}' && !it[1]) || !std::strcmp("done",it))) --nb_levels;
-                }
-              }
+              position = gmic_skip_block(2);
               callstack_ind = callstack_foreach;
               stb = "foreach"; ste = "done";
             } else if (callstack_local) {
               print(images,0,"%s %scurrent local environment.",
                     Com,is_continue?"to end of ":"");
-              for (nb_levels = 1; nb_levels && position<commands_line.size(); ++position) {
-                it = commands_line[position].data();
-                if (*it==1)
-                  is_debug_info|=get_debug_info(commands_line[position].data(),next_debug_line,next_debug_filename);
-                else {
-                  _is_get = *it=='+';
-                  it+=(_is_get || *it=='-');
-                  gmic_if_flr ++nb_levels;
-                  else if (!_is_get && ((*it=='}' && !it[1]) || !std::strcmp("done",it))) --nb_levels;
-                }
-              }
+              position = gmic_skip_block(2);
               callstack_ind = callstack_local;
               stb = "local"; ste = "done";
             } else {
@@ -13528,9 +15042,10 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
               continue;
             }
 
-            if (nb_levels)
+            if (position>=commands_line.size())
               error(true,images,0,0,
                     "Command '%s': Missing associated '%s' command.",stb,ste);
+            ++position;
             if (is_continue || callstack_local || callstack_foreach) {
               if (callstack_foreach && !is_continue) // Break 'foreach...done' loop
                 foreachdones(2,nb_foreachdones - 1) = 1; // Force loop to end at next 'done'
@@ -13575,7 +15090,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
                               &img1 = uind1!=~0U?gmic_check(images[uind1]):CImg<T>::empty();
               name = images_names[uind0];
               if (uind1!=~0U) { // Complex transform
-                if (is_verbose) {
+                if (is_verbose && !log_callback) {
                   cimg::mutex(29);
                   std::fprintf(cimg::output()," ([%u],[%u])%c",uind0,uind1,
                                l>=selection.height() - 2?'.':',');
@@ -13601,7 +15116,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
                 }
                 ++l;
               } else { // Real transform
-                if (is_verbose) {
+                if (is_verbose && !log_callback) {
                   cimg::mutex(29);
                   std::fprintf(cimg::output()," ([%u],0)%c",uind0,
                                l>=selection.height() - 2?'.':',');
@@ -13682,7 +15197,10 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
 
           if (is_command) {
             bool has_arguments = false, _is_noarg = false;
-            CImg<char> substituted_command(1024);
+            _gmic_scratch scratch_custom(scratch,nb_scratch,2);
+            CImg<char>
+              &substituted_command = scratch_custom[0]._width>=1024?scratch_custom[0]:scratch_custom[0].assign(1024),
+              &substr = scratch_custom[1]._width>=324?scratch_custom[1]:scratch_custom[1].assign(324);
             char *ptr_sub = substituted_command.data();
             const char
               *const command_code = commands[hash_custom][ind_custom].data(),
@@ -13757,7 +15275,6 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
                 CImg<char>(nsource0,(unsigned int)(nsource - nsource0),1,1,1,true).
                   append_string_to(substituted_command,ptr_sub);
               } else { // '$' expression found
-                CImg<char> substr(324);
                 inbraces.assign(1,1,1,1,0);
                 int iind = 0, iind1 = 0, l_inbraces = 0;
                 bool is_braces = false;
@@ -13979,10 +15496,11 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
                     command_name,command_code_text.data());
             }
 
-            const CImgList<char>
-              ncommands_line = commands_line_to_CImgList(substituted_command.data());
-            CImg<unsigned int> nvariables_sizes(gmic_varslots);
-            cimg_forX(nvariables_sizes,l) nvariables_sizes[l] = variables[l]->size();
+            CImgList<char> ncommands_line;
+            CImg<unsigned int> ncommands_blocks;
+            CImg<char> ncommands_key;
+            get_cached_commands_line(substituted_command.data(),ncommands_line,ncommands_blocks,ncommands_key);
+            _gmic_variables_scope nvariables_scope(*this);
             g_list.assign(selection.height());
             g_list_c.assign(selection.height());
 
@@ -14003,8 +15521,8 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
               try {
                 is_debug_info = false;
                 --verbosity;
-                _run(ncommands_line,nposition,g_list,g_list_c,images,images_names,nvariables_sizes,&_is_noarg,
-                     argument,&selection);
+                _run(ncommands_line,nposition,g_list,g_list_c,images,images_names,&nvariables_scope.level,
+                     &_is_noarg,argument,&selection,&ncommands_blocks);
                 ++verbosity;
               } catch (gmic_exception &e) {
                 cimg::swap(exception._command,e._command);
@@ -14040,8 +15558,8 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
               try {
                 is_debug_info = false;
                 --verbosity;
-                _run(ncommands_line,nposition,g_list,g_list_c,images,images_names,nvariables_sizes,&_is_noarg,
-                     argument,&selection);
+                _run(ncommands_line,nposition,g_list,g_list_c,images,images_names,&nvariables_scope.level,
+                     &_is_noarg,argument,&selection,&ncommands_blocks);
                 ++verbosity;
               } catch (gmic_exception &e) {
                 cimg::swap(exception._command,e._command);
@@ -14070,15 +15588,13 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
                 g_list.move_to(images,uind0);
               }
             }
-            for (unsigned int l = 0; l<gmic_varslots/2; ++l) if (variables[l]->size()>nvariables_sizes[l]) {
-                variables_names[l]->remove(nvariables_sizes[l],variables[l]->size() - 1);
-                variables[l]->remove(nvariables_sizes[l],variables[l]->size() - 1);
-              }
+            nvariables_scope.leave();
             callstack.remove();
             debug_filename = previous_debug_filename;
             debug_line = previous_debug_line;
             is_return = false;
             g_list.assign(); g_list_c.assign();
+            set_cached_commands_line(ncommands_line,ncommands_blocks,ncommands_key);
             if (has_arguments && !_is_noarg) ++position;
             if (exception._message) throw exception;
             continue;
@@ -14191,7 +15707,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
 
                 cimglist_for(varnames,k) {
                   const int l = k%varvalues.width();
-                  new_value = set_variable(varnames[k],sep0,varvalues[l],0,variables_sizes);
+                  new_value = set_variable(varnames[k],sep0,varvalues[l],0,variables_scope);
                   if (is_verbose) {
                     cimg::strellipsize(varnames[k],gmic_use_argx,80,true);
                     cimg::strellipsize(varvalues[l],gmic_use_argy,80,true);
@@ -14249,7 +15765,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
                 if (sep0==':' && varnames.width()==1) {
                   new_value = set_variable(varnames[0],sep0,
                                            varvalues_d.value_string(',',0,is_rounded?"%g":"%.17g"),
-                                           0,variables_sizes);
+                                           0,variables_scope);
                   if (is_verbose) {
                     cimg::strellipsize(varnames[0],gmic_use_argx,80,true);
                     cimg::strellipsize(varvalues[0],gmic_use_argy,80,true);
@@ -14263,7 +15779,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
                   cimglist_for(varnames,k) {
                     const int l = k%varvalues_d.height();
                     const double vvd = is_rounded?gmic_round(varvalues_d[l]):varvalues_d[l];
-                    new_value = set_variable(varnames[k],sep0,0,&vvd,variables_sizes);
+                    new_value = set_variable(varnames[k],sep0,0,&vvd,variables_scope);
                     if (is_verbose) {
                       cimg::strellipsize(varnames[k],gmic_use_argx,80,true);
                       cimg::strellipsize(new_value,gmic_use_argz,80,true);
@@ -15090,7 +16606,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
                     _filename0);
           }
           cimg::fclose(gfile);
-          if (is_verbose) {
+          if (is_verbose && !log_callback) {
             unsigned int count_total = 0;
             for (unsigned int l = 0; l<gmic_comslots; ++l) count_total+=commands[l].size();
             cimg::mutex(29);
@@ -15125,7 +16641,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
             const CImgList<char> ncommands_line = commands_line_to_CImgList(formula);
             unsigned int nposition = 0;
             CImg<char>::string("").move_to(callstack); // Anonymous scope
-            _run(ncommands_line,nposition,g_list,g_list_c,images,images_names,variables_sizes,0,0,0);
+            _run(ncommands_line,nposition,g_list,g_list_c,images,images_names,variables_scope,0,0,0);
             callstack.remove();
 
           } else { // Not found -> Try generic image loader
@@ -15219,7 +16735,7 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
         if (is_network_file) std::remove(_filename);  // Clean temporary file if network input
       }
 
-      if (is_verbose) {
+      if (is_verbose && !log_callback) {
         cimg::mutex(29);
         if (g_list) {
           const unsigned int last = g_list.size() - 1;
@@ -15329,14 +16845,14 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
 
           if (is_first3d) {
             CImg<char>::string("").move_to(callstack); // Anonymous scope
-            _run(ncommands_line,nposition,images,images_names,images,images_names,variables_sizes,0,0,0);
+            _run(ncommands_line,nposition,images,images_names,images,images_names,variables_scope,0,0,0);
             callstack.remove();
             if (lselection) display_images(images,images_names,lselection>'y',0,false);
           } else {
             if (lselection) display_images(images,images_names,lselection>'y',0,false);
             if (lselection3d) {
               CImg<char>::string("").move_to(callstack); // Anonymous scope
-              _run(ncommands_line,nposition,images,images_names,images,images_names,variables_sizes,0,0,0);
+              _run(ncommands_line,nposition,images,images_names,images,images_names,variables_scope,0,0,0);
               callstack.remove();
             }
           }
@@ -15362,6 +16878,14 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
         print(images,0,"End G'MIC interpreter.\n");
         is_quit = true;
       }
+      if (is_debug) {
+        cimg_uint64 bytes, peak_bytes, nb_allocations, nb_reuses;
+        cimg::meminfo(bytes,peak_bytes,nb_allocations,nb_reuses);
+        const CImg<char> s_bytes = CImg<char>::string(cimg::strbuffersize((cimg_ulong)bytes));
+        debug(images,"Pixel buffers: %s allocated (peak: %s), " cimg_fuint64 " allocations ("
+              cimg_fuint64 " from pool).",
+              s_bytes.data(),cimg::strbuffersize((cimg_ulong)peak_bytes),nb_allocations,nb_reuses);
+      }
     }
     verbosity = starting_verbosity;
 
@@ -15421,24 +16945,6 @@ gmic& gmic::_run(const CImgList<char>& commands_line, unsigned int& position,
     if (next_debug_filename!=~0U) { debug_filename = next_debug_filename; next_debug_filename = ~0U; }
   }
 
-  // Remove current run from managed list of gmic runs.
-  if (push_run) {
-    cimg::mutex(24);
-    for (int k = grl.width() - 1; k>=0; --k) {
-      CImg<void*> &_gr = grl[k];
-      if (_gr[0]==(void*)this &&
-          _gr[1]==(void*)&images &&
-          _gr[2]==(void*)&images_names &&
-          _gr[3]==(void*)&parent_images &&
-          _gr[4]==(void*)&parent_images_names &&
-          _gr[5]==(void*)variables_sizes &&
-          _gr[6]==(void*)command_selection) {
-        grl.remove(k); break;
-      }
-    }
-    cimg::mutex(24,0);
-  }
-
   return *this;
 }
 
@@ -15464,6 +16970,8 @@ template gmic& gmic::run(const char *const commands_line, \
 template gmic& gmic::run(const char *const commands_line, \
                          gmic_list<pt> &images, gmic_list<char> &images_names, \
                          float *const p_progress, bool *const p_is_abort); \
+template gmic_task gmic::run_async(const char *const commands_line, \
+                                   gmic_list<pt> &images, gmic_list<char> &images_names); \
 template CImg<pt>& CImg<pt>::assign(const unsigned int size_x, const unsigned int size_y, \
                                     const unsigned int size_z, const unsigned int size_c); \
 template CImgList<pt>& CImgList<pt>::assign(const unsigned int n)
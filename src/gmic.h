@@ -78,6 +78,9 @@
 const char gmic_dollar = 23, gmic_lbrace = 24, gmic_rbrace = 25, gmic_comma = 26, gmic_dquote = 28,
   gmic_store = 29; // <- this one is only used in variable names.
 
+// Deallocate a pixel buffer allocated by the library.
+void gmic_free(void *const ptr);
+
 #ifndef gmic_core
 
 // Define classes 'gmic_image<T>' and 'gmic_list<T>'.
@@ -100,7 +103,7 @@ namespace cimg_library {
 
     // Destructor.
     ~gmic_image() {
-      if (!_is_shared) delete[] _data;
+      if (!_is_shared) gmic_free(_data);
     }
 
     // Constructor.
@@ -204,42 +207,45 @@ namespace cimg_library {
 
 #ifdef cimg_use_abort
 inline bool *gmic_abort_ptr(bool *const p_is_abort);
-#define cimg_abort_init bool *const gmic_is_abort = ::gmic_abort_ptr(0); cimg::unused(gmic_is_abort)
+#define cimg_abort_init volatile bool *const gmic_is_abort = ::gmic_abort_ptr(0); cimg::unused(gmic_is_abort)
 #define cimg_abort_test if (*gmic_is_abort) throw CImgAbortException()
 #endif
 
-inline double gmic_mp_dollar(const char *const str, void *const p_list);
+inline void *gmic_mp_context();
+#define cimg_mp_context ::gmic_mp_context()
+
+inline double gmic_mp_dollar(const char *const str, void *const p_run);
 #define cimg_mp_operator_dollar(str) \
-  ::gmic_mp_dollar(str,&imglist)
+  ::gmic_mp_dollar(str,p_context)
 
 template<typename T>
 inline double gmic_mp_get(double *const ptrd, const unsigned int siz, const bool to_string, const char *const str,
-                          void *const p_list, const T& pixel_type);
+                          void *const p_run, const T& pixel_type);
 #define cimg_mp_func_get(ptrd,siz,to_string,str) \
-  return ::gmic_mp_get(ptrd,siz,to_string,str,&mp.imglist,(T)0)
+  return ::gmic_mp_get(ptrd,siz,to_string,str,mp.p_context,(T)0)
 
 inline double gmic_mp_set(const double *const ptrs, const unsigned int siz, const char *const str,
-                          void *const p_list);
+                          void *const p_run);
 #define cimg_mp_func_set(ptrs,siz,str) \
-  return ::gmic_mp_set(ptrs,siz,str,&mp.imglist)
+  return ::gmic_mp_set(ptrs,siz,str,mp.p_context)
 
 inline double gmic_mp_name(const unsigned int ind, double *const out_str, const unsigned int siz,
-                           void *const p_list);
+                           void *const p_run);
 #define cimg_mp_func_name(ind,out_str,siz) \
-  return ::gmic_mp_name(ind,out_str,siz,&mp.imglist)
+  return ::gmic_mp_name(ind,out_str,siz,mp.p_context)
 
 template<typename T>
-inline double gmic_mp_run(char *const str, void *const p_list, const T& pixel_type);
+inline double gmic_mp_run(char *const str, void *const p_run, const T& pixel_type);
 #define cimg_mp_func_run(str) \
-  return ::gmic_mp_run(str,&mp.imglist,(T)0)
+  return ::gmic_mp_run(str,mp.p_context,(T)0)
 
 template<typename T>
 inline double gmic_mp_store(const double *const ptrs, const unsigned int siz,
                             const unsigned int w, const unsigned int h, const unsigned int d, const unsigned int s,
                             const bool is_compressed, const char *const str,
-                            void *const p_list, const T& pixel_type);
+                            void *const p_run, const T& pixel_type);
 #define cimg_mp_func_store(ptrs,siz,w,h,d,s,is_compressed,str) \
-  return ::gmic_mp_store(ptrs,siz,w,h,d,s,is_compressed,str,&mp.imglist,(T)0)
+  return ::gmic_mp_store(ptrs,siz,w,h,d,s,is_compressed,str,mp.p_context,(T)0)
 
 #ifndef cimg_display
 #define cimg_display 0
@@ -267,6 +273,13 @@ inline double gmic_mp_store(const double *const ptrs, const unsigned int siz,
 #define gmic_image cimg_library::CImg
 #define gmic_list cimg_library::CImgList
 
+// Callbacks called by the interpreter (see 'gmic::set_callbacks()').
+// 'level' of a log message is 0 (information), 1 (warning) or 2 (error).
+typedef void (*gmic_progress_callback)(const float progress, void *const user_data);
+typedef void (*gmic_log_callback)(const char *const message, const unsigned int level, void *const user_data);
+
+struct gmic_task;
+
 // Class 'gmic'.
 struct gmic {
 
@@ -305,6 +318,16 @@ struct gmic {
   gmic& run(const char *const commands_line, gmic_list<T> &images, gmic_list<char> &images_names,
             float *const p_progress=0, bool *const p_is_abort=0);
 
+  // Run G'MIC pipeline in a new thread, and return immediately.
+  // The instance, 'images' and 'images_names' must not be accessed until the returned task is done.
+  template<typename T>
+  gmic_task run_async(const char *const commands_line, gmic_list<T> &images, gmic_list<char> &images_names);
+
+  // Set callbacks called when progress changes (command 'progress') and instead of printing log messages.
+  // They are called from the thread running the pipeline (including threads of command 'parallel').
+  gmic& set_callbacks(const gmic_progress_callback progress_callback, const gmic_log_callback log_callback,
+                      void *const user_data=0);
+
   // These functions return (or init) G'MIC-specific paths.
   static const char* path_user(const char *const custom_path=0);
   static const char* path_rc(const char *const custom_path=0);
@@ -313,19 +336,19 @@ struct gmic {
   // Functions below should be considered as *private*, and should not be used in user's code.
   template<typename T>
   static bool search_sorted(const char *const str, const T& list, const unsigned int length, unsigned int &out_ind);
-  static double mp_dollar(const char *const str, void *const p_list);
+  static double mp_dollar(const char *const str, void *const p_run);
   template<typename T>
   static double mp_get(double *const ptrd, const unsigned int siz, const bool to_string, const char *const str,
-                       void *const p_list, const T& pixel_type);
-  static double mp_set(const double *const ptrs, const unsigned int siz, const char *const str, void *const p_list);
-  static double mp_name(const unsigned int ind, double *const out_str, const unsigned int siz, void *const p_list);
+                       void *const p_run, const T& pixel_type);
+  static double mp_set(const double *const ptrs, const unsigned int siz, const char *const str, void *const p_run);
+  static double mp_name(const unsigned int ind, double *const out_str, const unsigned int siz, void *const p_run);
   template<typename T>
-  static double mp_run(char *const str, void *const p_list, const T& pixel_type);
+  static double mp_run(char *const str, void *const p_run, const T& pixel_type);
   template<typename T>
   static double mp_store(const double *const ptrs, const unsigned int siz,
                          const unsigned int w, const unsigned int h, const unsigned int d, const unsigned int s,
                          const bool is_compressed, const char *const str,
-                         void *const p_list, const T& pixel_type);
+                         void *const p_run, const T& pixel_type);
   static bool get_debug_info(const char *const s, unsigned int &line_number, unsigned int &file_number);
   static int _levenshtein(const char *const s, const char *const t, gmic_image<int>& d, const int i, const int j);
   static int levenshtein(const char *const s, const char *const t);
@@ -337,24 +360,31 @@ struct gmic {
   static unsigned int strescape(const char *const str, char *const res);
   static const gmic_image<char>& decompress_stdlib();
   static bool *abort_ptr(bool *const p_is_abort);
+  static void **&current_run();
 
   template<typename T>
   gmic& _gmic(const char *const commands_line, gmic_list<T>& images, gmic_list<char>& images_names,
               const char *const custom_commands, const bool include_stdlib,
               float *const p_progress, bool *const p_is_abort);
 
-  gmic_image<char> get_variable(const char *const name, const unsigned int *const variables_sizes=0,
+  gmic_image<char> get_variable(const char *const name, const unsigned int *const variables_scope=0,
                                 const gmic_list<char> *const images_names=0) const;
   const char *set_variable(const char *const name, const char operation='=', const char *const value=0,
-                           const double *const pvalue=0, const unsigned int *const variables_sizes=0);
+                           const double *const pvalue=0, const unsigned int *const variables_scope=0);
   const char *set_variable(const char *const name, const gmic_image<unsigned char>& value,
-                           const unsigned int *const variables_sizes=0);
+                           const unsigned int *const variables_scope=0);
+  unsigned int variables_bound(const unsigned int hash, const unsigned int *const variables_scope) const;
+  void mark_variables_slot(const unsigned int hash, const unsigned int *const variables_scope);
+  void unroll_variables_log(const unsigned int nb_log);
 
   gmic& add_commands(const char *const data_commands, const char *const commands_file=0,
                      const bool add_debug_info=false, unsigned int *count_new=0,
-                     unsigned int *count_replaced=0, bool *const is_entrypoint=0);
+                     unsigned int *count_replaced=0, bool *const is_entrypoint=0,
+                     gmic_list<char> *const block_warnings=0);
   gmic& add_commands(std::FILE *const file, const char *const filename=0, const bool add_debug_info=false,
-                     unsigned int *count_new=0, unsigned int *count_replaced=0, bool *const is_entrypoint=0);
+                     unsigned int *count_new=0, unsigned int *count_replaced=0, bool *const is_entrypoint=0,
+                     gmic_list<char> *const block_warnings=0);
+  gmic& add_commands_stdlib();
 
   gmic_image<char> callstack2string(const bool _is_debug=false) const;
   gmic_image<char> callstack2string(const gmic_image<unsigned int>& callstack_selection,
@@ -371,28 +401,47 @@ struct gmic {
                                      const unsigned int display_selection, gmic_image<char>& res) const;
 
   gmic_list<char> commands_line_to_CImgList(const char *const commands_line);
+  void get_cached_commands_line(const char *const commands_line, gmic_list<char>& items,
+                                gmic_image<unsigned int>& blocks, gmic_image<char>& key);
+  void set_cached_commands_line(gmic_list<char>& items, gmic_image<unsigned int>& blocks, gmic_image<char>& key);
+  static gmic_image<unsigned int> commands_line_blocks(const gmic_list<char>& commands_line);
+  static const char *check_commands_line_blocks(const gmic_list<char>& commands_line);
+  void check_command_blocks(const char *const command_name, const char *const body, const char *const commands_file,
+                            gmic_list<char>& block_warnings);
+  unsigned int skip_block(const gmic_list<char>& commands_line, gmic_image<unsigned int>& blocks,
+                          const unsigned int position, const unsigned int kind,
+                          unsigned int& next_debug_line, unsigned int& next_debug_filename);
 
   template<typename T>
   void _gmic_substitute_args(const char *const argument, const char *const argument0, const char *const command,
                              const char *const item, const gmic_list<T>& images);
 
   gmic& print(const char *format, ...);
+  gmic& warn(const char *format, ...);
   gmic& error(const bool output_header, const char *format, ...);
   gmic& debug(const char *format, ...);
 
   template<typename T>
   gmic_image<char> substitute_item(const char *const source, gmic_list<T>& images, gmic_list<char>& images_names,
                                    gmic_list<T>& parent_images, gmic_list<char>& parent_images_names,
-                                   const unsigned int *const variables_sizes,
+                                   const unsigned int *const variables_scope,
                                    const gmic_image<unsigned int> *const command_selection, const bool is_image_expr);
 
+  void init_thread(gmic &gmic_instance);
   template<typename T>
   void wait_threads(void *const p_gmic_threads, const bool try_abort, const T& pixel_type);
+  template<typename T>
+  void run_foreach(void *const p_foreach, gmic_list<T>& images, gmic_list<char>& images_names,
+                   gmic_list<T>& parent_images, gmic_list<char>& parent_images_names,
+                   const gmic_image<unsigned int> *const command_selection);
 
   template<typename T>
   gmic& print(const gmic_list<T>& list, const gmic_image<unsigned int> *const callstack_selection,
               const char *format, ...);
 
+  void notify_log(const unsigned int level, const char *const s_callstack, const unsigned int nb_images,
+                  const char *const message);
+
   template<typename T>
   gmic& warn(const gmic_list<T>& list, const gmic_image<unsigned int> *const callstack_selection,
              const bool force_visible, const char *format, ...);
@@ -440,27 +489,32 @@ struct gmic {
   template<typename T>
   gmic& _run(const gmic_list<char>& commands_line, unsigned int& position, gmic_list<T>& images,
              gmic_list<char>&images_names, gmic_list<T>& parent_images, gmic_list<char>& parent_images_names,
-             const unsigned int *const variables_sizes, bool *const is_noargs, const char *const parent_arguments,
-             const gmic_image<unsigned int> *const command_selection);
+             const unsigned int *const variables_scope, bool *const is_noargs, const char *const parent_arguments,
+             const gmic_image<unsigned int> *const command_selection, gmic_image<unsigned int> *const p_blocks=0);
 
   // Class attributes.
   static const char *builtin_commands_names[];
   static gmic_image<int> builtin_commands_inds;
   static gmic_image<char> stdlib;
-  static gmic_list<void*> list_p_is_abort;
   static bool is_display_available;
 
   gmic_list<char> *commands, *commands_names, *commands_has_arguments, *_variables, *_variables_names,
-    **variables, **variables_names, commands_files, callstack;
-  gmic_image<unsigned int> dowhiles, fordones, foreachdones, repeatdones;
+    **variables, **variables_names, *cached_commands_lines, commands_files, callstack, scratch,
+    cached_commands_lines_keys, cached_selections_keys;
+  gmic_list<unsigned int> cached_selections, cached_commands_blocks;
+  gmic_image<unsigned int> dowhiles, fordones, foreachdones, repeatdones, cached_selections_sizes, variables_scopes,
+    variables_log;
   gmic_image<unsigned char> light3d;
   gmic_image<void*> display_windows;
   gmic_image<char> status;
+  gmic_progress_callback progress_callback;
+  gmic_log_callback log_callback;
+  void *callback_data, *foreach_workers;
 
   float focale3d, light3d_x, light3d_y, light3d_z, specular_lightness3d, specular_shininess3d, _progress, *progress;
   gmic_uint64 reference_time;
   unsigned int nb_dowhiles, nb_fordones, nb_foreachdones, nb_repeatdones, nb_carriages_default, nb_carriages_stdout,
-    debug_filename, debug_line, cimg_exception_mode;
+    nb_scratch, nb_variables_log, variables_level, debug_filename, debug_line, cimg_exception_mode;
   int verbosity, render3d, renderd3d, network_timeout;
   bool allow_entrypoint, is_change, is_debug, is_running, is_start, is_return, is_quit, is_double3d, is_debug_info,
     _is_abort, *is_abort, is_abort_thread;
@@ -496,42 +550,85 @@ struct gmic_exception {
   }
 };
 
+// Class 'gmic_task'.
+//-------------------
+// Handle on a pipeline run asynchronously by 'gmic::run_async()'. Copies share the same run.
+// Cancellation is cooperative: it is checked before each command, for each line processed by the
+// Deriche and Van Vliet recursive filters (used by 'blur' and 'bilateral'), for each row of the
+// structure and diffusion tensors (used by 'smooth'), and between iterations of 'smooth' and 'matchpatch'.
+// When the last handle on a running task is destroyed, the task is cancelled and waited for.
+struct gmic_task {
+  void *_state;
+
+  // Constructors / destructor.
+  gmic_task();
+  gmic_task(const gmic_task& task);
+  gmic_task& operator=(const gmic_task& task);
+  ~gmic_task();
+
+  // Tell if handle refers to a run.
+  bool is_valid() const;
+
+  // Tell if run has finished (successfully, with an error, or cancelled).
+  bool is_done() const;
+
+  // Wait for the run to finish, for at most 'milliseconds' (~0U means forever).
+  // Return 'true' if run has finished.
+  bool wait(const unsigned int milliseconds=~0U) const;
+
+  // Request cancellation of the run (does not wait).
+  const gmic_task& cancel() const;
+
+  // Return current progress (in [0,100], or -1 if undefined).
+  float progress() const;
+
+  // Return error raised by the run (with an empty message if none, or if not done yet).
+  const gmic_exception& exception() const;
+
+  // Wait for the run to finish, and throw its error (if any).
+  void get() const;
+};
+
 inline bool *gmic_abort_ptr(bool *const p_is_abort) {
   return gmic::abort_ptr(p_is_abort);
 }
 
-inline double gmic_mp_dollar(const char *const str, void *const p_list) {
-  return gmic::mp_dollar(str,p_list);
+inline void *gmic_mp_context() {
+  return gmic::current_run();
+}
+
+inline double gmic_mp_dollar(const char *const str, void *const p_run) {
+  return gmic::mp_dollar(str,p_run);
 }
 
 template<typename T>
 inline double gmic_mp_get(double *const ptrd, const unsigned int siz, const bool to_string, const char *const str,
-                          void *const p_list, const T& pixel_type) {
-  return gmic::mp_get(ptrd,siz,to_string,str,p_list,pixel_type);
+                          void *const p_run, const T& pixel_type) {
+  return gmic::mp_get(ptrd,siz,to_string,str,p_run,pixel_type);
 }
 
 inline double gmic_mp_set(const double *const ptrs, const unsigned int siz, const char *const str,
-                          void *const p_list) {
-  return gmic::mp_set(ptrs,siz,str,p_list);
+                          void *const p_run) {
+  return gmic::mp_set(ptrs,siz,str,p_run);
 }
 
 inline double gmic_mp_name(const unsigned int ind, double *const out_str, const unsigned int siz,
-                           void *const p_list) {
-  return gmic::mp_name(ind,out_str,siz,p_list);
+                           void *const p_run) {
+  return gmic::mp_name(ind,out_str,siz,p_run);
 }
 
 template<typename T>
 inline double gmic_mp_run(char *const str,
-                          void *const p_list, const T& pixel_type) {
-  return gmic::mp_run(str,p_list,pixel_type);
+                          void *const p_run, const T& pixel_type) {
+  return gmic::mp_run(str,p_run,pixel_type);
 }
 
 template<typename T>
 inline double gmic_mp_store(const double *const ptrs, const unsigned int siz,
                             const unsigned int w, const unsigned int h, const unsigned int d, const unsigned int s,
                             const bool is_compressed, const char *const str,
-                            void *const p_list, const T& pixel_type) {
-  return gmic::mp_store(ptrs,siz,w,h,d,s,is_compressed,str,p_list,pixel_type);
+                            void *const p_run, const T& pixel_type) {
+  return gmic::mp_store(ptrs,siz,w,h,d,s,is_compressed,str,p_run,pixel_type);
 }
 
 #endif // #ifndef gmic_version
@@ -52,6 +52,12 @@
 #include <signal.h>
 #include "CImg.h"
 #include "gmic.h"
+#if cimg_OS==1
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
 using namespace cimg_library;
 
 // Fallback function for segfault signals.
@@ -74,74 +80,13 @@ void gmic_segfault_sigaction(int signal, siginfo_t *si, void *arg) {
 int _CRT_glob = 0; // Disable globbing for msys
 #endif
 
-// Main entry
-//------------
-int main(int argc, char **argv) {
-
-  // Set default output messages stream.
-  const bool is_debug = cimg_option("-debug",false,0) || cimg_option("debug",false,0);
-  cimg::output(is_debug?stdout:stderr);
-
-  // Set fallback for segfault signals.
-#if cimg_OS==1
-  struct sigaction sa;
-  std::memset(&sa,0,sizeof(sa));
-  sigemptyset(&sa.sa_mask);
-  sa.sa_sigaction = gmic_segfault_sigaction;
-  sa.sa_flags = SA_SIGINFO;
-  sigaction(SIGSEGV,&sa,0);
-#endif
-
-  // Init resources folder.
-  if (!gmic::init_rc()) {
-    std::fprintf(cimg::output(),
-                 "\n[gmic] Unable to create resources folder.\n");
-    std::fflush(cimg::output());
-  }
-
-  // Set special path for curl on Windows
-  // (in case the use of libcurl is not enabled).
-#if cimg_OS==2
-  cimg::curl_path("_gmic\\curl",true);
-#endif
-
-  // Declare main G'MIC instance.
-  gmic gmic_instance;
-  gmic_instance.set_variable("_host",0,"cli");
-  gmic_instance.add_commands("cli_start : ");
-
-  // Load startup command files.
-  CImg<char> commands_user, commands_update, filename_update;
-  bool is_invalid_userfile = false, is_invalid_updatefile = false;
+// Run a command line given as arguments, with a warm G'MIC instance.
+//-------------------------------------------------------------------
+int gmic_cli_run(gmic& gmic_instance, int argc, char **argv, const bool is_debug,
+                 const char *const filename_update, const char *const filename_user,
+                 const bool is_invalid_updatefile, const bool is_invalid_userfile) {
   char sep = 0;
 
-  // Import update file (from resources directory).
-  filename_update.assign(1024);
-  cimg_snprintf(filename_update,filename_update.width(),"%supdate%u.gmic",
-                gmic::path_rc(),gmic_version);
-  try { commands_update.load_cimg(filename_update); }
-  catch (...) {
-    try { commands_update.load_raw(filename_update); }
-    catch (...) { }
-  }
-  if (commands_update) try {
-      commands_update.unroll('y');
-      commands_update.resize(1,commands_update.height() + 1,1,1,0);
-      gmic_instance.add_commands(commands_update);
-    } catch (...) { is_invalid_updatefile = true; }
-  is_invalid_updatefile|=commands_update && (cimg_sscanf(commands_update," #@gmi%c",&sep)!=1 || sep!='c');
-  commands_update.assign();
-
-  // Import user file (in parent of resources directory).
-  const char *const filename_user = gmic::path_user();
-  try { commands_user.load_raw(filename_user); }
-  catch (...) {}
-  if (commands_user) try {
-      commands_user.resize(1,commands_user.height() + 1,1,1,0);
-      gmic_instance.add_commands(commands_user,filename_user,is_debug);
-    } catch (...) { is_invalid_userfile = true; }
-  commands_user.assign();
-
   // Convert 'argv' into G'MIC command line.
   CImgList<char> items;
   if (argc==1) // When no args have been specified
@@ -202,7 +147,7 @@ int main(int argc, char **argv) {
   if (is_invalid_updatefile) { // Display warning message in case of invalid user command file
     CImg<char> tmpstr(1024);
     cimg_snprintf(tmpstr,tmpstr.width(),"warn \"File '\"{/\"%s\"}\"' is not a valid G'MIC update file.\" ",
-                  filename_update.data());
+                  filename_update);
     items.insert(CImg<char>::string(tmpstr.data(),false),is_first_item_verbose?2:0);
   }
 
@@ -246,7 +191,7 @@ int main(int argc, char **argv) {
                       "l[] i raw:\"%s\",char m \"%s\" onfail rm done "
                       "l[] i raw:\"%s\",char m \"%s\" onfail rm done "
                       "rv help \"%s\",0",
-                      filename_update.data(),filename_update.data(),
+                      filename_update,filename_update,
                       filename_user,filename_user,
                       e.command());
         try {
@@ -266,3 +211,307 @@ int main(int argc, char **argv) {
   }
   return 0;
 }
+
+// Server/client mode.
+//--------------------
+// A server ('gmic --server <socket>') loads the stdlib, the update and the user command files
+// once, then forks one child per request, so that each request runs on a warm copy of the
+// interpreter. A client ('gmic --client <socket> [args]', or any invocation with the
+// environment variable 'GMIC_SERVER' set) passes its standard streams, working directory,
+// environment and arguments through the unix socket, and exits with the status of the remote run.
+// Images are exchanged as files (relative paths are resolved from the client directory)
+// or through the standard streams.
+#if cimg_OS==1
+extern char **environ;
+
+static bool gmic_cli_write(const int fd, const void *const data, const size_t size) {
+  const char *ptr = (const char*)data;
+  for (size_t remaining = size; remaining; ) {
+    const ssize_t n = ::write(fd,ptr,remaining);
+    if (n<=0) return false;
+    ptr+=n; remaining-=(size_t)n;
+  }
+  return true;
+}
+
+static bool gmic_cli_read(const int fd, void *const data, const size_t size) {
+  char *ptr = (char*)data;
+  for (size_t remaining = size; remaining; ) {
+    const ssize_t n = ::read(fd,ptr,remaining);
+    if (n<=0) return false;
+    ptr+=n; remaining-=(size_t)n;
+  }
+  return true;
+}
+
+static bool gmic_cli_write_string(const int fd, const char *const str) {
+  const unsigned int size = (unsigned int)std::strlen(str);
+  return gmic_cli_write(fd,&size,sizeof(size)) && gmic_cli_write(fd,str,size);
+}
+
+static bool gmic_cli_read_string(const int fd, CImg<char>& str) {
+  unsigned int size = 0;
+  if (!gmic_cli_read(fd,&size,sizeof(size)) || size>(1U<<24)) return false;
+  str.assign(size + 1);
+  str.back() = 0;
+  return !size || gmic_cli_read(fd,str.data(),size);
+}
+
+static int gmic_cli_socket(const char *const path, struct sockaddr_un& addr) {
+  if (std::strlen(path)>=sizeof(addr.sun_path)) return -1;
+  std::memset(&addr,0,sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  std::strcpy(addr.sun_path,path);
+  return ::socket(AF_UNIX,SOCK_STREAM,0);
+}
+
+// Send a request to a server and get its exit status (return 'false' if the server cannot be reached).
+bool gmic_client(const char *const path, int argc, char **argv, int& status) {
+  struct sockaddr_un addr;
+  const int fd = gmic_cli_socket(path,addr);
+  if (fd<0) return false;
+  if (::connect(fd,(struct sockaddr*)&addr,sizeof(addr))) { ::close(fd); return false; }
+
+  // Pass standard streams along with the first byte of the request.
+  int fds[3] = { 0, 1, 2 };
+  char control[CMSG_SPACE(sizeof(fds))], tag = 'G';
+  std::memset(control,0,sizeof(control));
+  struct iovec iov;
+  iov.iov_base = &tag;
+  iov.iov_len = 1;
+  struct msghdr msg;
+  std::memset(&msg,0,sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  struct cmsghdr *const cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  std::memcpy(CMSG_DATA(cmsg),fds,sizeof(fds));
+  std::fflush(stdout);
+  std::fflush(stderr);
+  if (::sendmsg(fd,&msg,0)!=1) { ::close(fd); return false; }
+
+  // Send working directory, environment and arguments.
+  CImg<char> cwd(4096);
+  bool is_sent = ::getcwd(cwd,cwd.width())!=0 && gmic_cli_write_string(fd,cwd);
+  unsigned int nb_envs = 0;
+  if (environ) while (environ[nb_envs]) ++nb_envs;
+  is_sent = is_sent && gmic_cli_write(fd,&nb_envs,sizeof(nb_envs));
+  for (unsigned int l = 0; is_sent && l<nb_envs; ++l) is_sent = gmic_cli_write_string(fd,environ[l]);
+  const unsigned int nb_args = (unsigned int)argc;
+  is_sent = is_sent && gmic_cli_write(fd,&nb_args,sizeof(nb_args));
+  for (int l = 0; is_sent && l<argc; ++l) is_sent = gmic_cli_write_string(fd,argv[l]);
+
+  if (!is_sent || !gmic_cli_read(fd,&status,sizeof(status))) {
+    std::fprintf(cimg::output(),"\n[gmic] Connection to server '%s' has been lost.\n",path);
+    std::fflush(cimg::output());
+    status = EXIT_FAILURE;
+  }
+  ::close(fd);
+  return true;
+}
+
+// Serve requests from a child process, with a copy of the warm interpreter.
+static void gmic_server_serve(const int fd, gmic& gmic_instance,
+                              const char *const filename_update, const char *const filename_user,
+                              const bool is_invalid_updatefile, const bool is_invalid_userfile) {
+  int fds[3] = { -1, -1, -1 };
+  char control[CMSG_SPACE(sizeof(fds))], tag = 0;
+  struct iovec iov;
+  iov.iov_base = &tag;
+  iov.iov_len = 1;
+  struct msghdr msg;
+  std::memset(&msg,0,sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  if (::recvmsg(fd,&msg,0)!=1 || tag!='G') return;
+  struct cmsghdr *const cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || cmsg->cmsg_type!=SCM_RIGHTS || cmsg->cmsg_len!=CMSG_LEN(sizeof(fds))) return;
+  std::memcpy(fds,CMSG_DATA(cmsg),sizeof(fds));
+
+  CImg<char> cwd;
+  unsigned int nb_envs = 0, nb_args = 0;
+  if (!gmic_cli_read_string(fd,cwd) ||
+      !gmic_cli_read(fd,&nb_envs,sizeof(nb_envs)) || nb_envs>65536) return;
+  CImgList<char> envs(nb_envs);
+  cimglist_for(envs,l) if (!gmic_cli_read_string(fd,envs[l])) return;
+  CImg<char *> envp(nb_envs + 1);
+  cimglist_for(envs,l) envp[l] = envs[l].data();
+  envp[nb_envs] = 0;
+  if (!gmic_cli_read(fd,&nb_args,sizeof(nb_args)) || !nb_args || nb_args>65536) return;
+  CImgList<char> args(nb_args);
+  cimglist_for(args,l) if (!gmic_cli_read_string(fd,args[l])) return;
+  CImg<char *> argv(nb_args + 1);
+  cimglist_for(args,l) argv[l] = args[l].data();
+  argv[nb_args] = 0;
+
+  // Take over the client's standard streams, environment and working directory.
+  for (int k = 0; k<3; ++k) { ::dup2(fds[k],k); ::close(fds[k]); }
+  environ = envp.data(); // Variables not defined in the interpreter are looked up from the client environment
+  int status = EXIT_FAILURE;
+  if (::chdir(cwd)) {
+    std::fprintf(stderr,"\n[gmic] Server cannot change to directory '%s'.\n",cwd.data());
+    std::fflush(stderr);
+  } else {
+    const int argc = (int)nb_args;
+    const bool is_debug = cimg_option("-debug",false,0) || cimg_option("debug",false,0);
+    cimg::output(is_debug?stdout:stderr);
+    status = gmic_cli_run(gmic_instance,argc,argv.data(),is_debug,filename_update,filename_user,
+                          is_invalid_updatefile,is_invalid_userfile);
+  }
+  std::fflush(stdout);
+  std::fflush(stderr);
+  gmic_cli_write(fd,&status,sizeof(status));
+}
+
+int gmic_server(const char *const path, gmic& gmic_instance,
+                const char *const filename_update, const char *const filename_user,
+                const bool is_invalid_updatefile, const bool is_invalid_userfile) {
+  struct sockaddr_un addr;
+  struct stat st;
+  if (!::lstat(path,&st)) { // Only replace a stale socket, never another kind of file
+    if (!S_ISSOCK(st.st_mode)) {
+      std::fprintf(cimg::output(),"\n[gmic] Path '%s' already exists and is not a socket.\n",path);
+      std::fflush(cimg::output());
+      return EXIT_FAILURE;
+    }
+    ::unlink(path);
+  }
+
+  // Socket is only accessible by the current user, as clients can run any command (including 'exec').
+  const int server_fd = gmic_cli_socket(path,addr);
+  const mode_t o_mask = ::umask(0077);
+  const bool is_bound = server_fd>=0 && !::bind(server_fd,(struct sockaddr*)&addr,sizeof(addr));
+  ::umask(o_mask);
+  if (!is_bound || ::chmod(path,0600) || ::listen(server_fd,64)) {
+    std::fprintf(cimg::output(),"\n[gmic] Unable to listen on socket '%s'.\n",path);
+    std::fflush(cimg::output());
+    return EXIT_FAILURE;
+  }
+  std::fprintf(cimg::output(),"[gmic] Server listening on socket '%s'.\n",path);
+  std::fflush(cimg::output());
+  signal(SIGCHLD,SIG_IGN); // Children are reaped automatically
+  signal(SIGPIPE,SIG_IGN);
+  for (;;) {
+    const int fd = ::accept(server_fd,0,0);
+    if (fd<0) continue;
+    std::fflush(stdout);
+    std::fflush(stderr);
+    const pid_t pid = ::fork();
+    if (!pid) {
+      ::close(server_fd);
+      signal(SIGCHLD,SIG_DFL);
+      gmic_server_serve(fd,gmic_instance,filename_update,filename_user,
+                        is_invalid_updatefile,is_invalid_userfile);
+      ::close(fd);
+      std::exit(0);
+    }
+    if (pid<0) {
+      const int status = EXIT_FAILURE;
+      gmic_cli_write(fd,&status,sizeof(status));
+    }
+    ::close(fd);
+  }
+  return 0;
+}
+#endif
+
+// Main entry
+//------------
+int main(int argc, char **argv) {
+
+  // Set default output messages stream.
+  const bool is_debug = cimg_option("-debug",false,0) || cimg_option("debug",false,0);
+  cimg::output(is_debug?stdout:stderr);
+
+#if cimg_OS==1
+  // Redirect to a server, if requested.
+  const char *server_path = 0;
+  const bool is_server = argc>=3 && !std::strcmp(argv[1],"--server");
+  int status = 0;
+  if (argc>=3 && !std::strcmp(argv[1],"--client")) {
+    if (!gmic_client(argv[2],argc - 2,argv + 2,status)) {
+      std::fprintf(cimg::output(),"\n[gmic] Unable to connect to server '%s'.\n",argv[2]);
+      std::fflush(cimg::output());
+      return EXIT_FAILURE;
+    }
+    return status;
+  }
+  if (is_server) server_path = argv[2];
+  else if ((server_path = std::getenv("GMIC_SERVER"))!=0 && *server_path &&
+           gmic_client(server_path,argc,argv,status)) return status; // Otherwise, fallback to a local run
+#endif
+
+  // Set fallback for segfault signals.
+#if cimg_OS==1
+  struct sigaction sa;
+  std::memset(&sa,0,sizeof(sa));
+  sigemptyset(&sa.sa_mask);
+  sa.sa_sigaction = gmic_segfault_sigaction;
+  sa.sa_flags = SA_SIGINFO;
+  sigaction(SIGSEGV,&sa,0);
+#endif
+
+  // Init resources folder.
+  if (!gmic::init_rc()) {
+    std::fprintf(cimg::output(),
+                 "\n[gmic] Unable to create resources folder.\n");
+    std::fflush(cimg::output());
+  }
+
+  // Set special path for curl on Windows
+  // (in case the use of libcurl is not enabled).
+#if cimg_OS==2
+  cimg::curl_path("_gmic\\curl",true);
+#endif
+
+  // Declare main G'MIC instance.
+  gmic gmic_instance;
+  gmic_instance.set_variable("_host",0,"cli");
+  gmic_instance.add_commands("cli_start : ");
+
+  // Load startup command files.
+  CImg<char> commands_user, commands_update, filename_update;
+  bool is_invalid_userfile = false, is_invalid_updatefile = false;
+  char sep = 0;
+
+  // Import update file (from resources directory).
+  filename_update.assign(1024);
+  cimg_snprintf(filename_update,filename_update.width(),"%supdate%u.gmic",
+                gmic::path_rc(),gmic_version);
+  try { commands_update.load_cimg(filename_update); }
+  catch (...) {
+    try { commands_update.load_raw(filename_update); }
+    catch (...) { }
+  }
+  if (commands_update) try {
+      commands_update.unroll('y');
+      commands_update.resize(1,commands_update.height() + 1,1,1,0);
+      gmic_instance.add_commands(commands_update);
+    } catch (...) { is_invalid_updatefile = true; }
+  is_invalid_updatefile|=commands_update && (cimg_sscanf(commands_update," #@gmi%c",&sep)!=1 || sep!='c');
+  commands_update.assign();
+
+  // Import user file (in parent of resources directory).
+  const char *const filename_user = gmic::path_user();
+  try { commands_user.load_raw(filename_user); }
+  catch (...) {}
+  if (commands_user) try {
+      commands_user.resize(1,commands_user.height() + 1,1,1,0);
+      gmic_instance.add_commands(commands_user,filename_user,is_debug);
+    } catch (...) { is_invalid_userfile = true; }
+  commands_user.assign();
+
+#if cimg_OS==1
+  if (is_server)
+    return gmic_server(server_path,gmic_instance,filename_update,filename_user,
+                       is_invalid_updatefile,is_invalid_userfile);
+#endif
+  return gmic_cli_run(gmic_instance,argc,argv,is_debug,filename_update,filename_user,
+                      is_invalid_updatefile,is_invalid_userfile);
+}
@@ -46,7 +46,7 @@
 #include "gmic_libc.h"
 
 GMIC_DLLINTERFACE int GMIC_CALLCONV gmic_delete_external(float* p) {
-  delete[] p;
+  cimg_library::cimg::memfree(p);
   return 0;
 }
 